@@ -0,0 +1,1047 @@
+/* ****************************************************************************
+ *
+ *   Micro-benchmarks of the C interface. Usage:
+ *
+ *      bench [-n iteration] <mode> [json-file ...]
+ *
+ *   The modes are:
+ *      o. scan: jp_parse_ex() with JP_PREALLOC, with the memory estimated
+ *               after the input versus bounded by the tokens counted ahead
+ *               of parsing (JP_STRUCT_INDEX).
+ *      o. str:  string scaning over synthesized escape-free and escape-heavy
+ *               strings, with and without JP_ZERO_COPY; report the size of
+ *               the result per byte of the input as well. It takes no
+ *               json-file.
+ *      o. fp:   floating point numbers over synthesized short decimals (e.g.
+ *               latencies), coordinates and full-precision doubles, along
+ *               with strtod() over the same literals for reference. It takes
+ *               no json-file.
+ *      o. mem:  parse with page-size chunks, with chunks growing
+ *               geometrically (with and without huge pages), with the
+ *               memory retained across jp_parse() calls, and with the
+ *               memory preallocated (JP_PREALLOC), and with the tape
+ *               (jp_parse_tape()); report the # of chunk allocations per
+ *               parse, and the size of the result per byte of the input.
+ *      o. tape: parse to linked lists (jp_parse_ex()) versus to the tape
+ *               (jp_parse_tape()), with and without visiting every object
+ *               of the result afterwards.
+ *      o. stream: jp_parse_tape() versus jp_feed() in pieces of 1K, 4K and
+ *               64K bytes.
+ *      o. validate: jp_validate() versus jp_parse_ex() and jp_parse_tape().
+ *      o. paths: picking a few values out of a synthesized 50K-byte document
+ *               with jp_parse_paths(), with the values near the beginning,
+ *               and spread across the document, versus jp_parse_tape() of
+ *               the whole document. It takes no json-file.
+ *      o. skip: jp_parse_tape() versus jp_parse_shallow(), and versus
+ *               jp_skip_value() which skips the whole json without parsing
+ *               it.
+ *      o. keys: jp_hashtab_get() over synthesized hashtabs of 10, 100 and
+ *               10K keys, with and without JP_KEY_INDEX, along with the
+ *               throughput of jp_parse_tape() with and without the index.
+ *               It takes no json-file.
+ *      o. many: synthesized newline-delimited jsons (log records), parsed
+ *               line by line with jp_parse_tape() versus as a whole with
+ *               jp_parse_many(). It takes no json-file.
+ *      o. pool: jp_pool_parse_many() over synthesized newline-delimited
+ *               jsons, and jp_pool_parse() over the array of the same jsons,
+ *               with 1, 2, 4, ... threads, up to the # of CPUs. It takes no
+ *               json-file.
+ *
+ * ****************************************************************************
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ljson_parser.h"
+
+static int iteration = 1000;
+
+static char*
+load_json(const char* file_path, size_t* len) {
+    struct stat buf;
+    if (stat(file_path, &buf)) {
+        perror("stat");
+        exit(1);
+    }
+
+    if (!S_ISREG(buf.st_mode)) {
+        fprintf(stderr, "not regular file");
+        exit(1);
+    }
+
+    size_t file_len = buf.st_size;
+
+    int fd = open(file_path, 0);
+    if (fd == -1) {
+        perror("open");
+        exit(1);
+    }
+
+    char *payload = malloc(file_len);
+    if (payload == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    if (read(fd, payload, file_len) != file_len) {
+        perror("read");
+        exit(1);
+    }
+
+    close(fd);
+
+    *len = file_len;
+    return payload;
+}
+
+static double
+now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Return the throughput in MB/s given the # of bytes processed "iteration"
+ * times in "elapsed" seconds.
+ */
+static double
+mb_per_sec(size_t len, double elapsed) {
+    return (double)len * iteration / elapsed / (1024 * 1024);
+}
+
+/* Parse the json "iteration" times with given flags, return the throughput
+ * in MB/s (the best of 3 rounds), or -1 if the json is malformed.
+ */
+static double
+time_parse(struct json_parser* jp, const char* json, size_t len,
+           uint32_t flags) {
+    double best = 0;
+    int round;
+    for (round = 0; round < 3; round++) {
+        double start = now_sec();
+        int i;
+        for (i = 0; i < iteration; i++) {
+            if (!jp_parse_ex(jp, json, len, flags)) {
+                fprintf(stderr, "parsing failed: %s\n", jp_get_err(jp));
+                return -1;
+            }
+        }
+
+        double tp = mb_per_sec(len, now_sec() - start);
+        if (tp > best)
+            best = tp;
+    }
+    return best;
+}
+
+static int
+bench_scan(const char* file, const char* json, size_t len) {
+    struct json_parser* jp = jp_create();
+    if (!jp) {
+        fprintf(stderr, "fail to create parser\n");
+        return 1;
+    }
+
+    double base = time_parse(jp, json, len, JP_PREALLOC);
+    double counted = time_parse(jp, json, len, JP_PREALLOC | JP_STRUCT_INDEX);
+    jp_destroy(jp);
+
+    if (base < 0 || counted < 0)
+        return 1;
+
+    fprintf(stdout, "%-24s %10zu bytes  estimate: %8.1f MB/s  "
+                    "count: %8.1f MB/s  (%+.1f%%)\n",
+            file, len, base, counted, (counted - base) / base * 100);
+    return 0;
+}
+
+/* Synthesize an array of strings, each of which has "str_len" characters,
+ * and every "esc_dist"-th character of which is an escape (0 means no escape
+ * at all).
+ */
+static char*
+synthesize_str_array(int str_num, int str_len, int esc_dist, size_t* len) {
+    static const char* escapes[] = { "\\n", "\\\"", "\\\\", "\\u00e9" };
+    char* json = malloc((size_t)str_num * (str_len * 6 + 3) + 2);
+    char* p = json;
+
+    *p++ = '[';
+    int i, j;
+    for (i = 0; i < str_num; i++) {
+        if (i)
+            *p++ = ',';
+        *p++ = '"';
+        for (j = 0; j < str_len; j++) {
+            if (esc_dist && j % esc_dist == esc_dist - 1) {
+                const char* esc = escapes[j % 4];
+                size_t esc_len = strlen(esc);
+                memcpy(p, esc, esc_len);
+                p += esc_len;
+            } else {
+                *p++ = 'a' + j % 26;
+            }
+        }
+        *p++ = '"';
+    }
+    *p++ = ']';
+
+    *len = p - json;
+    return json;
+}
+
+static int
+bench_str(const char* file, const char* json, size_t len) {
+    static const struct {
+        const char* desc;
+        int str_len;
+        int esc_dist;
+    } inputs[] = {
+        { "escape-free, short", 16, 0 },
+        { "escape-free, long", 1000, 0 },
+        { "escape-heavy, short", 16, 4 },
+        { "escape-heavy, long", 1000, 8 },
+    };
+
+    struct json_parser* jp = jp_create();
+    if (!jp) {
+        fprintf(stderr, "fail to create parser\n");
+        return 1;
+    }
+
+    int i, ret = 0;
+    for (i = 0; i < sizeof(inputs)/sizeof(inputs[0]); i++) {
+        size_t str_len;
+        int str_num = 1000000 / inputs[i].str_len;
+        char* str_json = synthesize_str_array(str_num, inputs[i].str_len,
+                                              inputs[i].esc_dist, &str_len);
+        double tp = time_parse(jp, str_json, str_len, 0);
+        jp_mem_stats_t copy_stats;
+        jp_get_mem_stats(jp, &copy_stats);
+
+        double zc_tp = time_parse(jp, str_json, str_len, JP_ZERO_COPY);
+        jp_mem_stats_t zc_stats;
+        jp_get_mem_stats(jp, &zc_stats);
+        free(str_json);
+
+        if (tp < 0 || zc_tp < 0) {
+            ret = 1;
+            break;
+        }
+        fprintf(stdout, "%-24s %10zu bytes  copy: %8.1f MB/s (%.2f)  "
+                "zero-copy: %8.1f MB/s (%.2f)\n", inputs[i].desc, str_len,
+                tp, (double)copy_stats.result_size / str_len, zc_tp,
+                (double)zc_stats.result_size / str_len);
+    }
+
+    jp_destroy(jp);
+    return ret;
+}
+
+/* Synthesize an array of "num" floating point numbers, each printed with
+ * the given format; the values are uniformly distributed in [lo, hi).
+ */
+static char*
+synthesize_fp_array(int num, const char* fmt, double lo, double hi,
+                    size_t* len) {
+    char* json = malloc((size_t)num * 32 + 2);
+    char* p = json;
+    unsigned seed = 1;
+
+    *p++ = '[';
+    int i;
+    for (i = 0; i < num; i++) {
+        if (i)
+            *p++ = ',';
+        double d = lo + (hi - lo) * rand_r(&seed) / ((double)RAND_MAX + 1);
+        p += sprintf(p, fmt, d);
+    }
+    *p++ = ']';
+
+    *len = p - json;
+    return json;
+}
+
+/* The throughput of strtod() over the numbers of the synthesized array. */
+static double
+time_strtod(const char* json, size_t len) {
+    double best = 0, sum = 0;
+    int round;
+    for (round = 0; round < 3; round++) {
+        double start = now_sec();
+        int i;
+        for (i = 0; i < iteration; i++) {
+            const char* p = json + 1;
+            while (*p != ']') {
+                char* end;
+                sum += strtod(p, &end);
+                p = end + (*end == ',');
+            }
+        }
+
+        double tp = mb_per_sec(len, now_sec() - start);
+        if (tp > best)
+            best = tp;
+    }
+
+    /* keep the loop from being optimized away */
+    if (sum == 0.5)
+        fprintf(stderr, "?");
+    return best;
+}
+
+static int
+bench_fp(const char* file, const char* json, size_t len) {
+    static const struct {
+        const char* desc;
+        const char* fmt;
+        double lo;
+        double hi;
+    } inputs[] = {
+        { "latency (%.3f)", "%.3f", 0, 1000 },
+        { "coordinate (%.7f)", "%.7f", -180, 180 },
+        { "full precision (%.17g)", "%.17g", -1e10, 1e10 },
+        { "scientific (%.6e)", "%.6e", 0, 1e-3 },
+    };
+
+    struct json_parser* jp = jp_create();
+    if (!jp) {
+        fprintf(stderr, "fail to create parser\n");
+        return 1;
+    }
+
+    int i, ret = 0;
+    for (i = 0; i < sizeof(inputs)/sizeof(inputs[0]); i++) {
+        size_t fp_len;
+        char* fp_json = synthesize_fp_array(100000, inputs[i].fmt,
+                                            inputs[i].lo, inputs[i].hi,
+                                            &fp_len);
+        double tp = time_parse(jp, fp_json, fp_len, 0);
+        double strtod_tp = time_strtod(fp_json, fp_len);
+        free(fp_json);
+
+        if (tp < 0) {
+            ret = 1;
+            break;
+        }
+        fprintf(stdout, "%-24s %10zu bytes  parse: %8.1f MB/s  "
+                        "strtod: %8.1f MB/s\n",
+                inputs[i].desc, fp_len, tp, strtod_tp);
+    }
+
+    jp_destroy(jp);
+    return ret;
+}
+
+/* Visit every object of the result of jp_parse_ex(), return the # of them */
+static uint64_t
+walk_objs(const obj_t* obj) {
+    if (obj->obj_ty <= OT_LAST_PRIMITIVE)
+        return 1;
+
+    uint64_t num = 0;
+    const obj_composite_t* cobj = (const obj_composite_t*)(const void*)obj;
+    for (; cobj; cobj = cobj->reverse_nesting_order) {
+        const obj_t* elmt;
+        for (elmt = cobj->subobjs; elmt; elmt = elmt->next)
+            num++;
+    }
+    return num + 1;
+}
+
+/* Visit every object of the result of jp_parse_tape() */
+static uint64_t
+walk_tape(const jp_tape_t* tape) {
+    uint32_t entry_num = tape->obj_ty <= OT_LAST_PRIMITIVE ? 1 : tape->skip;
+    uint64_t num = 0;
+    uint32_t i;
+    for (i = 0; i < entry_num; i++)
+        num += (tape[i].obj_ty != OT_NULL);
+    return num;
+}
+
+/* Same as time_parse(), except that the result is optionally visited, and
+ * it goes for the tape if "tape" is non-zero.
+ */
+static double
+time_parse_walk(struct json_parser* jp, const char* json, size_t len,
+                uint32_t flags, int tape, int walk) {
+    double best = 0;
+    uint64_t sum = 0;
+    int round;
+    for (round = 0; round < 3; round++) {
+        double start = now_sec();
+        int i;
+        for (i = 0; i < iteration; i++) {
+            if (tape) {
+                const jp_tape_t* t = jp_parse_tape(jp, json, len, flags);
+                if (!t)
+                    goto err;
+                if (walk)
+                    sum += walk_tape(t);
+            } else {
+                obj_t* obj = jp_parse_ex(jp, json, len, flags);
+                if (!obj)
+                    goto err;
+                if (walk)
+                    sum += walk_objs(obj);
+            }
+        }
+
+        double tp = mb_per_sec(len, now_sec() - start);
+        if (tp > best)
+            best = tp;
+    }
+
+    /* keep the walk from being optimized away */
+    if (sum == 1)
+        fprintf(stderr, "?");
+    return best;
+
+err:
+    fprintf(stderr, "parsing failed: %s\n", jp_get_err(jp));
+    return -1;
+}
+
+static int
+bench_mem(const char* file, const char* json, size_t len) {
+    static const struct {
+        const char* desc;
+        uint32_t retain;
+        uint32_t max_chunk;
+        int huge_page;
+        uint32_t flags;
+        int tape;
+    } settings[] = {
+        { "page-size", 0, 0, 0, 0, 0 },
+        { "geometric", 0, 8 * 1024 * 1024, 0, 0, 0 },
+        { "huge page", 0, 8 * 1024 * 1024, 1, 0, 0 },
+        { "retain 1M", 1024 * 1024, 8 * 1024 * 1024, 0, 0, 0 },
+        { "prealloc", 0, 8 * 1024 * 1024, 0, JP_PREALLOC, 0 },
+        { "prealloc+index", 0, 8 * 1024 * 1024, 0,
+          JP_PREALLOC | JP_STRUCT_INDEX, 0 },
+        { "tape", 0, 8 * 1024 * 1024, 0, 0, 1 },
+        { "tape+prealloc+index", 0, 8 * 1024 * 1024, 0,
+          JP_PREALLOC | JP_STRUCT_INDEX, 1 },
+    };
+
+    int i;
+    for (i = 0; i < sizeof(settings)/sizeof(settings[0]); i++) {
+        struct json_parser* jp = jp_create();
+        if (!jp) {
+            fprintf(stderr, "fail to create parser\n");
+            return 1;
+        }
+
+        jp_set_mem_retain(jp, settings[i].retain);
+        jp_set_mem_chunk(jp, settings[i].max_chunk, settings[i].huge_page);
+
+        jp_mem_stats_t before, after;
+        jp_get_mem_stats(jp, &before);
+        double tp = time_parse_walk(jp, json, len, settings[i].flags,
+                                    settings[i].tape, 0);
+        jp_get_mem_stats(jp, &after);
+        jp_destroy(jp);
+
+        if (tp < 0)
+            return 1;
+
+        /* NOTE: time_parse_walk() parses the json 3 * iteration times */
+        fprintf(stdout, "%-24s %10zu bytes  %-19s %8.1f MB/s  "
+                        "alloc/parse: %.2f  result/byte: %.2f\n",
+                file, len, settings[i].desc, tp,
+                (double)(after.chunk_malloc - before.chunk_malloc) /
+                    (iteration * 3),
+                (double)after.result_size / len);
+    }
+
+    return 0;
+}
+
+static int
+bench_tape(const char* file, const char* json, size_t len) {
+    struct json_parser* jp = jp_create();
+    if (!jp) {
+        fprintf(stderr, "fail to create parser\n");
+        return 1;
+    }
+
+    double tp[4];
+    int i;
+    for (i = 0; i < 4; i++) {
+        tp[i] = time_parse_walk(jp, json, len, 0, i & 1, i >> 1);
+        if (tp[i] < 0) {
+            jp_destroy(jp);
+            return 1;
+        }
+    }
+    jp_destroy(jp);
+
+    fprintf(stdout, "%-24s %10zu bytes  list: %8.1f MB/s  tape: %8.1f MB/s  "
+                    "list+walk: %8.1f MB/s  tape+walk: %8.1f MB/s\n",
+            file, len, tp[0], tp[1], tp[2], tp[3]);
+    return 0;
+}
+
+/* The throughput of feeding the json in pieces of "piece" bytes */
+static double
+time_feed(struct json_parser* jp, const char* json, size_t len,
+          size_t piece) {
+    double best = 0;
+    int round;
+    for (round = 0; round < 3; round++) {
+        double start = now_sec();
+        int i;
+        for (i = 0; i < iteration; i++) {
+            size_t ofst;
+            for (ofst = 0; ofst < len; ofst += piece) {
+                size_t left = len - ofst;
+                if (!jp_feed(jp, json + ofst, left < piece ? left : piece))
+                    break;
+            }
+
+            if (!jp_finish(jp)) {
+                fprintf(stderr, "parsing failed: %s\n", jp_get_err(jp));
+                return -1;
+            }
+        }
+
+        double tp = mb_per_sec(len, now_sec() - start);
+        if (tp > best)
+            best = tp;
+    }
+    return best;
+}
+
+static int
+bench_stream(const char* file, const char* json, size_t len) {
+    struct json_parser* jp = jp_create();
+    if (!jp) {
+        fprintf(stderr, "fail to create parser\n");
+        return 1;
+    }
+
+    double whole = time_parse_walk(jp, json, len, 0, 1, 0);
+    double tp_1k = time_feed(jp, json, len, 1024);
+    double tp_4k = time_feed(jp, json, len, 4096);
+    double tp_64k = time_feed(jp, json, len, 65536);
+    jp_destroy(jp);
+
+    if (whole < 0 || tp_1k < 0 || tp_4k < 0 || tp_64k < 0)
+        return 1;
+
+    fprintf(stdout, "%-24s %10zu bytes  whole: %8.1f MB/s  1K: %8.1f MB/s  "
+                    "4K: %8.1f MB/s  64K: %8.1f MB/s\n",
+            file, len, whole, tp_1k, tp_4k, tp_64k);
+    return 0;
+}
+
+/* The throughput of jp_validate() */
+static double
+time_validate(struct json_parser* jp, const char* json, size_t len,
+              uint32_t flags) {
+    double best = 0;
+    int round;
+    for (round = 0; round < 3; round++) {
+        double start = now_sec();
+        int i;
+        for (i = 0; i < iteration; i++) {
+            if (!jp_validate(jp, json, len, flags)) {
+                fprintf(stderr, "validation failed: %s\n", jp_get_err(jp));
+                return -1;
+            }
+        }
+
+        double tp = mb_per_sec(len, now_sec() - start);
+        if (tp > best)
+            best = tp;
+    }
+    return best;
+}
+
+static int
+bench_validate(const char* file, const char* json, size_t len) {
+    struct json_parser* jp = jp_create();
+    if (!jp) {
+        fprintf(stderr, "fail to create parser\n");
+        return 1;
+    }
+
+    double list = time_parse_walk(jp, json, len, 0, 0, 0);
+    double tape = time_parse_walk(jp, json, len, 0, 1, 0);
+    double validate = time_validate(jp, json, len, 0);
+    jp_destroy(jp);
+
+    if (list < 0 || tape < 0 || validate < 0)
+        return 1;
+
+    fprintf(stdout, "%-24s %10zu bytes  list: %8.1f MB/s  tape: %8.1f MB/s  "
+                    "validate: %8.1f MB/s\n",
+            file, len, list, tape, validate);
+    return 0;
+}
+
+/* Synthesize a document of a user along with "num" events */
+static char*
+synthesize_doc(int num, size_t* len) {
+    static const char* types[] = { "click", "view", "scroll" };
+    char* json = malloc((size_t)num * 160 + 256);
+    char* p = json;
+
+    p += sprintf(p, "{\"user\":{\"id\":1234,\"name\":\"someone\","
+                    "\"roles\":[\"admin\",\"dev\"]},\n\"events\":[");
+    int i;
+    for (i = 0; i < num; i++) {
+        p += sprintf(p, "%s{\"type\":\"%s\",\"ts\":%d,\"target\":"
+                        "\"#item-%d\",\"pos\":[%d,%d],\"extra\":{\"n\":null}}",
+                     i ? ",\n" : "", types[i % 3], 1700000000 + i, i,
+                     i % 1280, i % 720);
+    }
+    p += sprintf(p, "],\n\"meta\":{\"version\":\"1.0\"}}");
+
+    *len = p - json;
+    return json;
+}
+
+/* The throughput of jp_parse_paths() */
+static double
+time_parse_paths(struct json_parser* jp, const char* json, size_t len,
+                 const char* const* paths, uint32_t path_num) {
+    double best = 0;
+    int round;
+    for (round = 0; round < 3; round++) {
+        double start = now_sec();
+        int i;
+        for (i = 0; i < iteration; i++) {
+            if (!jp_parse_paths(jp, json, len, JP_ZERO_COPY, paths,
+                                path_num)) {
+                fprintf(stderr, "parsing failed: %s\n", jp_get_err(jp));
+                return -1;
+            }
+        }
+
+        double tp = mb_per_sec(len, now_sec() - start);
+        if (tp > best)
+            best = tp;
+    }
+    return best;
+}
+
+static int
+bench_paths(const char* file, const char* json, size_t len) {
+    static const char* front[] = { "/user/id", "/events/0/type" };
+    static const char* spread[] = { "/user/id", "/events/0/type",
+                                    "/events/200/pos/0", "/meta/version" };
+
+    struct json_parser* jp = jp_create();
+    if (!jp) {
+        fprintf(stderr, "fail to create parser\n");
+        return 1;
+    }
+
+    size_t doc_len;
+    char* doc = synthesize_doc(560, &doc_len);
+    double tape = time_parse_walk(jp, doc, doc_len, 0, 1, 0);
+    double front_tp = time_parse_paths(jp, doc, doc_len, front, 2);
+    double spread_tp = time_parse_paths(jp, doc, doc_len, spread, 4);
+    free(doc);
+    jp_destroy(jp);
+
+    if (tape < 0 || front_tp < 0 || spread_tp < 0)
+        return 1;
+
+    fprintf(stdout, "document %10zu bytes  tape: %8.1f MB/s  paths (front): "
+                    "%8.1f MB/s  paths (spread): %8.1f MB/s\n",
+            doc_len, tape, front_tp, spread_tp);
+    return 0;
+}
+
+/* The throughput of jp_parse_shallow(), or of jp_skip_value() if "jp" is
+ * NULL.
+ */
+static double
+time_skip(struct json_parser* jp, const char* json, size_t len) {
+    double best = 0;
+    int round;
+    for (round = 0; round < 3; round++) {
+        double start = now_sec();
+        int i;
+        for (i = 0; i < iteration; i++) {
+            if (!jp) {
+                if (!jp_skip_value(json, len)) {
+                    fprintf(stderr, "skipping failed\n");
+                    return -1;
+                }
+            } else if (!jp_parse_shallow(jp, json, len, JP_ZERO_COPY)) {
+                fprintf(stderr, "parsing failed: %s\n", jp_get_err(jp));
+                return -1;
+            }
+        }
+
+        double tp = mb_per_sec(len, now_sec() - start);
+        if (tp > best)
+            best = tp;
+    }
+    return best;
+}
+
+static int
+bench_skip(const char* file, const char* json, size_t len) {
+    struct json_parser* jp = jp_create();
+    if (!jp) {
+        fprintf(stderr, "fail to create parser\n");
+        return 1;
+    }
+
+    double tape = time_parse_walk(jp, json, len, 0, 1, 0);
+    double shallow = time_skip(jp, json, len);
+    double skip = time_skip(NULL, json, len);
+    jp_destroy(jp);
+
+    if (tape < 0 || shallow < 0 || skip < 0)
+        return 1;
+
+    fprintf(stdout, "%-24s %10zu bytes  tape: %8.1f MB/s  shallow: %8.1f MB/s  "
+                    "skip: %8.1f MB/s\n",
+            file, len, tape, shallow, skip);
+    return 0;
+}
+
+/* Synthesize a hashtab of "num" keys, e.g. {"field_0":[0], ...} */
+static char*
+synthesize_hashtab(int num, size_t* len) {
+    char* json = malloc((size_t)num * 32 + 8);
+    char* p = json;
+    int i;
+    *p++ = '{';
+    for (i = 0; i < num; i++)
+        p += sprintf(p, "%s\"field_%d\":[%d]", i ? "," : "", i, i);
+    *p++ = '}';
+
+    *len = p - json;
+    return json;
+}
+
+/* Look up the keys of the hashtab synthesized above round-robin, "iteration"
+ * times 100 in total, return the average time per lookup in ns.
+ */
+static double
+time_hashtab_get(const jp_tape_t* hashtab, int num) {
+    char key[32];
+    int i, lookups = iteration * 100;
+    double start = now_sec();
+    for (i = 0; i < lookups; i++) {
+        int len = sprintf(key, "field_%d", i % num);
+        if (!jp_hashtab_get(hashtab, key, len)) {
+            fprintf(stderr, "key %s is not found\n", key);
+            return -1;
+        }
+    }
+    return (now_sec() - start) * 1e9 / lookups;
+}
+
+static int
+bench_keys(const char* file, const char* json, size_t len) {
+    static const int key_nums[] = { 10, 100, 10000 };
+
+    struct json_parser* jp = jp_create();
+    if (!jp) {
+        fprintf(stderr, "fail to create parser\n");
+        return 1;
+    }
+
+    int i, fail = 0;
+    for (i = 0; i < (int)(sizeof(key_nums)/sizeof(key_nums[0])); i++) {
+        int num = key_nums[i];
+        size_t doc_len;
+        char* doc = synthesize_hashtab(num, &doc_len);
+
+        double tape = time_parse_walk(jp, doc, doc_len, 0, 1, 0);
+        double tape_idx = time_parse_walk(jp, doc, doc_len, JP_KEY_INDEX, 1, 0);
+        double linear = time_hashtab_get(jp_parse_tape(jp, doc, doc_len, 0),
+                                         num);
+        const jp_tape_t* indexed = jp_parse_tape(jp, doc, doc_len,
+                                                 JP_KEY_INDEX);
+        double hashed = time_hashtab_get(indexed, num);
+        free(doc);
+
+        if (tape < 0 || tape_idx < 0 || linear < 0 || hashed < 0) {
+            fail = 1;
+            break;
+        }
+
+        fprintf(stdout, "%5d keys  lookup: %8.1f ns  lookup+index: %8.1f ns  "
+                        "tape: %8.1f MB/s  tape+index: %8.1f MB/s\n",
+                num, linear, hashed, tape, tape_idx);
+    }
+
+    jp_destroy(jp);
+    return fail;
+}
+
+/* Synthesize "num" newline-delimited log records */
+static char*
+synthesize_ndjson(int num, size_t* len) {
+    static const char* levels[] = { "info", "warn", "error" };
+    char* json = malloc((size_t)num * 160);
+    char* p = json;
+    unsigned seed = 1;
+
+    int i;
+    for (i = 0; i < num; i++) {
+        p += sprintf(p, "{\"ts\":%d,\"level\":\"%s\",\"msg\":\"request %d "
+                        "served\",\"latency\":%.3f,\"tags\":[\"edge\",\"v%d\"]}\n",
+                     1700000000 + i, levels[i % 3], i,
+                     rand_r(&seed) / ((double)RAND_MAX + 1) * 100, i % 7);
+    }
+
+    *len = p - json;
+    return json;
+}
+
+/* The throughput of parsing the newline-delimited jsons line by line */
+static double
+time_parse_lines(struct json_parser* jp, const char* json, size_t len) {
+    double best = 0;
+    int round;
+    for (round = 0; round < 3; round++) {
+        double start = now_sec();
+        int i;
+        for (i = 0; i < iteration; i++) {
+            const char* p = json;
+            const char* end = json + len;
+            while (p < end) {
+                const char* eol = memchr(p, '\n', end - p);
+                if (!jp_parse_tape(jp, p, eol + 1 - p, 0)) {
+                    fprintf(stderr, "parsing failed: %s\n", jp_get_err(jp));
+                    return -1;
+                }
+                p = eol + 1;
+            }
+        }
+
+        double tp = mb_per_sec(len, now_sec() - start);
+        if (tp > best)
+            best = tp;
+    }
+    return best;
+}
+
+/* The throughput of jp_parse_many() */
+static double
+time_parse_many(struct json_parser* jp, const char* json, size_t len) {
+    double best = 0;
+    int round;
+    for (round = 0; round < 3; round++) {
+        double start = now_sec();
+        int i;
+        for (i = 0; i < iteration; i++) {
+            uint32_t json_num;
+            if (!jp_parse_many(jp, json, len, 0, &json_num)) {
+                fprintf(stderr, "parsing failed: %s\n", jp_get_err(jp));
+                return -1;
+            }
+        }
+
+        double tp = mb_per_sec(len, now_sec() - start);
+        if (tp > best)
+            best = tp;
+    }
+    return best;
+}
+
+static int
+bench_many(const char* file, const char* json, size_t len) {
+    static const int record_nums[] = { 10, 100, 10000 };
+
+    struct json_parser* jp = jp_create();
+    if (!jp) {
+        fprintf(stderr, "fail to create parser\n");
+        return 1;
+    }
+
+    int i, ret = 0;
+    for (i = 0; i < sizeof(record_nums)/sizeof(record_nums[0]); i++) {
+        size_t nd_len;
+        char* nd_json = synthesize_ndjson(record_nums[i], &nd_len);
+        double lines = time_parse_lines(jp, nd_json, nd_len);
+        double many = time_parse_many(jp, nd_json, nd_len);
+        free(nd_json);
+
+        if (lines < 0 || many < 0) {
+            ret = 1;
+            break;
+        }
+        fprintf(stdout, "%6d records %10zu bytes  line by line: %8.1f MB/s  "
+                        "many: %8.1f MB/s\n",
+                record_nums[i], nd_len, lines, many);
+    }
+
+    jp_destroy(jp);
+    return ret;
+}
+
+/* The throughput of jp_pool_parse_many(), or jp_pool_parse() if "array" is
+ * non-zero.
+ */
+static double
+time_pool_parse(struct jp_pool* pool, const char* json, size_t len,
+                int array) {
+    double best = 0;
+    int round;
+    for (round = 0; round < 3; round++) {
+        double start = now_sec();
+        int i;
+        for (i = 0; i < iteration; i++) {
+            uint32_t slice_num;
+            int succ = array ? !!jp_pool_parse(pool, json, len, 0) :
+                       !!jp_pool_parse_many(pool, json, len, 0, &slice_num);
+            if (!succ) {
+                fprintf(stderr, "parsing failed: %s\n", jp_pool_get_err(pool));
+                return -1;
+            }
+        }
+
+        double tp = mb_per_sec(len, now_sec() - start);
+        if (tp > best)
+            best = tp;
+    }
+    return best;
+}
+
+static int
+bench_pool(const char* file, const char* json, size_t len) {
+    size_t nd_len;
+    char* nd_json = synthesize_ndjson(100000, &nd_len);
+    long cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+
+    /* The array of the same jsons */
+    char* array = malloc(nd_len + 1);
+    size_t array_len = nd_len + 1;
+    array[0] = '[';
+    memcpy(array + 1, nd_json, nd_len);
+    size_t i;
+    for (i = 1; i < array_len; i++) {
+        if (array[i] == '\n')
+            array[i] = ',';
+    }
+    array[array_len - 1] = ']';
+
+    int ret = 0;
+    double base = 0, array_base = 0;
+    long thread_num;
+    for (thread_num = 1; ; thread_num *= 2) {
+        if (thread_num > cpu_num)
+            thread_num = cpu_num;
+
+        struct jp_pool* pool = jp_pool_create(thread_num);
+        if (!pool) {
+            fprintf(stderr, "fail to create thread pool\n");
+            ret = 1;
+            break;
+        }
+
+        double tp = time_pool_parse(pool, nd_json, nd_len, 0);
+        double array_tp = time_pool_parse(pool, array, array_len, 1);
+        jp_pool_destroy(pool);
+        if (tp < 0 || array_tp < 0) {
+            ret = 1;
+            break;
+        }
+
+        if (thread_num == 1) {
+            base = tp;
+            array_base = array_tp;
+        }
+        fprintf(stdout, "%3ld threads %10zu bytes  ndjson: %8.1f MB/s (x%.2f)  "
+                        "array: %8.1f MB/s (x%.2f)\n",
+                thread_num, nd_len, tp, tp / base, array_tp,
+                array_tp / array_base);
+
+        if (thread_num == cpu_num)
+            break;
+    }
+
+    free(nd_json);
+    free(array);
+    return ret;
+}
+
+typedef int (*bench_func_t)(const char* file, const char* json, size_t len);
+
+static struct {
+    const char* name;
+    bench_func_t func;
+    int need_file;
+} bench_modes[] = {
+    { "scan", bench_scan, 1 },
+    { "str", bench_str, 0 },
+    { "fp", bench_fp, 0 },
+    { "mem", bench_mem, 1 },
+    { "tape", bench_tape, 1 },
+    { "stream", bench_stream, 1 },
+    { "validate", bench_validate, 1 },
+    { "paths", bench_paths, 0 },
+    { "skip", bench_skip, 1 },
+    { "keys", bench_keys, 0 },
+    { "many", bench_many, 0 },
+    { "pool", bench_pool, 0 },
+};
+
+static void
+usage(const char* prog) {
+    fprintf(stderr, "usage: %s [-n iteration] <mode> [json-file...]\n", prog);
+    exit(1);
+}
+
+int
+main(int argc, char** argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n')
+            iteration = atoi(optarg);
+        else
+            usage(argv[0]);
+    }
+
+    if (argc - optind < 1 || iteration <= 0)
+        usage(argv[0]);
+
+    const char* mode = argv[optind++];
+    bench_func_t func = NULL;
+    int need_file = 0;
+    int i;
+    for (i = 0; i < sizeof(bench_modes)/sizeof(bench_modes[0]); i++) {
+        if (!strcmp(mode, bench_modes[i].name)) {
+            func = bench_modes[i].func;
+            need_file = bench_modes[i].need_file;
+            break;
+        }
+    }
+
+    if (!func) {
+        fprintf(stderr, "unknown mode '%s'\n", mode);
+        usage(argv[0]);
+    }
+
+    if (!need_file)
+        return func(NULL, NULL, 0);
+
+    if (optind == argc)
+        usage(argv[0]);
+
+    int ret = 0;
+    for (; optind < argc; optind++) {
+        size_t len;
+        char* json = load_json(argv[optind], &len);
+        ret |= func(argv[optind], json, len);
+        free(json);
+    }
+
+    return ret;
+}
@@ -0,0 +1,480 @@
+#include <stdint.h>
+#include <string.h>
+#include "util.h"
+#include "fp_conv.h"
+#include "fp_pow5_tbl.h"
+
+#define MANTISSA_BITS   52
+#define MIN_EXPONENT    (-1023)
+#define INFINITE_POWER  0x7ff
+
+typedef union {
+    uint64_t bits;
+    double db;
+} db_bits_t;
+
+/* The binary form of a double: "mantissa" excludes the implicit bit, and
+ * "power2" is the biased exponent.
+ */
+typedef struct {
+    uint64_t mantissa;
+    int32_t power2;
+} adjusted_mantissa_t;
+
+static inline double
+to_double(adjusted_mantissa_t am, int negative) {
+    db_bits_t u;
+    u.bits = am.mantissa | ((uint64_t)am.power2 << MANTISSA_BITS) |
+             ((uint64_t)negative << 63);
+    return u.db;
+}
+
+static inline int
+am_equal(adjusted_mantissa_t a, adjusted_mantissa_t b) {
+    return a.mantissa == b.mantissa && a.power2 == b.power2;
+}
+
+/* ***********************************************************************
+ *
+ *      Clinger's fast path
+ *
+ * ***********************************************************************
+ */
+static const double exact_pow10[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline int
+clinger_fast_path(uint64_t w, int64_t exp10, double* result) {
+    if (w > ((uint64_t)1 << 53) || exp10 < -22 || exp10 > 22)
+        return 0;
+
+    /* NOTE: this relies on the FPU working in double precision with
+     * round-to-nearest, which holds on x86-64 (SSE2) and ARM64.
+     */
+    double d = (double)w;
+    if (exp10 < 0)
+        d = d / exact_pow10[-exp10];
+    else
+        d = d * exact_pow10[exp10];
+
+    *result = d;
+    return 1;
+}
+
+/* ***********************************************************************
+ *
+ *      Eisel-Lemire
+ *
+ * ***********************************************************************
+ */
+
+/* floor(log2(10^q)) + 63 */
+static inline int32_t
+power(int32_t q) {
+    return (((152170 + 65536) * q) >> 16) + 63;
+}
+
+/* Compute w * 5^q, with w normalized. Only the 64 + 55 most significant bits
+ * of the product are accurate, which are enough for rounding to 53 bits.
+ */
+static inline void
+product_approximation(int64_t q, uint64_t w, uint64_t* hi, uint64_t* lo) {
+    const uint64_t* pow5 = pow5_128[q - FP_MIN_POW10];
+    unsigned __int128 first = (unsigned __int128)w * pow5[0];
+    uint64_t first_hi = (uint64_t)(first >> 64);
+    uint64_t first_lo = (uint64_t)first;
+
+    const uint64_t precision_mask = 0xffffffffffffffffULL >> (MANTISSA_BITS + 3);
+    if ((first_hi & precision_mask) == precision_mask) {
+        unsigned __int128 second = (unsigned __int128)w * pow5[1];
+        uint64_t second_hi = (uint64_t)(second >> 64);
+        first_lo += second_hi;
+        if (second_hi > first_lo)
+            first_hi++;
+    }
+
+    *hi = first_hi;
+    *lo = first_lo;
+}
+
+static adjusted_mantissa_t
+eisel_lemire(int64_t q, uint64_t w) {
+    adjusted_mantissa_t am;
+    if (w == 0 || q < FP_MIN_POW10) {
+        am.mantissa = 0;
+        am.power2 = 0;
+        return am;
+    }
+
+    if (q > FP_MAX_POW10) {
+        am.mantissa = 0;
+        am.power2 = INFINITE_POWER;
+        return am;
+    }
+
+    int lz = __builtin_clzll(w);
+    w <<= lz;
+
+    uint64_t hi, lo;
+    product_approximation(q, w, &hi, &lo);
+
+    int upperbit = (int)(hi >> 63);
+    int shift = upperbit + 64 - MANTISSA_BITS - 3;
+    am.mantissa = hi >> shift;
+    am.power2 = power((int32_t)q) + upperbit - lz - MIN_EXPONENT;
+
+    if (am.power2 <= 0) {
+        /* subnormal */
+        if (-am.power2 + 1 >= 64) {
+            am.mantissa = 0;
+            am.power2 = 0;
+            return am;
+        }
+        am.mantissa >>= -am.power2 + 1;
+        am.mantissa += (am.mantissa & 1);
+        am.mantissa >>= 1;
+        am.power2 = (am.mantissa < ((uint64_t)1 << MANTISSA_BITS)) ? 0 : 1;
+        return am;
+    }
+
+    /* Exactly half-way between two doubles, which is only possible when
+     * 5^q fits in 64 bits, i.e. q in [-4, 23]: round to even.
+     */
+    if (lo <= 1 && q >= -4 && q <= 23 && (am.mantissa & 3) == 1) {
+        if ((am.mantissa << shift) == hi)
+            am.mantissa &= ~(uint64_t)1;
+    }
+
+    am.mantissa += (am.mantissa & 1);
+    am.mantissa >>= 1;
+    if (am.mantissa >= ((uint64_t)2 << MANTISSA_BITS)) {
+        am.mantissa = (uint64_t)1 << MANTISSA_BITS;
+        am.power2++;
+    }
+
+    am.mantissa &= ~((uint64_t)1 << MANTISSA_BITS);
+    if (am.power2 >= INFINITE_POWER) {
+        am.mantissa = 0;
+        am.power2 = INFINITE_POWER;
+    }
+    return am;
+}
+
+/* ***********************************************************************
+ *
+ *      Big decimal fallback
+ *
+ * ***********************************************************************
+ */
+
+/* 768 digits are enough to tell apart any two adjacent doubles (the exact
+ * value of the smallest subnormal has 767 significant digits).
+ */
+#define MAX_DIGITS      768
+#define DP_RANGE        2047
+#define MAX_SHIFT       60
+
+typedef struct {
+    uint32_t num_digits;
+    int32_t decimal_point;  /* value = 0.d1d2...dn * 10^decimal_point */
+    int truncated;          /* non-zero digits dropped beyond MAX_DIGITS */
+    uint8_t digits[MAX_DIGITS];
+} big_decimal_t;
+
+static inline void
+bd_trim(big_decimal_t* d) {
+    while (d->num_digits > 0 && d->digits[d->num_digits - 1] == 0)
+        d->num_digits--;
+
+    if (d->num_digits == 0)
+        d->decimal_point = 0;
+}
+
+static inline void
+bd_add_digit(big_decimal_t* d, uint8_t digit) {
+    if (d->num_digits < MAX_DIGITS)
+        d->digits[d->num_digits] = digit;
+    else if (digit)
+        d->truncated = 1;
+    d->num_digits++;
+}
+
+/* The literal is known to be well-formed at this point. */
+static void
+bd_parse(big_decimal_t* d, const char* p, const char* end) {
+    d->num_digits = 0;
+    d->decimal_point = 0;
+    d->truncated = 0;
+
+    if (*p == '-')
+        p++;
+
+    /* leading zeros are insignificant */
+    while (p < end && *p == '0')
+        p++;
+
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+        bd_add_digit(d, *p - '0');
+    d->decimal_point = d->num_digits;
+
+    if (p < end && *p == '.') {
+        p++;
+        if (d->num_digits == 0) {
+            for (; p < end && *p == '0'; p++)
+                d->decimal_point--;
+        }
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            bd_add_digit(d, *p - '0');
+    }
+
+    if (d->num_digits > MAX_DIGITS) {
+        d->num_digits = MAX_DIGITS;
+    }
+
+    if (p < end && (*p | 0x20) == 'e') {
+        p++;
+        int neg_exp = 0;
+        if (p < end && (*p == '-' || *p == '+')) {
+            neg_exp = (*p == '-');
+            p++;
+        }
+
+        int32_t exp = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (exp < 0x10000)
+                exp = exp * 10 + (*p - '0');
+        }
+        d->decimal_point += neg_exp ? -exp : exp;
+    }
+
+    bd_trim(d);
+}
+
+/* Multiply the decimal by 2^shift, shift <= MAX_SHIFT. */
+static void
+bd_left_shift(big_decimal_t* d, uint32_t shift) {
+    if (d->num_digits == 0)
+        return;
+
+    /* Produce the digits from the least significant one; they are put
+     * in reverse order in "tmp".
+     */
+    uint8_t tmp[MAX_DIGITS + 20];
+    uint32_t n = 0;
+    uint64_t acc = 0;
+    int32_t i;
+
+    for (i = (int32_t)d->num_digits - 1; i >= 0; i--) {
+        acc += (uint64_t)d->digits[i] << shift;
+        tmp[n++] = acc % 10;
+        acc /= 10;
+    }
+
+    while (acc) {
+        tmp[n++] = acc % 10;
+        acc /= 10;
+    }
+
+    d->decimal_point += (int32_t)(n - d->num_digits);
+
+    uint32_t num_digits = n;
+    if (num_digits > MAX_DIGITS) {
+        uint32_t k;
+        for (k = 0; k < num_digits - MAX_DIGITS; k++) {
+            if (tmp[k])
+                d->truncated = 1;
+        }
+        num_digits = MAX_DIGITS;
+    }
+
+    uint32_t k;
+    for (k = 0; k < num_digits; k++)
+        d->digits[k] = tmp[n - 1 - k];
+    d->num_digits = num_digits;
+
+    bd_trim(d);
+}
+
+/* Divide the decimal by 2^shift, shift <= MAX_SHIFT. */
+static void
+bd_right_shift(big_decimal_t* d, uint32_t shift) {
+    uint32_t r = 0, w = 0;
+    uint64_t n = 0;
+
+    /* pick up enough leading digits to cover the first shift */
+    for (; (n >> shift) == 0; r++) {
+        if (r >= d->num_digits) {
+            if (n == 0) {
+                d->num_digits = 0;
+                return;
+            }
+            while ((n >> shift) == 0) {
+                n *= 10;
+                r++;
+            }
+            break;
+        }
+        n = n * 10 + d->digits[r];
+    }
+
+    d->decimal_point -= (int32_t)r - 1;
+    if (d->decimal_point < -DP_RANGE) {
+        d->num_digits = 0;
+        d->decimal_point = 0;
+        d->truncated = 0;
+        return;
+    }
+
+    uint64_t mask = ((uint64_t)1 << shift) - 1;
+    for (; r < d->num_digits; r++) {
+        uint8_t c = d->digits[r];
+        d->digits[w++] = (uint8_t)(n >> shift);
+        n = (n & mask) * 10 + c;
+    }
+
+    while (n > 0) {
+        uint8_t digit = (uint8_t)(n >> shift);
+        n = (n & mask) * 10;
+        if (w < MAX_DIGITS)
+            d->digits[w++] = digit;
+        else if (digit > 0)
+            d->truncated = 1;
+    }
+
+    d->num_digits = w;
+    bd_trim(d);
+}
+
+/* Round the decimal to an integer, with ties to even. */
+static uint64_t
+bd_round(const big_decimal_t* d) {
+    if (d->num_digits == 0 || d->decimal_point < 0)
+        return 0;
+
+    if (d->decimal_point > 18)
+        return UINT64_MAX;
+
+    uint32_t dp = (uint32_t)d->decimal_point;
+    uint64_t n = 0;
+    uint32_t i;
+    for (i = 0; i < dp; i++)
+        n = n * 10 + (i < d->num_digits ? d->digits[i] : 0);
+
+    int round_up = 0;
+    if (dp < d->num_digits) {
+        round_up = d->digits[dp] >= 5;
+        if (d->digits[dp] == 5 && dp + 1 == d->num_digits) {
+            round_up = d->truncated || (dp > 0 && (d->digits[dp - 1] & 1));
+        }
+    }
+
+    return n + round_up;
+}
+
+static const uint8_t shift_by_dp[] = {
+    0, 3, 6, 9, 13, 16, 19, 23, 26, 29, 33, 36, 39, 43, 46, 49, 53, 56, 59
+};
+
+static inline uint32_t
+shift_for_dp(int32_t dp) {
+    return dp < (int32_t)sizeof(shift_by_dp) ? shift_by_dp[dp] : MAX_SHIFT;
+}
+
+static adjusted_mantissa_t
+big_decimal_to_am(big_decimal_t* d) {
+    adjusted_mantissa_t zero = { 0, 0 };
+    adjusted_mantissa_t inf = { 0, INFINITE_POWER };
+
+    if (d->num_digits == 0 || d->decimal_point < -324)
+        return zero;
+
+    if (d->decimal_point >= 310)
+        return inf;
+
+    /* Scale the decimal into [1/2, 1), accumulating the power of 2 */
+    int32_t exp2 = 0;
+    while (d->decimal_point > 0) {
+        uint32_t shift = shift_for_dp(d->decimal_point);
+        bd_right_shift(d, shift);
+        if (d->num_digits == 0)
+            return zero;
+        exp2 += shift;
+    }
+
+    while (d->decimal_point <= 0) {
+        uint32_t shift;
+        if (d->decimal_point == 0) {
+            if (d->digits[0] >= 5)
+                break;
+            shift = (d->digits[0] < 2) ? 2 : 1;
+        } else {
+            shift = shift_for_dp(-d->decimal_point);
+        }
+
+        bd_left_shift(d, shift);
+        if (d->decimal_point > DP_RANGE)
+            return inf;
+        exp2 -= shift;
+    }
+
+    /* [1/2, 1) => [1, 2) */
+    exp2--;
+
+    while (MIN_EXPONENT + 1 > exp2) {
+        uint32_t n = (MIN_EXPONENT + 1) - exp2;
+        if (n > MAX_SHIFT)
+            n = MAX_SHIFT;
+        bd_right_shift(d, n);
+        exp2 += n;
+    }
+
+    if (exp2 - MIN_EXPONENT >= INFINITE_POWER)
+        return inf;
+
+    bd_left_shift(d, MANTISSA_BITS + 1);
+    uint64_t mantissa = bd_round(d);
+    if (mantissa >= ((uint64_t)1 << (MANTISSA_BITS + 1))) {
+        /* rounding up overflowed the mantissa */
+        bd_right_shift(d, 1);
+        exp2++;
+        mantissa = bd_round(d);
+        if (exp2 - MIN_EXPONENT >= INFINITE_POWER)
+            return inf;
+    }
+
+    adjusted_mantissa_t am;
+    am.power2 = exp2 - MIN_EXPONENT;
+    if (mantissa < ((uint64_t)1 << MANTISSA_BITS))
+        am.power2--;
+    am.mantissa = mantissa & (((uint64_t)1 << MANTISSA_BITS) - 1);
+    return am;
+}
+
+/* ***********************************************************************
+ *
+ *      Interface functions
+ *
+ * ***********************************************************************
+ */
+double
+fp_decimal_to_double(uint64_t w, int64_t exp10, int negative, int truncated,
+                     const char* lit, const char* lit_end) {
+    double d;
+    if (!truncated && clinger_fast_path(w, exp10, &d))
+        return negative ? -d : d;
+
+    adjusted_mantissa_t am = eisel_lemire(exp10, w);
+    if (unlikely(truncated) &&
+        !am_equal(am, eisel_lemire(exp10, w + 1))) {
+        /* The dropped digits make a difference: w * 10^exp10 and
+         * (w + 1) * 10^exp10 round to different doubles.
+         */
+        big_decimal_t bd;
+        bd_parse(&bd, lit, lit_end);
+        am = big_decimal_to_am(&bd);
+    }
+
+    return to_double(am, negative);
+}
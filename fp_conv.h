@@ -0,0 +1,41 @@
+/* ****************************************************************************
+ *
+ *   Correctly rounded decimal-to-double conversion. The number is given as
+ * w * 10^exp10, where "w" holds (at most) the first 19 significant digits of
+ * the literal. The conversion is tried in this order:
+ *
+ *   o. Clinger's fast path: if w < 2^53 and |exp10| <= 22, both w and
+ *      10^|exp10| are exact doubles, and a single IEEE multiplication or
+ *      division yields the correctly rounded result.
+ *   o. Eisel-Lemire: multiply w by a 128-bit approximation of 5^exp10
+ *      (fp_pow5_tbl.h), which is precise enough to determine the rounding
+ *      unless the literal has more than 19 significant digits and the
+ *      dropped digits could affect the rounding.
+ *   o. In that rare case, re-parse the literal into a big decimal (up to
+ *      768 digits) and convert it by shifting (aka simple decimal
+ *      conversion).
+ *
+ *   The result is the same as what a correct strtod() would produce under the
+ * round-to-nearest-even mode, including overflow to infinity and underflow to
+ * zero or subnormal.
+ *
+ * ****************************************************************************
+ */
+#ifndef FP_CONV_H
+#define FP_CONV_H
+
+#include <stdint.h>
+
+/* The range of exp10 beyond which the result is zero or infinity. */
+#define FP_MIN_POW10    (-342)
+#define FP_MAX_POW10    308
+
+/* Return the double nearest to (-1)^negative * w * 10^exp10. If "truncated"
+ * is set, some non-zero digits of the literal [lit, lit_end) did not make
+ * into "w", and the literal may be re-parsed to break the tie.
+ */
+double fp_decimal_to_double(uint64_t w, int64_t exp10, int negative,
+                            int truncated, const char* lit,
+                            const char* lit_end);
+
+#endif
@@ -2,7 +2,30 @@
 -- from package.cpath instead of LD_LIBRARTY_PATH.
 --
 
-local ffi = require 'ffi'
+-- Without FFI (e.g. plain Lua 5.1), go for the module built with the Lua
+-- C-API if it's installed (see ljson_c.c). It provides new(), decode(),
+-- validate(), set_null() and set_metatables() only.
+local has_ffi, ffi = pcall(require, 'ffi')
+if not has_ffi then
+    local ok, ljson_c = pcall(require, 'ljson_c')
+    if ok then
+        return ljson_c
+    end
+    error(ffi)
+end
+
+-- With the JIT compiler off, FFI is slow if interpreted, hence decode() and
+-- validate() are done by ljson_c if it's installed (see new()); the rest
+-- stays with FFI, sharing the parser of ljson_c.
+local ljson_c
+if not (jit and jit.status()) then
+    local ok, mod = pcall(require, 'ljson_c')
+    if ok then
+        ljson_c = mod
+    end
+end
+
+local bit = require 'bit'
 ffi.cdef[[
 typedef enum {
     OT_INT64,
@@ -21,7 +44,8 @@ typedef struct obj_tag obj_t;
 
 struct obj_tag {
     obj_t* next;
-    int32_t obj_ty;
+    int16_t obj_ty;
+    uint16_t flags;
     union {
         int32_t str_len;
         int32_t elmt_num; /* # of element of array/hashtab */
@@ -47,18 +71,85 @@ struct obj_composite_tag {
     uint32_t id;
 };
 
+typedef struct {
+    int16_t obj_ty;
+    uint16_t flags;
+    union {
+        int32_t str_len;
+        int32_t elmt_num;
+    };
+    union {
+        char* str_val;
+        int64_t int_val;
+        double db_val;
+        struct {
+            uint32_t skip;
+            uint32_t key_index;
+        };
+    };
+} jp_tape_t;
+
 struct json_parser;
 
 /* Export functions */
 struct json_parser* jp_create(void);
 obj_t* jp_parse(struct json_parser*, const char* json, uint32_t len);
+obj_t* jp_parse_ex(struct json_parser*, const char* json, uint32_t len,
+                   uint32_t flags);
+const jp_tape_t* jp_parse_tape(struct json_parser*, const char* json,
+                               uint32_t len, uint32_t flags);
+const jp_tape_t* jp_parse_many(struct json_parser*, const char* json,
+                               uint32_t len, uint32_t flags,
+                               uint32_t* json_num);
+const jp_tape_t* const* jp_parse_paths(struct json_parser*, const char* json,
+                                       uint32_t len, uint32_t flags,
+                                       const char* const* paths,
+                                       uint32_t path_num);
+const jp_tape_t* jp_hashtab_get(const jp_tape_t* hashtab, const char* key,
+                                uint32_t key_len);
+const jp_tape_t* jp_array_get(const jp_tape_t* array, uint32_t idx);
+
+typedef struct {
+    uint32_t num;
+    const uint8_t* tags;
+    const uint16_t* slots;
+    const uint32_t* lens;
+    const int64_t* ints;
+    const double* dbls;
+    const char* const* strs;
+} jp_flat_t;
+
+const jp_flat_t* jp_parse_flat(struct json_parser*, const char* json,
+                               uint32_t len, uint32_t flags);
+const jp_tape_t* jp_parse_shallow(struct json_parser*, const char* json,
+                                  uint32_t len, uint32_t flags);
+int jp_validate(struct json_parser*, const char* json, uint32_t len,
+                uint32_t flags);
+int jp_feed(struct json_parser*, const char* data, uint32_t len);
+const jp_tape_t* jp_finish(struct json_parser*);
 const char* jp_get_err(struct json_parser*);
 void jp_destroy(struct json_parser*);
+
+typedef struct {
+    uint64_t chunk_malloc;
+    uint64_t chunk_free;
+    uint64_t chunk_reuse;
+    uint32_t retained;
+    uint64_t result_size;
+} jp_mem_stats_t;
+
+void jp_set_mem_retain(struct json_parser*, uint32_t bytes);
+void jp_set_mem_chunk(struct json_parser*, uint32_t max_chunk, int huge_page);
+void jp_trim_mem(struct json_parser*);
+void jp_get_mem_stats(struct json_parser*, jp_mem_stats_t*);
 ]]
 
+local mem_stats_t = ffi.typeof("jp_mem_stats_t")
 local cobj_ptr_t = ffi.typeof("obj_composite_t*")
 local pobj_ptr_t = ffi.typeof("obj_primitive_t*")
 local obj_ptr_t = ffi.typeof("obj_t*")
+local json_num_buf = ffi.new("uint32_t[1]")
+local path_buf_t = ffi.typeof("const char*[?]")
 
 local ffi_cast = ffi.cast
 local ffi_string = ffi.string
@@ -117,20 +208,49 @@ local ty_last_primitive = 4
 local ty_hashtab = 5
 local ty_array= 6
 
+-- JP_ZERO_COPY of jp_flag_t. The strings are converted to Lua strings before
+-- decode*() return, so they can point into the input JSON.
+local zero_copy = 4
+
+-- JP_INTERN_KEYS of jp_flag_t. The slot of an interned key is told by the
+-- upper bits of its flags (see JP_KEY_SLOT()), and each decoder maps the slots
+-- to the Lua strings of the keys of its own parser, see interned_key().
+local intern_keys = 16
+
+-- JP_KEY_INDEX of jp_flag_t, for the hashtabs looked up key by key
+local key_index = 8
+
 local create_primitive
 local create_array
 local create_hashtab
 local convert_obj
+local create_tape_primitive
+local convert_tape
+local convert_flat
 local tonumber = tonumber
+local setmetatable = setmetatable
+local rshift = bit.rshift
+
+-- Return the key interned in the given slot, which is converted to Lua string
+-- the first time the slot is seen.
+local function interned_key(key_strs, slot, str_val, str_len)
+    local key = key_strs[slot]
+    if key == nil then
+        key = ffi_string(str_val, str_len)
+        key_strs[slot] = key
+    end
+    return key
+end
 
-create_primitive = function(obj)
+-- "null" is what JSON null is converted to, see set_null()
+create_primitive = function(obj, null)
     local ty = obj.common.obj_ty
     if ty == ty_int64 then
         return tonumber(obj.int_val)
     elseif ty == ty_str then
         return ffi_string(obj.str_val, obj.common.str_len)
     elseif ty == ty_null then
-        return nil
+        return null
     elseif ty == ty_bool then
         if obj.int_val == 0 then
             return false
@@ -144,7 +264,7 @@ create_primitive = function(obj)
     return nil, "Unknown primitive type"
 end
 
-create_array = function(array, cobj_array)
+create_array = function(array, cobj_array, opts)
     local elmt_num = array.common.elmt_num
     local elmt_list = array.subobjs
 
@@ -157,25 +277,33 @@ create_array = function(array, cobj_array)
         local elmt_obj
         if elmt.obj_ty <= ty_last_primitive then
             local err;
-            elmt_obj, err = create_primitive(ffi_cast(pobj_ptr_t, elmt))
+            elmt_obj, err = create_primitive(ffi_cast(pobj_ptr_t, elmt),
+                                             opts.null)
             if err then
                 return nil, err
             end
         else
-            local cobj = ffi_cast(cobj_ptr_t, elmt);
-            elmt_obj = cobj_array[cobj.id + 1]
+            -- take the table out, see create_cobj_vect()
+            local slot = ffi_cast(cobj_ptr_t, elmt).id + 1
+            elmt_obj = cobj_array[slot]
+            cobj_array[slot] = nil
         end
 
         result[elmt_num - iter + 1] = elmt_obj
         elmt_list = elmt_list.next
     end
 
+    local array_mt = opts.array_mt
+    if array_mt then
+        setmetatable(result, array_mt)
+    end
+
     cobj_array[array.id + 1] = result
 
     return result;
 end
 
-create_hashtab = function(hashtab, cobj_array)
+create_hashtab = function(hashtab, cobj_array, key_strs, opts)
     local elmt_num = hashtab.common.elmt_num
     local elmt_list = hashtab.subobjs
 
@@ -187,67 +315,329 @@ create_hashtab = function(hashtab, cobj_array)
         elmt_list = elmt_list.next
 
         local key = ffi_cast(pobj_ptr_t, elmt_list)
-        local key_obj = ffi_string(key.str_val, key.common.str_len)
+        local key_obj
+        local slot = rshift(key.common.flags, 4)
+        if slot ~= 0 then
+            key_obj = interned_key(key_strs, slot, key.str_val,
+                                   key.common.str_len)
+        else
+            key_obj = ffi_string(key.str_val, key.common.str_len)
+        end
 
         local val_obj = nil
         if val.obj_ty <= ty_last_primitive then
             local err;
-            val_obj, err = create_primitive(ffi_cast(pobj_ptr_t, val))
+            val_obj, err = create_primitive(ffi_cast(pobj_ptr_t, val),
+                                            opts.null)
             if err then
                 return nil, err
             end
         else
-            local cobj = ffi_cast(cobj_ptr_t, val);
-            val_obj = cobj_array[cobj.id + 1]
+            local slot = ffi_cast(cobj_ptr_t, val).id + 1
+            val_obj = cobj_array[slot]
+            cobj_array[slot] = nil
         end
 
         result[key_obj] = val_obj;
         elmt_list = elmt_list.next
     end
 
+    local hashtab_mt = opts.hashtab_mt
+    if hashtab_mt then
+        setmetatable(result, hashtab_mt)
+    end
+
     cobj_array[hashtab.id + 1] = result
 
     return result
 end
 
-convert_obj = function(obj, cobj_array)
+-- "opts" is the decoder, which tells the null sentinel and the metatables
+-- (see set_null() and set_metatables()).
+convert_obj = function(obj, cobj_array, key_strs, opts)
     local ty = obj.obj_ty
     if ty <= ty_last_primitive then
-        return create_primitive(ffi_cast(pobj_ptr_t, obj))
+        return create_primitive(ffi_cast(pobj_ptr_t, obj), opts.null)
     elseif ty == ty_array then
-        return create_array(ffi_cast(cobj_ptr_t, obj), cobj_array)
+        return create_array(ffi_cast(cobj_ptr_t, obj), cobj_array, opts)
     else
-        return create_hashtab(ffi_cast(cobj_ptr_t, obj), cobj_array)
+        return create_hashtab(ffi_cast(cobj_ptr_t, obj), cobj_array, key_strs,
+                              opts)
+    end
+end
+
+create_tape_primitive = function(entry, null)
+    local ty = entry.obj_ty
+    if ty == ty_int64 then
+        return tonumber(entry.int_val)
+    elseif ty == ty_str then
+        return ffi_string(entry.str_val, entry.str_len)
+    elseif ty == ty_null then
+        return null
+    elseif ty == ty_bool then
+        return entry.int_val ~= 0
+    else
+        return tonumber(entry.db_val)
+    end
+end
+
+-- Convert the tape to Lua objects in a single pass. The elements of a
+-- composite object follow it on the tape, so the tables are filled in the
+-- natural order. The state of the enclosing composite objects being filled
+-- is kept in "stack", 3 slots each. The interned keys are looked up in
+-- "key_strs". The null sentinel and the metatables are those of "opts" (see
+-- convert_obj()); a table gets its metatable once it's filled, as the stores
+-- to the tables with metatables are slower.
+convert_tape = function(tape, stack, key_strs, opts)
+    local null = opts.null
+    local entry = tape[0]
+    if entry.obj_ty <= ty_last_primitive then
+        return create_tape_primitive(entry, null)
+    end
+
+    local array_mt, hashtab_mt = opts.array_mt, opts.hashtab_mt
+
+    local root
+    local depth = 0
+
+    -- the composite object being filled, and its state
+    local cur, cur_is_array, left, idx, key
+
+    for i = 0, entry.skip - 1 do
+        entry = tape[i]
+        local ty = entry.obj_ty
+        local val
+        local elmt_num = 0
+        if ty <= ty_last_primitive then
+            -- only the interned keys have the slot
+            local slot = rshift(entry.flags, 4)
+            if slot ~= 0 then
+                val = interned_key(key_strs, slot, entry.str_val,
+                                   entry.str_len)
+            else
+                val = create_tape_primitive(entry, null)
+            end
+        else
+            elmt_num = entry.elmt_num
+            if ty == ty_array then
+                val = tab_new(elmt_num, 0)
+                if elmt_num == 0 and array_mt then
+                    setmetatable(val, array_mt)
+                end
+            else
+                val = tab_new(0, elmt_num / 2)
+                if elmt_num == 0 and hashtab_mt then
+                    setmetatable(val, hashtab_mt)
+                end
+            end
+        end
+
+        if cur == nil then
+            root = val
+        else
+            if cur_is_array then
+                idx = idx + 1
+                cur[idx] = val
+            elseif key == nil then
+                key = val
+            else
+                cur[key] = val
+                key = nil
+            end
+            left = left - 1
+        end
+
+        if elmt_num ~= 0 then
+            -- push, "key" is always nil at this point
+            local base = depth * 3
+            stack[base + 1] = cur
+            stack[base + 2] = left
+            stack[base + 3] = idx
+            depth = depth + 1
+
+            -- "idx" is nil for hashtab, which tells arrays apart when popping
+            cur = val
+            cur_is_array = (ty == ty_array)
+            left = elmt_num
+            idx = cur_is_array and 0 or nil
+        else
+            -- pop the composite objects just completed, which get their
+            -- metatables now that they are filled
+            while left == 0 do
+                local mt = hashtab_mt
+                if cur_is_array then
+                    mt = array_mt
+                end
+                if mt then
+                    setmetatable(cur, mt)
+                end
+
+                if depth == 1 then
+                    break
+                end
+                depth = depth - 1
+                local base = depth * 3
+                cur = stack[base + 1]
+                left = stack[base + 2]
+                idx = stack[base + 3]
+                cur_is_array = (idx ~= nil)
+                stack[base + 1] = nil
+            end
+        end
+    end
+
+    return root
+end
+
+-- Same as convert_tape(), except that the nodes are read from the arrays of
+-- jp_flat_t, each load being a plain number instead of a cdata.
+convert_flat = function(flat, stack, key_strs, opts)
+    local tags, slots, lens = flat.tags, flat.slots, flat.lens
+    local ints, dbls, strs = flat.ints, flat.dbls, flat.strs
+    local null, array_mt, hashtab_mt = opts.null, opts.array_mt,
+                                       opts.hashtab_mt
+
+    local root
+    local depth = 0
+
+    -- the composite object being filled, and its state
+    local cur, cur_is_array, left, idx, key
+
+    for i = 0, flat.num - 1 do
+        local ty = tags[i]
+        local val
+        local elmt_num = 0
+        if ty == ty_str then
+            local slot = slots[i]
+            if slot ~= 0 then
+                val = interned_key(key_strs, slot, strs[i], lens[i])
+            else
+                val = ffi_string(strs[i], lens[i])
+            end
+        elseif ty == ty_int64 then
+            val = tonumber(ints[i])
+        elseif ty == ty_fp then
+            val = dbls[i]
+        elseif ty == ty_bool then
+            val = ints[i] ~= 0
+        elseif ty == ty_array then
+            elmt_num = lens[i]
+            val = tab_new(elmt_num, 0)
+            if elmt_num == 0 and array_mt then
+                setmetatable(val, array_mt)
+            end
+        elseif ty == ty_hashtab then
+            elmt_num = lens[i]
+            val = tab_new(0, elmt_num / 2)
+            if elmt_num == 0 and hashtab_mt then
+                setmetatable(val, hashtab_mt)
+            end
+        else
+            val = null
+        end
+
+        if cur == nil then
+            root = val
+        else
+            if cur_is_array then
+                idx = idx + 1
+                cur[idx] = val
+            elseif key == nil then
+                key = val
+            else
+                cur[key] = val
+                key = nil
+            end
+            left = left - 1
+        end
+
+        if elmt_num ~= 0 then
+            -- push, "key" is always nil at this point
+            local base = depth * 3
+            stack[base + 1] = cur
+            stack[base + 2] = left
+            stack[base + 3] = idx
+            depth = depth + 1
+
+            -- "idx" is nil for hashtab, which tells arrays apart when popping
+            cur = val
+            cur_is_array = (ty == ty_array)
+            left = elmt_num
+            idx = cur_is_array and 0 or nil
+        else
+            -- pop the composite objects just completed, which get their
+            -- metatables now that they are filled
+            while left == 0 do
+                local mt = hashtab_mt
+                if cur_is_array then
+                    mt = array_mt
+                end
+                if mt then
+                    setmetatable(cur, mt)
+                end
+
+                if depth == 1 then
+                    break
+                end
+                depth = depth - 1
+                local base = depth * 3
+                cur = stack[base + 1]
+                left = stack[base + 2]
+                idx = stack[base + 3]
+                cur_is_array = (idx ~= nil)
+                stack[base + 1] = nil
+            end
+        end
     end
+
+    return root
 end
 
--- Create an array big enough to accommodate elmt_num + 2 elements.
--- If cobj_vect is big enough, return it; otherwise, create a new one.
-local function create_cobj_vect(cobj_vect, elmt_num)
+-- The vector of decode() keeps the table of each composite object by its id
+-- until the enclosing object takes it out, which sets the slot back to nil.
+-- Hence it's empty again once decode() is done, without clearing each slot,
+-- and it's reused across calls. Yet a vector 4 times as large as needed for
+-- so many calls in a row is replaced by a smaller one, lest a single huge
+-- json pins the memory forever.
+local cobj_vect_min = 100
+local cobj_vect_shrink_calls = 16
+
+-- Return a vector of the decoder big enough to accommodate elmt_num + 2
+-- elements.
+local function create_cobj_vect(self, elmt_num)
+    local cobj_vect = self.cobj_vect
     local array_size = elmt_num + 2
     local cap = cobj_vect[0]
-    if cap < 400 and cap >= array_size then
-        return cobj_vect
+    if cap >= array_size then
+        if cap <= cobj_vect_min or array_size * 4 > cap then
+            self.cobj_vect_idle = 0
+            return cobj_vect
+        end
+
+        local idle = self.cobj_vect_idle + 1
+        self.cobj_vect_idle = idle
+        if idle < cobj_vect_shrink_calls then
+            return cobj_vect
+        end
+        array_size = array_size * 2
+    end
+
+    if array_size < cobj_vect_min then
+        array_size = cobj_vect_min
     end
 
     cobj_vect = tab_new(array_size, 1)
     cobj_vect[0] = array_size
+    self.cobj_vect = cobj_vect
+    self.cobj_vect_idle = 0
     return cobj_vect
 end
 
--- set each element to be nil, such that they can be GC-ed ASAP.
-local function clean_cobj_vect(cobj_vect, elmt_num)
-    for iter = 1, elmt_num + 2 do
-        cobj_vect[iter] = nil
-    end
-end
-
 -- #########################################################################
 --
 --      "Export" functions
 --
 -- #########################################################################
-local setmetatable = setmetatable
 local mt = { __index = _M }
 
 function _M.new()
@@ -259,23 +649,42 @@ function _M.new()
         return nil, "fail to load libjson.so"
     end
 
-    local parser_inst = jp_lib.jp_create()
-    if parser_inst ~= nil then
-        ffi.gc(parser_inst, jp_lib.jp_destroy)
+    -- Share the parser of ljson_c, which owns it, rather than keeping a
+    -- second one along with its memory.
+    local c_decoder, parser_inst
+    if ljson_c then
+        local err
+        c_decoder, err = ljson_c.new()
+        if not c_decoder then
+            return nil, err
+        end
+        parser_inst = ffi.cast("struct json_parser*", c_decoder:parser())
     else
-        return nil, "Fail to create JSON parser, likely due to OOM"
+        parser_inst = jp_lib.jp_create()
+        if parser_inst ~= nil then
+            ffi.gc(parser_inst, jp_lib.jp_destroy)
+        else
+            return nil, "Fail to create JSON parser, likely due to OOM"
+        end
     end
 
-    local cobj_vect = tab_new(100, 1)
+    local cobj_vect = tab_new(cobj_vect_min, 1)
     if cobj_vect then
-        cobj_vect[0] = 100
+        cobj_vect[0] = cobj_vect_min
     else
         return nil, "fail to create intermediate array"
     end
 
     local self = {
         cobj_vect = cobj_vect,
-        parser = parser_inst
+        cobj_vect_idle = 0,
+        tape_stack = {},
+        path_buf = nil,
+        path_buf_len = 0,
+        key_strs = {},
+        parse_flags = zero_copy + intern_keys,
+        parser = parser_inst,
+        c_decoder = c_decoder
     }
 
     return setmetatable(self, mt)
@@ -287,32 +696,177 @@ function _M.decode(self, json)
         return nil, "JSON parser was not initialized properly"
     end]]
 
-    local objs = jp_lib.jp_parse(self.parser, json, #json)
+    local c_decoder = self.c_decoder
+    if c_decoder then
+        return c_decoder:decode(json)
+    end
+
+    local objs = jp_lib.jp_parse_ex(self.parser, json, #json,
+                                    self.parse_flags)
     if objs == nil then
         return nil, ffi_string(jp_lib.jp_get_err(self.parser))
     end
 
     local ty = objs.obj_ty
     if ty <= ty_last_primitive then
-        return convert_obj(objs)
+        return convert_obj(objs, nil, nil, self)
     end
 
     local composite_objs = ffi_cast(cobj_ptr_t, objs)
     local elmt_num = composite_objs.id
-    local cobj_vect = create_cobj_vect(self.cobj_vect, elmt_num)
-    self.cobj_vect = cobj_vect
+    local cobj_vect = create_cobj_vect(self, elmt_num)
 
     local last_val
     repeat
-        last_val = convert_obj(ffi_cast(obj_ptr_t, composite_objs), cobj_vect)
+        last_val = convert_obj(ffi_cast(obj_ptr_t, composite_objs), cobj_vect,
+                               self.key_strs, self)
         composite_objs = composite_objs.reverse_nesting_order
     until composite_objs == nil
 
-    clean_cobj_vect(cobj_vect, elmt_num)
+    -- The out-most object is the only one not taken out
+    cobj_vect[2] = nil
 
     return last_val
 end
 
+-- Same as decode(), except that the input JSON is parsed into a tape (see
+-- jp_parse_tape()), from which the tables are filled in the natural order.
+function _M.decode_tape(self, json)
+    local tape = jp_lib.jp_parse_tape(self.parser, json, #json,
+                                      self.parse_flags)
+    if tape == nil then
+        return nil, ffi_string(jp_lib.jp_get_err(self.parser))
+    end
+
+    return convert_tape(tape, self.tape_stack, self.key_strs, self)
+end
+
+-- Same as decode_tape(), except that the tape is laid out as arrays of
+-- numbers (see jp_parse_flat()) before it is converted to tables.
+function _M.decode_flat(self, json)
+    local flat = jp_lib.jp_parse_flat(self.parser, json, #json,
+                                      self.parse_flags)
+    if flat == nil then
+        return nil, ffi_string(jp_lib.jp_get_err(self.parser))
+    end
+
+    return convert_flat(flat, self.tape_stack, self.key_strs, self)
+end
+
+-- Decode only the values referred to by the JSON pointers (e.g. "/user/id",
+-- "/events/0/type"), skipping the rest of the JSON without building tables
+-- for it (nor fully validating it).
+-- return:
+--  1). array of the values, the i-th of which is referred to by paths[i]; it
+--      has holes for the values which are not found, or null unless there is
+--      a null sentinel (see set_null()). nil in the event of error
+--  2). error message if error occur
+function _M.decode_paths(self, json, paths)
+    local path_num = #paths
+    local path_buf = self.path_buf
+    if not path_buf or self.path_buf_len < path_num then
+        path_buf = ffi.new(path_buf_t, path_num)
+        self.path_buf = path_buf
+        self.path_buf_len = path_num
+    end
+
+    -- The strings are kept alive by "paths"
+    for i = 1, path_num do
+        path_buf[i - 1] = paths[i]
+    end
+
+    local values = jp_lib.jp_parse_paths(self.parser, json, #json, zero_copy,
+                                         path_buf, path_num)
+    if values == nil then
+        return nil, ffi_string(jp_lib.jp_get_err(self.parser))
+    end
+
+    local result = tab_new(path_num, 0)
+    local stack = self.tape_stack
+    for i = 1, path_num do
+        local tape = values[i - 1]
+        if tape ~= nil then
+            result[i] = convert_tape(tape, stack, nil, self)
+        end
+    end
+
+    return result
+end
+
+-- Decode only the out-most array/hashtab: the arrays and hashtabs nested in
+-- it are not decoded (nor validated), but left as strings of their raw JSON,
+-- which can be decoded later on if needed.
+function _M.decode_shallow(self, json)
+    local tape = jp_lib.jp_parse_shallow(self.parser, json, #json, zero_copy)
+    if tape == nil then
+        return nil, ffi_string(jp_lib.jp_get_err(self.parser))
+    end
+
+    return convert_tape(tape, self.tape_stack, nil, self)
+end
+
+-- Check if the JSON is well-formed without decoding it. Return true, or nil
+-- and the error message.
+function _M.validate(self, json)
+    local c_decoder = self.c_decoder
+    if c_decoder then
+        return c_decoder:validate(json)
+    end
+
+    if jp_lib.jp_validate(self.parser, json, #json, 0) == 0 then
+        return nil, ffi_string(jp_lib.jp_get_err(self.parser))
+    end
+    return true
+end
+
+-- Decode a sequence of JSONs, e.g. newline-delimited JSON (aka NDJSON or JSON
+-- lines), all in one go.
+-- return:
+--  1). array of the decoded JSONs, or nil in the event of error
+--  2). # of the JSONs (the array has holes if some of them are null, unless
+--      there is a null sentinel), or the error message
+function _M.decode_many(self, json)
+    local tape = jp_lib.jp_parse_many(self.parser, json, #json,
+                                      self.parse_flags, json_num_buf)
+    if tape == nil then
+        return nil, ffi_string(jp_lib.jp_get_err(self.parser))
+    end
+
+    local json_num = json_num_buf[0]
+    local result = tab_new(json_num, 0)
+    local stack = self.tape_stack
+    local key_strs = self.key_strs
+    for i = 1, json_num do
+        result[i] = convert_tape(tape, stack, key_strs, self)
+
+        -- the next JSON follows
+        local entry = tape[0]
+        tape = tape + (entry.obj_ty <= ty_last_primitive and 1 or entry.skip)
+    end
+
+    return result, json_num
+end
+
+-- Feed a piece of the JSON, e.g. a chunk of the request body just received.
+-- The pieces can be split anywhere. Return true, or nil and the error
+-- message if the JSON is known to be malformed.
+function _M.feed(self, piece)
+    if jp_lib.jp_feed(self.parser, piece, #piece) == 0 then
+        return nil, ffi_string(jp_lib.jp_get_err(self.parser))
+    end
+    return true
+end
+
+-- Decode the JSON fed so far; the next feed() starts a new JSON.
+function _M.finish(self)
+    local tape = jp_lib.jp_finish(self.parser)
+    if tape == nil then
+        return nil, ffi_string(jp_lib.jp_get_err(self.parser))
+    end
+
+    return convert_tape(tape, self.tape_stack, nil, self)
+end
+
 -- return:
 --  1). array of strings in the input JSON
 --  2). error message if error occur
@@ -323,7 +877,7 @@ end
 function _M.get_strings(self, json)
 
     -- step 1: decode the input JSON
-    local objs = jp_lib.jp_parse(self.parser, json, #json)
+    local objs = jp_lib.jp_parse_ex(self.parser, json, #json, zero_copy)
     if objs == nil then
         return nil, ffi_string(jp_lib.jp_get_err(self.parser))
     end
@@ -386,6 +940,179 @@ function _M.get_strings(self, json)
     return str_array
 end
 
+-- Lazy decoding: decode_lazy() returns a proxy of the out-most array/hashtab,
+-- whose elements are looked up on the tape (see jp_hashtab_get()) as they
+-- are accessed, and cached in the proxy. The arrays/hashtabs among them are
+-- proxies likewise, so the tables are built only for what is accessed.
+--
+-- The tape is kept by a parser of its own, and the proxies are valid until
+-- the next decode_lazy() on the same decoder: accessing a stale one raises
+-- an error. As the proxies are filled on demand, pairs() and the length
+-- operator do not work on them; use lazy_len() or materialize() instead.
+-- The null sentinel applies to the proxies, but the metatables of
+-- set_metatables() do not, the proxies having their own.
+local getmetatable = getmetatable
+local rawset = rawset
+local type = type
+local error = error
+
+local lazy_index
+
+-- The state of a proxy is kept in its metatable, which is per proxy: the
+-- entry of the array/hashtab on the tape, and the decode_lazy() call (the
+-- generation) the tape is from. "ctx" is shared by the proxies of the same
+-- decoder; it keeps alive the parser owning the tape, and the input JSON
+-- the strings on the tape point into.
+local function lazy_value(entry, ctx, gen)
+    if entry.obj_ty <= ty_last_primitive then
+        return create_tape_primitive(entry, ctx.null)
+    end
+
+    return setmetatable({}, { __index = lazy_index, entry = entry,
+                              ctx = ctx, gen = gen })
+end
+
+local function lazy_state(proxy)
+    local state = getmetatable(proxy)
+    if state.gen ~= state.ctx.gen then
+        error("lazy proxy is stale: the decoder has decoded another JSON", 3)
+    end
+    return state
+end
+
+lazy_index = function(proxy, key)
+    local state = lazy_state(proxy)
+    local entry = state.entry
+
+    local val
+    if entry.obj_ty == ty_array then
+        -- jp_array_get() takes an uint32_t
+        if type(key) ~= "number" or key < 1 or key % 1 ~= 0 or
+           key > entry.elmt_num then
+            return nil
+        end
+        val = jp_lib.jp_array_get(entry, key - 1)
+    else
+        if type(key) ~= "string" then
+            return nil
+        end
+        val = jp_lib.jp_hashtab_get(entry, key, #key)
+    end
+
+    if val == nil then
+        return nil
+    end
+
+    local obj = lazy_value(val, state.ctx, state.gen)
+    if obj ~= nil then
+        rawset(proxy, key, obj)
+    end
+    return obj
+end
+
+-- Same as decode_tape(), except that the arrays/hashtabs are decoded lazily,
+-- see above.
+function _M.decode_lazy(self, json)
+    local ctx = self.lazy_ctx
+    if not ctx then
+        local parser = jp_lib.jp_create()
+        if parser == nil then
+            return nil, "Fail to create JSON parser, likely due to OOM"
+        end
+        ctx = { parser = ffi.gc(parser, jp_lib.jp_destroy), gen = 0 }
+        self.lazy_ctx = ctx
+    end
+
+    -- Invalidate the proxies of the last JSON before its tape is overwritten
+    local gen = ctx.gen + 1
+    ctx.gen = gen
+    ctx.json = nil
+
+    local tape = jp_lib.jp_parse_tape(ctx.parser, json, #json,
+                                      zero_copy + key_index)
+    if tape == nil then
+        return nil, ffi_string(jp_lib.jp_get_err(ctx.parser))
+    end
+
+    ctx.json = json
+    ctx.null = self.null
+    return lazy_value(tape, ctx, gen)
+end
+
+-- Return the # of elements of the array, or of the key/value pairs of the
+-- hashtab that the proxy stands for.
+function _M.lazy_len(proxy)
+    local entry = lazy_state(proxy).entry
+    if entry.obj_ty == ty_array then
+        return entry.elmt_num
+    end
+    return entry.elmt_num / 2
+end
+
+-- Convert the value the proxy stands for to Lua tables all at once. The
+-- proxy is left intact.
+function _M.materialize(self, proxy)
+    return convert_tape(lazy_state(proxy).entry, self.tape_stack, nil, self)
+end
+
+-- Intern the keys of the hashtabs (the default), so that the keys seen
+-- before are not converted to Lua strings over again. The parser keeps up to
+-- 4095 keys of up to 24 bytes.
+function _M.set_intern_keys(self, enable)
+    self.parse_flags = enable and zero_copy + intern_keys or zero_copy
+end
+
+-- Convert JSON null to "null" (nil by default), e.g. cjson.null or
+-- ngx.null, instead of nil, so that the arrays keep their length and the
+-- hashtabs their keys.
+function _M.set_null(self, null)
+    self.null = null
+    if self.c_decoder then
+        self.c_decoder:set_null(null)
+    end
+end
+
+-- Set the metatable of each array/hashtab decoded to "array_mt"/"hashtab_mt"
+-- respectively (nil for none, the default), e.g. to tell the empty arrays from
+-- the empty hashtabs when encoding them back. It's done as the tables are
+-- built, sparing a pass over the result.
+function _M.set_metatables(self, array_mt, hashtab_mt)
+    self.array_mt = array_mt
+    self.hashtab_mt = hashtab_mt
+    if self.c_decoder then
+        self.c_decoder:set_metatables(array_mt, hashtab_mt)
+    end
+end
+
+-- Keep at most "bytes" of memory for subsequent decoding (1M by default)
+function _M.set_mem_retain(self, bytes)
+    jp_lib.jp_set_mem_retain(self.parser, bytes)
+end
+
+-- Let the memory chunks grow up to "max_chunk" bytes (8M by default), and
+-- back the large ones with huge pages if "huge_page" is true
+function _M.set_mem_chunk(self, max_chunk, huge_page)
+    jp_lib.jp_set_mem_chunk(self.parser, max_chunk, huge_page and 1 or 0)
+end
+
+-- Release the memory kept for subsequent decoding
+function _M.trim_mem(self)
+    jp_lib.jp_trim_mem(self.parser)
+end
+
+-- Return the counters of memory allocation
+function _M.mem_stats(self)
+    local stats = mem_stats_t()
+    jp_lib.jp_get_mem_stats(self.parser, stats)
+    return {
+        chunk_malloc = tonumber(stats.chunk_malloc),
+        chunk_free = tonumber(stats.chunk_free),
+        chunk_reuse = tonumber(stats.chunk_reuse),
+        retained = tonumber(stats.retained),
+        result_size = tonumber(stats.result_size),
+    }
+end
+
 -- #########################################################################
 --
 --      Debugging and Misc
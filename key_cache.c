@@ -0,0 +1,65 @@
+#include <stdlib.h>
+#include "util.h"
+#include "key_cache.h"
+
+/* Twice as many as the slots, a power of 2 */
+#define BUCKET_NUM 8192
+
+void
+kc_init(key_cache_t* kc) {
+    kc->slots = 0;
+    kc->buckets = 0;
+    kc->slot_num = 0;
+}
+
+void
+kc_fini(key_cache_t* kc) {
+    free(kc->slots);
+    free(kc->buckets);
+    kc_init(kc);
+}
+
+static int __attribute__((cold))
+kc_alloc(key_cache_t* kc) {
+    kc->slots = (key_slot_t*)malloc(sizeof(key_slot_t) * KEY_CACHE_SLOT_NUM);
+    kc->buckets = (uint16_t*)calloc(BUCKET_NUM, sizeof(uint16_t));
+    if (unlikely(!kc->slots || !kc->buckets)) {
+        kc_fini(kc);
+        return 0;
+    }
+    return 1;
+}
+
+uint32_t
+kc_intern(key_cache_t* kc, const char* key, uint32_t len) {
+    if (unlikely(len > KEY_CACHE_MAX_LEN))
+        return 0;
+
+    if (unlikely(!kc->buckets) && !kc_alloc(kc))
+        return 0;
+
+    uint32_t hash = key_hash(key, len);
+    uint32_t b;
+    for (b = hash; ; b++) {
+        uint32_t id = kc->buckets[b & (BUCKET_NUM - 1)];
+        if (!id)
+            break;
+
+        const key_slot_t* slot = kc->slots + id - 1;
+        if (slot->hash == hash && slot->len == len &&
+            !memcmp(slot->str, key, len)) {
+            return id;
+        }
+    }
+
+    if (unlikely(kc->slot_num == KEY_CACHE_SLOT_NUM))
+        return 0;
+
+    uint32_t id = ++kc->slot_num;
+    key_slot_t* slot = kc->slots + id - 1;
+    slot->len = len;
+    slot->hash = hash;
+    memcpy(slot->str, key, len);
+    kc->buckets[b & (BUCKET_NUM - 1)] = id;
+    return id;
+}
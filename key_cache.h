@@ -0,0 +1,64 @@
+/* ****************************************************************************
+ *
+ *   The key cache interns the keys of hashtabs across parsings, see
+ * JP_INTERN_KEYS. A key seen for the first time is copied to a slot of its
+ * own, and the slot never changes afterwards, so that the caller (i.e. the
+ * Lua interface) can keep the slot-to-string mapping on its side, and map
+ * the key without looking at its bytes again.
+ *
+ *   The slots are numbered from 1 up to KEY_CACHE_SLOT_NUM; once they are
+ * used up, the new keys are no longer interned. The keys longer than
+ * KEY_CACHE_MAX_LEN are not interned either.
+ *
+ * ****************************************************************************
+ */
+#ifndef KEY_CACHE_H
+#define KEY_CACHE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define KEY_CACHE_SLOT_NUM  4095    /* fit in the 12 upper bits of flags */
+#define KEY_CACHE_MAX_LEN   24
+
+typedef struct {
+    uint32_t len;
+    uint32_t hash;
+    char str[KEY_CACHE_MAX_LEN];
+} key_slot_t;
+
+typedef struct {
+    key_slot_t* slots;      /* allocated when the first key is interned */
+    uint16_t* buckets;      /* open addressing, the slot # or 0 if empty */
+    uint32_t slot_num;      /* # of slots used */
+} key_cache_t;
+
+void kc_init(key_cache_t*);
+void kc_fini(key_cache_t*);
+
+/* Return the slot # of the given key, or 0 if it's not interned */
+uint32_t kc_intern(key_cache_t*, const char* key, uint32_t len);
+
+/* The hash of the key, shared with the index of JP_KEY_INDEX */
+static inline uint32_t
+key_hash(const char* key, uint32_t len) {
+    const uint64_t k = 0x9E3779B97F4A7C15ULL;
+    uint64_t w, h = len;
+    for (; len >= 8; key += 8, len -= 8) {
+        memcpy(&w, key, 8);
+        h = (h ^ w) * k;
+        h ^= h >> 32;
+    }
+
+    if (len) {
+        w = 0;
+        memcpy(&w, key, len);
+        h = (h ^ w) * k;
+        h ^= h >> 32;
+    }
+
+    /* The high bits of the product depend on all the bits of "h" */
+    return (uint32_t)((h * k) >> 32);
+}
+
+#endif /* KEY_CACHE_H */
@@ -0,0 +1,314 @@
+/* ****************************************************************************
+ *
+ *   This file implements the optional Lua module "ljson_c", which builds the
+ * Lua tables with the Lua C-API instead of FFI. It's picked by
+ * json_decoder.lua when FFI is unavailable (e.g. plain Lua 5.1), or when the
+ * JIT compiler of LuaJIT is off, as FFI is slow if interpreted.
+ *
+ *   The json is parsed to the tape (see jp_parse_tape()), which is walked
+ * once in the natural order. The tables being filled are kept on the Lua
+ * stack, and the # of elements left to fill of each of them is kept in
+ * "levels".
+ *
+ *   The interface mirrors the one of json_decoder.lua:
+ *
+ *      local ljson_c = require "ljson_c"
+ *      local decoder = ljson_c.new()
+ *      local result, err = decoder:decode(json)
+ *      local ok, err = decoder:validate(json)
+ *      decoder:set_null(null)
+ *      decoder:set_metatables(array_mt, hashtab_mt)
+ *
+ * plus decoder:parser(), with which json_decoder.lua shares the parser.
+ *
+ * ****************************************************************************
+ */
+#include <stdlib.h>
+#include "util.h"
+#include "ljson_parser.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#define DECODER_MT "ljson_c.decoder"
+
+/* The options of set_null() and set_metatables() are kept in the environment
+ * of the decoder, at these indices. decoder_decode() pushes them to the
+ * stack slots of the same numbers, right above the decoder and the json.
+ */
+enum {
+    OPT_NULL = 3,
+    OPT_ARRAY_MT,
+    OPT_HASHTAB_MT,
+};
+
+typedef struct {
+    struct json_parser* parser;
+
+    /* The state of each open array/hashtab: the # of elements left to fill,
+     * and the index of the last element of the array, or whether the key on
+     * top of the stack is waiting for its value for hashtab. The buffer is
+     * reused across calls.
+     */
+    struct level {
+        uint32_t left;
+        uint32_t idx;
+        int is_array;
+    }* levels;
+    uint32_t level_cap;
+} decoder_t;
+
+static decoder_t*
+check_decoder(lua_State* L) {
+    decoder_t* d = (decoder_t*)luaL_checkudata(L, 1, DECODER_MT);
+    if (unlikely(!d->parser))
+        luaL_error(L, "the decoder is destroyed");
+    return d;
+}
+
+static int
+decoder_new(lua_State* L) {
+    decoder_t* d = (decoder_t*)lua_newuserdata(L, sizeof(decoder_t));
+    d->parser = 0;
+    d->levels = 0;
+    d->level_cap = 0;
+    luaL_getmetatable(L, DECODER_MT);
+    lua_setmetatable(L, -2);
+    lua_createtable(L, OPT_HASHTAB_MT, 0);
+    lua_setfenv(L, -2);
+
+    d->parser = jp_create();
+    if (unlikely(!d->parser)) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Fail to create JSON parser, likely due to OOM");
+        return 2;
+    }
+    return 1;
+}
+
+static int
+decoder_gc(lua_State* L) {
+    decoder_t* d = (decoder_t*)luaL_checkudata(L, 1, DECODER_MT);
+    if (d->parser) {
+        jp_destroy(d->parser);
+        d->parser = 0;
+    }
+    free(d->levels);
+    d->levels = 0;
+    return 0;
+}
+
+static void
+push_primitive(lua_State* L, const jp_tape_t* entry) {
+    switch (entry->obj_ty) {
+    case OT_INT64:
+        lua_pushnumber(L, (lua_Number)entry->int_val);
+        break;
+    case OT_FP:
+        lua_pushnumber(L, entry->db_val);
+        break;
+    case OT_STR:
+        lua_pushlstring(L, entry->str_val, entry->str_len);
+        break;
+    case OT_BOOL:
+        lua_pushboolean(L, entry->int_val != 0);
+        break;
+    default:
+        lua_pushvalue(L, OPT_NULL);
+        break;
+    }
+}
+
+/* Make room for "depth" levels, raise an error on OOM */
+static struct level*
+reserve_levels(lua_State* L, decoder_t* d, uint32_t depth) {
+    if (likely(depth <= d->level_cap))
+        return d->levels;
+
+    uint32_t cap = d->level_cap ? d->level_cap * 2 : 64;
+    struct level* levels = (struct level*)realloc(d->levels,
+                                                  sizeof(*levels) * cap);
+    if (unlikely(!levels))
+        luaL_error(L, "OOM");
+
+    d->levels = levels;
+    d->level_cap = cap;
+    return levels;
+}
+
+/* Push the value at the beginning of the tape */
+static void
+push_tape(lua_State* L, decoder_t* d, const jp_tape_t* tape) {
+    if (tape->obj_ty <= OT_LAST_PRIMITIVE) {
+        push_primitive(L, tape);
+        return;
+    }
+
+    struct level* levels = d->levels;
+    uint32_t depth = 0;
+    uint32_t i, num = tape->skip;
+    for (i = 0; i < num; i++) {
+        const jp_tape_t* entry = tape + i;
+        int32_t elmt_num = 0;
+        if (entry->obj_ty <= OT_LAST_PRIMITIVE) {
+            push_primitive(L, entry);
+        } else {
+            elmt_num = entry->elmt_num;
+            int mt = OPT_HASHTAB_MT;
+            if (entry->obj_ty == OT_ARRAY) {
+                lua_createtable(L, elmt_num, 0);
+                mt = OPT_ARRAY_MT;
+            } else {
+                lua_createtable(L, 0, elmt_num / 2);
+            }
+
+            if (!lua_isnil(L, mt)) {
+                lua_pushvalue(L, mt);
+                lua_setmetatable(L, -2);
+            }
+        }
+
+        if (elmt_num) {
+            /* the table, the key of the enclosing hashtab if any, and the
+             * metatable of the next one
+             */
+            luaL_checkstack(L, 3, "json is nested too deep");
+            levels = reserve_levels(L, d, depth + 1);
+            levels[depth].left = elmt_num;
+            levels[depth].idx = 0;
+            levels[depth].is_array = (entry->obj_ty == OT_ARRAY);
+            depth++;
+            continue;
+        }
+
+        /* Set the value on top of the stack to the enclosing object, and so
+         * on for the objects thus completed.
+         */
+        while (depth) {
+            struct level* lv = levels + depth - 1;
+            lv->left--;
+            if (lv->is_array) {
+                lua_rawseti(L, -2, ++lv->idx);
+            } else if (!lv->idx) {
+                /* the key, wait for the value */
+                lv->idx = 1;
+                break;
+            } else {
+                lua_rawset(L, -3);
+                lv->idx = 0;
+            }
+
+            if (lv->left)
+                break;
+            depth--;
+        }
+    }
+}
+
+static int
+decoder_decode(lua_State* L) {
+    decoder_t* d = check_decoder(L);
+    size_t len;
+    const char* json = luaL_checklstring(L, 2, &len);
+
+    lua_settop(L, 2);
+    lua_getfenv(L, 1);
+    lua_rawgeti(L, 3, OPT_NULL);
+    lua_rawgeti(L, 3, OPT_ARRAY_MT);
+    lua_rawgeti(L, 3, OPT_HASHTAB_MT);
+    lua_remove(L, 3);
+
+    /* The strings are copied by lua_pushlstring() anyway */
+    const jp_tape_t* tape = jp_parse_tape(d->parser, json, len,
+                                          JP_ZERO_COPY);
+    if (unlikely(!tape)) {
+        lua_pushnil(L);
+        lua_pushstring(L, jp_get_err(d->parser));
+        return 2;
+    }
+
+    push_tape(L, d, tape);
+    return 1;
+}
+
+static int
+decoder_validate(lua_State* L) {
+    decoder_t* d = check_decoder(L);
+    size_t len;
+    const char* json = luaL_checklstring(L, 2, &len);
+
+    if (!jp_validate(d->parser, json, len, 0)) {
+        lua_pushnil(L);
+        lua_pushstring(L, jp_get_err(d->parser));
+        return 2;
+    }
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int
+decoder_set_null(lua_State* L) {
+    check_decoder(L);
+    lua_settop(L, 2);
+    lua_getfenv(L, 1);
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, OPT_NULL);
+    return 0;
+}
+
+static int
+decoder_set_metatables(lua_State* L) {
+    check_decoder(L);
+    if (!lua_isnoneornil(L, 2))
+        luaL_checktype(L, 2, LUA_TTABLE);
+    if (!lua_isnoneornil(L, 3))
+        luaL_checktype(L, 3, LUA_TTABLE);
+
+    lua_settop(L, 3);
+    lua_getfenv(L, 1);
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, OPT_ARRAY_MT);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, OPT_HASHTAB_MT);
+    return 0;
+}
+
+/* Return the parser as a light userdata, which is valid as long as the
+ * decoder is. json_decoder.lua does the rest with it through FFI, such that
+ * the decoder takes a single parser and mempool.
+ */
+static int
+decoder_parser(lua_State* L) {
+    decoder_t* d = check_decoder(L);
+    lua_pushlightuserdata(L, d->parser);
+    return 1;
+}
+
+static const luaL_Reg decoder_methods[] = {
+    { "decode", decoder_decode },
+    { "validate", decoder_validate },
+    { "set_null", decoder_set_null },
+    { "set_metatables", decoder_set_metatables },
+    { "parser", decoder_parser },
+    { 0, 0 },
+};
+
+static const luaL_Reg module_funcs[] = {
+    { "new", decoder_new },
+    { 0, 0 },
+};
+
+int __attribute__((visibility("default")))
+luaopen_ljson_c(lua_State* L) {
+    luaL_newmetatable(L, DECODER_MT);
+    lua_pushcfunction(L, decoder_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_newtable(L);
+    luaL_register(L, 0, decoder_methods);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    luaL_register(L, "ljson_c", module_funcs);
+    return 1;
+}
@@ -55,9 +55,29 @@ typedef enum {
 struct obj_tag;
 typedef struct obj_tag obj_t;
 
+/* Flags of an object */
+typedef enum {
+    /* The string is not copied, i.e. str_val points into the input json,
+     * which must outlive the object, and is not NUL-terminated. See
+     * JP_ZERO_COPY.
+     */
+    OF_BORROWED = 1,
+
+    /* The string is the raw text of an array/hashtab which is not parsed,
+     * see jp_parse_shallow().
+     */
+    OF_RAW = 2,
+} obj_flag_t;
+
+/* The slot of the key in the key cache, or 0 if it's not interned, see
+ * JP_INTERN_KEYS.
+ */
+#define JP_KEY_SLOT(flags)  ((flags) >> 4)
+
 struct obj_tag {
     obj_t* next;
-    int32_t obj_ty;
+    int16_t obj_ty;
+    uint16_t flags; /* bitwise-or of obj_flag_t */
     union {
         int32_t str_len;
         int32_t elmt_num; /* # of element of array/hashtab */
@@ -112,11 +132,272 @@ void jp_destroy(struct json_parser*) LJP_EXPORT;
  */
 obj_t* jp_parse(struct json_parser*, const char* json, uint32_t len) LJP_EXPORT;
 
+/* Flags of jp_parse_ex() */
+typedef enum {
+    /* Count the places where tokens could start before parsing, which
+     * bounds the # of tokens: JP_PREALLOC then allocates an upper bound
+     * instead of an estimate, and jp_parse_tape() sizes the tape in one go.
+     * The flag takes no effect otherwise (see "bench scan" for the cost).
+     */
+    JP_STRUCT_INDEX = 1,
+
+    /* Allocate the memory for the resulting objects in one go before
+     * parsing, such that they are contiguous in memory. The size is an
+     * upper bound if combined with JP_STRUCT_INDEX, otherwise an estimate
+     * (see jp_set_prealloc_ratio()).
+     */
+    JP_PREALLOC = 2,
+
+    /* Don't copy the strings free of escapes; let them point into the
+     * input json instead (see OF_BORROWED). The input json must be kept
+     * around as long as the result is in use.
+     */
+    JP_ZERO_COPY = 4,
+
+    /* Index the keys of each hashtab (with more than a few keys) on the
+     * tape, such that jp_hashtab_get() takes O(1) time instead of walking
+     * the keys. It takes effect with jp_parse_tape() and jp_parse_many().
+     */
+    JP_KEY_INDEX = 8,
+
+    /* Intern the keys of hashtabs in a cache kept by the parser across
+     * calls, and tell the slot of each key in the cache by the upper bits of
+     * its flags (see JP_KEY_SLOT()). The slot of a key never changes for the
+     * life of the parser, so the caller can map the slots to its own copies
+     * of the keys instead of looking at the bytes again. It takes no effect
+     * with jp_pool_parse*(), as each thread has a parser of its own.
+     */
+    JP_INTERN_KEYS = 16,
+} jp_flag_t;
+
+/* Same as jp_parse() except that the parsing is tuned by "flags", which is
+ * bitwise-or of jp_flag_t.
+ */
+obj_t* jp_parse_ex(struct json_parser*, const char* json, uint32_t len,
+                   uint32_t flags) LJP_EXPORT;
+
+/* An entry of the tape returned from jp_parse_tape(). The tape is the
+ * pre-order of the objects, i.e. a composite object is immediately followed
+ * by its elements (and their descendants), in the order they appear in the
+ * json. For hashtab {k1:v1, ..., kn:vn}, the elements are k1, v1, ..., kn, vn.
+ */
+typedef struct {
+    int16_t obj_ty;
+    uint16_t flags; /* bitwise-or of obj_flag_t */
+    union {
+        int32_t str_len;
+        int32_t elmt_num; /* # of element of array/hashtab */
+    };
+    union {
+        char* str_val;
+        int64_t int_val;
+        double db_val;
+
+        struct {
+            /* # of entries taken by the array/hashtab along with its
+             * descendants, i.e. the next sibling is "skip" entries away.
+             */
+            uint32_t skip;
+
+            /* The hash index of the keys of a hashtab is this many entries
+             * away, or 0 if none, see JP_KEY_INDEX.
+             */
+            uint32_t key_index;
+        };
+    };
+} jp_tape_t;
+
+/* Same as jp_parse_ex() except that the result is a flat tape instead of
+ * linked lists. The tape takes a single entry if the json is a primitive,
+ * or tape[0].skip entries otherwise. It remains valid until the next call
+ * to the jp_parse*() functions.
+ */
+const jp_tape_t* jp_parse_tape(struct json_parser*, const char* json,
+                               uint32_t len, uint32_t flags) LJP_EXPORT;
+
+/* Look up the value of the given key in the hashtab on the tape, without
+ * converting the hashtab as a whole. Return NULL if the key is not found,
+ * or the entry is not a hashtab. It walks the keys unless the hashtab is
+ * indexed (see JP_KEY_INDEX). If the key is duplicated, the first one wins.
+ */
+const jp_tape_t* jp_hashtab_get(const jp_tape_t* hashtab, const char* key,
+                                uint32_t key_len) LJP_EXPORT;
+
+/* Get the idx-th (0-based) element of the array on the tape, or NULL if it's
+ * out of range, or the entry is not an array.
+ */
+const jp_tape_t* jp_array_get(const jp_tape_t* array, uint32_t idx) LJP_EXPORT;
+
+/* The result of jp_parse_flat(): the tape laid out as a structure of arrays,
+ * the i-th node corresponding to the i-th entry of the tape. The values of
+ * int64/bool, fp and string nodes share the same array of 8-byte slots,
+ * viewed through "ints", "dbls" and "strs" respectively.
+ */
+typedef struct {
+    uint32_t num;               /* # of nodes */
+    const uint8_t* tags;        /* obj_ty_t */
+    const uint16_t* slots;      /* JP_KEY_SLOT() of the keys, 0 otherwise */
+    const uint32_t* lens;       /* str_len, or elmt_num of array/hashtab */
+    const int64_t* ints;
+    const double* dbls;
+    const char* const* strs;
+} jp_flat_t;
+
+/* Same as jp_parse_tape() except that the result is laid out as above, so
+ * that it can be walked with plain loads from the arrays. It remains valid
+ * until the next call.
+ */
+const jp_flat_t* jp_parse_flat(struct json_parser*, const char* json,
+                               uint32_t len, uint32_t flags) LJP_EXPORT;
+
+/* Parse a sequence of jsons separated by whitespaces (if necessary), e.g.
+ * newline-delimited json (aka NDJSON or JSON lines), and lay them on the
+ * tape one after another. The # of jsons is returned via "json_num". The
+ * i+1-th json follows the i-th one, which takes a single entry if it is a
+ * primitive, or "skip" entries otherwise. The last json need not be followed
+ * by a newline, even if it is a primitive.
+ *
+ * The input is parsed as a whole, hence in the event of error, NULL is
+ * returned, and the location of the error (see jp_get_err()) tells which
+ * json is malformed.
+ */
+const jp_tape_t* jp_parse_many(struct json_parser*, const char* json,
+                               uint32_t len, uint32_t flags,
+                               uint32_t* json_num) LJP_EXPORT;
+
+/* A pool of threads parsing in parallel, each of which has a parser of its
+ * own. The pool itself is not thread-safe.
+ */
+struct jp_pool;
+
+/* Create a pool of "thread_num" threads, including the calling thread, i.e.
+ * thread_num - 1 threads are spawned. Return NULL on failure.
+ */
+struct jp_pool* jp_pool_create(uint32_t thread_num) LJP_EXPORT;
+void jp_pool_destroy(struct jp_pool*) LJP_EXPORT;
+
+/* The result of jp_pool_parse_many() for a slice of the input */
+typedef struct {
+    const jp_tape_t* tape;
+    uint32_t json_num;
+} jp_slice_t;
+
+/* Same as jp_parse_many() except that the input is split at newlines into up
+ * to as many slices as threads, which are parsed in parallel. Hence, the
+ * jsons must not span multiple lines, which is the case of NDJSON.
+ *
+ * The result of each slice, in the order of input, is returned along with
+ * the # of slices via "slice_num". It remains valid until the next call.
+ * In the event of error, NULL is returned, see jp_pool_get_err().
+ */
+const jp_slice_t* jp_pool_parse_many(struct jp_pool*, const char* json,
+                                     uint32_t len, uint32_t flags,
+                                     uint32_t* slice_num) LJP_EXPORT;
+
+/* Same as jp_parse_ex() except that if the json is a large array, its
+ * elements are split into up to as many slices as threads, which are parsed
+ * in parallel and then stitched into one array. The result remains valid
+ * until the next call.
+ */
+obj_t* jp_pool_parse(struct jp_pool*, const char* json, uint32_t len,
+                     uint32_t flags) LJP_EXPORT;
+
+const char* jp_pool_get_err(struct jp_pool*) LJP_EXPORT;
+
+/* Pick the values referred to by the given JSON pointers (RFC 6901), e.g.
+ * "/user/id" or "/events/0/type", out of the json. The value of the i-th
+ * pointer is laid on a tape as if it were parsed by jp_parse_tape(), and
+ * the i-th element of the returned array points to it, or is NULL if there
+ * is no such value. The result remains valid until the next call.
+ *
+ * The array/hashtab which do not lead to the values are skipped by matching
+ * the brackets and quotes, and the parsing stops once all the values are
+ * found, hence the json is not fully validated. In the event of error, NULL
+ * is returned. JP_ZERO_COPY is the only flag taking effect.
+ */
+const jp_tape_t* const* jp_parse_paths(struct json_parser*, const char* json,
+                                       uint32_t len, uint32_t flags,
+                                       const char* const* paths,
+                                       uint32_t path_num) LJP_EXPORT;
+
+/* Same as jp_parse_tape() except that only the out-most array/hashtab is
+ * parsed: its elements which are array/hashtab are not looked into, but
+ * laid on the tape as strings (flagged with OF_RAW and OF_BORROWED) holding
+ * their raw text, which can be parsed later on if needed. They are skipped
+ * by matching the brackets and quotes, hence not validated. JP_ZERO_COPY is
+ * the only flag taking effect.
+ */
+const jp_tape_t* jp_parse_shallow(struct json_parser*, const char* json,
+                                  uint32_t len, uint32_t flags) LJP_EXPORT;
+
+/* Return the length of the json value at the beginning of "json", including
+ * the whitespaces ahead of it, or 0 if it does not end within "len" bytes.
+ * The value is not validated: an array/hashtab is skipped by matching the
+ * brackets and quotes with vector instructions, without looking into the
+ * tokens.
+ */
+uint32_t jp_skip_value(const char* json, uint32_t len) LJP_EXPORT;
+
+/* Check if the given json is well-formed without building any result, which
+ * is much faster than parsing it. Return 1 if it is, 0 otherwise, see
+ * jp_get_err() for the error message. No flag takes effect so far.
+ */
+int jp_validate(struct json_parser*, const char* json, uint32_t len,
+                uint32_t flags) LJP_EXPORT;
+
+/* Parse the json fed piece by piece, e.g. as it arrives from the network.
+ * The first jp_feed() after jp_create(), jp_finish() or the jp_parse*()
+ * functions starts a new json. The pieces can be split anywhere, even in
+ * the middle of a token, and can be discarded once fed.
+ *
+ * jp_feed() returns 0 if the json is known to be malformed, 1 otherwise.
+ * jp_finish() tells the end of the json, and returns the tape (as if the
+ * json were parsed by jp_parse_tape()), or NULL on error.
+ */
+int jp_feed(struct json_parser*, const char* data, uint32_t len) LJP_EXPORT;
+const jp_tape_t* jp_finish(struct json_parser*) LJP_EXPORT;
+
 /* Get the error message. Do not call this function if jp_parser() return
  * non-NULL pointer.
  */
 const char* jp_get_err(struct json_parser*) LJP_EXPORT;
 
+/* The parser keeps the memory of a jp_parse() for the next one, up to
+ * the given limit (1M bytes by default), such that parsing jsons of similar
+ * size over and over again calls no malloc() at all.
+ */
+void jp_set_mem_retain(struct json_parser*, uint32_t bytes) LJP_EXPORT;
+
+/* Release the retained memory. The result of the last jp_parse() remains
+ * valid.
+ */
+void jp_trim_mem(struct json_parser*) LJP_EXPORT;
+
+/* The memory is allocated in chunks, each of which is as large as all the
+ * previous ones, up to "max_chunk" bytes (8M by default); the first one is
+ * sized after the length of the input json. If "huge_page" is non-zero, the
+ * chunks of 2M or larger are mmap()ed and advised to be backed by
+ * transparent huge pages.
+ */
+void jp_set_mem_chunk(struct json_parser*, uint32_t max_chunk,
+                      int huge_page) LJP_EXPORT;
+
+/* Without JP_STRUCT_INDEX, JP_PREALLOC allocates "ratio" times as
+ * much memory as the input json (4 by default). The objects which do not
+ * fit are allocated as usual.
+ */
+void jp_set_prealloc_ratio(struct json_parser*, uint32_t ratio) LJP_EXPORT;
+
+typedef struct {
+    uint64_t chunk_malloc;  /* # of memory chunks malloc()ed or mmap()ed */
+    uint64_t chunk_free;    /* # of memory chunks given back */
+    uint64_t chunk_reuse;   /* # of memory chunks reused */
+    uint32_t retained;      /* bytes of memory retained */
+    uint64_t result_size;   /* bytes taken by the result of the last parse */
+} jp_mem_stats_t;
+
+void jp_get_mem_stats(struct json_parser*, jp_mem_stats_t*) LJP_EXPORT;
+
 /* Dump the result returned from jp_parse() */
 void dump_obj(FILE*, obj_t*) LJP_EXPORT;
 
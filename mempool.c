@@ -1,6 +1,8 @@
 #include <unistd.h>
+#include <sys/mman.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "mempool.h"
 #include "util.h"
@@ -25,38 +27,140 @@ align_free_pointer(chunk_hdr_t* chunk_hdr, int align) {
     chunk_hdr->free = p;
 }
 
+static inline uint32_t
+chunk_size(chunk_hdr_t* chunk) {
+    return chunk->chunk_end - (char*)(void*)chunk;
+}
+
 /* Allocate a chunk which can accommodate an object of given size. If size
- * is not specified (i.e. size = 0), default size is used.
+ * is not specified (i.e. size = 0), default size is used. Given the mempool,
+ * the chunk is at least as large as the size hint, or as all the chunks in
+ * use, such that the chunks grow geometrically, up to mp->max_chunk.
  */
 static chunk_hdr_t*
-alloc_chunk(int size) {
-    int s = default_chunk_sz();
-    if (!size)
-        size = s;
-    else {
-        size += sizeof(mempool_t) + MAX_ALIGN;
-        if (size < s)
-            size = s;
+alloc_chunk(mempool_t* mp, int size) {
+    uint64_t sz = default_chunk_sz();
+    if (size && size + sizeof(mempool_t) + MAX_ALIGN > sz)
+        sz = size + sizeof(mempool_t) + MAX_ALIGN;
+
+    int huge = 0;
+    if (mp) {
+        uint64_t grow = mp->chain_size;
+        if (mp->size_hint > grow)
+            grow = mp->size_hint;
+        mp->size_hint = 0;
+
+        if (grow > mp->max_chunk)
+            grow = mp->max_chunk;
+
+        /* Try not to outgrow the retain limit, otherwise the chunks beyond
+         * the limit would be free()ed and allocated again and again when
+         * parsing jsons of similar size.
+         */
+        uint64_t in_use = mp->chain_size - chunk_size(&mp->chunk_hdr);
+        if (in_use < mp->retain_limit && grow > mp->retain_limit - in_use)
+            grow = mp->retain_limit - in_use;
+
+        if (grow > sz)
+            sz = grow;
+
+        huge = mp->huge_page && sz >= HUGE_PAGE_SZ;
+    }
+
+    char* blk;
+    if (huge) {
+        sz = (sz + HUGE_PAGE_SZ - 1) & ~(uint64_t)(HUGE_PAGE_SZ - 1);
+        blk = (char*)mmap(NULL, sz, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (unlikely(blk == MAP_FAILED))
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        madvise(blk, sz, MADV_HUGEPAGE);
+#endif
+    } else {
+        blk = (char*) malloc(sz);
+        if (unlikely(!blk))
+            return NULL;
     }
 
-    char* blk = (char*) malloc(size);
     chunk_hdr_t* chunk_hdr = (chunk_hdr_t*)blk;
     chunk_hdr->next = NULL;
-    chunk_hdr->chunk_end = blk + size;
+    chunk_hdr->chunk_end = blk + sz;
     chunk_hdr->free = blk + sizeof(chunk_hdr_t);
+    chunk_hdr->flags = huge ? CHUNK_MMAP : 0;
     align_free_pointer(chunk_hdr, DEFAULT_ALIGN);
 
     return chunk_hdr;
 }
 
-/* Allocate a new chunk and add it to the mempool, return 1 on success,
- * 0 otherwise.
+static void
+free_chunk(chunk_hdr_t* chunk) {
+    if (chunk->flags & CHUNK_MMAP)
+        munmap((void*)chunk, chunk_size(chunk));
+    else
+        free((void*)chunk);
+}
+
+/* Take a retained chunk which can accommodate an object of given size,
+ * return NULL if there is no such chunk.
+ */
+static chunk_hdr_t*
+reuse_chunk(mempool_t* mp, int size) {
+    chunk_hdr_t** pp;
+    for (pp = &mp->retained; *pp; pp = &(*pp)->next) {
+        chunk_hdr_t* chunk = *pp;
+        chunk->free = sizeof(chunk_hdr_t) + (char*)(void*)chunk;
+        align_free_pointer(chunk, DEFAULT_ALIGN);
+
+        if (chunk->chunk_end - chunk->free >= size) {
+            *pp = chunk->next;
+            chunk->next = NULL;
+            mp->stats.retained -= chunk_size(chunk);
+            mp->stats.chunk_reuse++;
+            return chunk;
+        }
+    }
+
+    return NULL;
+}
+
+/* Keep the leading retained chunks no more than "keep" bytes in total, and
+ * free() the rest.
+ */
+static void
+free_retained(mempool_t* mp, uint32_t keep) {
+    chunk_hdr_t** pp = &mp->retained;
+    uint32_t kept = 0;
+    while (*pp) {
+        chunk_hdr_t* chunk = *pp;
+        uint32_t size = chunk_size(chunk);
+        if ((uint64_t)kept + size <= keep) {
+            kept += size;
+            pp = &chunk->next;
+            continue;
+        }
+
+        *pp = chunk->next;
+        free_chunk(chunk);
+        mp->stats.chunk_free++;
+    }
+
+    mp->stats.retained = kept;
+}
+
+/* Add a new chunk, either reused or allocated, to the mempool, return 1 on
+ * success, 0 otherwise.
  */
 static int
 add_a_chunk(mempool_t* mp, int size) {
-    chunk_hdr_t* new_chunk = alloc_chunk(size);
-    if (!new_chunk)
-        return 0;
+    chunk_hdr_t* new_chunk = reuse_chunk(mp, size);
+    if (!new_chunk) {
+        new_chunk = alloc_chunk(mp, size);
+        if (!new_chunk)
+            return 0;
+        mp->stats.chunk_malloc++;
+    }
+    mp->chain_size += chunk_size(new_chunk);
 
     if (!mp->chunk_hdr.next) {
         ASSERT(mp->last == &mp->chunk_hdr);
@@ -72,7 +176,7 @@ add_a_chunk(mempool_t* mp, int size) {
 
 mempool_t*
 mp_create() {
-    chunk_hdr_t* chunk_hdr = alloc_chunk(0);
+    chunk_hdr_t* chunk_hdr = alloc_chunk(NULL, 0);
     if (!chunk_hdr)
         return NULL;
 
@@ -81,6 +185,14 @@ mp_create() {
 
     mempool_t* mp = (mempool_t*)(void*)chunk_hdr;
     mp->last = chunk_hdr;
+    mp->retained = NULL;
+    mp->retain_limit = MP_DEFAULT_RETAIN;
+    memset(&mp->stats, 0, sizeof(mp->stats));
+    mp->stats.chunk_malloc = 1;
+    mp->chain_size = chunk_size(chunk_hdr);
+    mp->max_chunk = MP_DEFAULT_MAX_CHUNK;
+    mp->size_hint = 0;
+    mp->huge_page = 0;
 
     return mp;
 }
@@ -93,12 +205,45 @@ mp_alloc_slow(mempool_t* mp, int size) {
     return mp_alloc(mp, size);
 }
 
+/* the slow-path of mp_reserve() */
+char*
+mp_reserve_slow(mempool_t* mp, int size, char** end) {
+    if (unlikely(add_a_chunk(mp, size) == 0))
+        return NULL;
+
+    chunk_hdr_t* chunk = mp->last;
+    *end = chunk->chunk_end;
+    return chunk->free;
+}
+
+int
+mp_prealloc(mempool_t* mp, int size) {
+    chunk_hdr_t* chunk = mp->last;
+    if (chunk->chunk_end - chunk->free >= size)
+        return 1;
+
+    return add_a_chunk(mp, size);
+}
+
+uint64_t
+mp_used(mempool_t* mp) {
+    chunk_hdr_t* chunk = &mp->chunk_hdr;
+    uint64_t used = chunk->free - (sizeof(mempool_t) + (char*)(void*)chunk);
+
+    for (chunk = chunk->next; chunk; chunk = chunk->next)
+        used += chunk->free - (sizeof(chunk_hdr_t) + (char*)(void*)chunk);
+
+    return used;
+}
+
 void
 mp_destroy(mempool_t* mp) {
+    free_retained(mp, 0);
+
     chunk_hdr_t* iter = mp->chunk_hdr.next;
     while (iter) {
         chunk_hdr_t* next = iter->next;
-        free((void*)iter);
+        free_chunk(iter);
         iter = next;
     };
 
@@ -109,17 +254,51 @@ mp_destroy(mempool_t* mp) {
 void
 mp_free_all(mempool_t* mp) {
     chunk_hdr_t* iter;
+    chunk_hdr_t* kept = NULL;
+    chunk_hdr_t** kept_tail = &kept;
 
     for (iter = mp->chunk_hdr.next; iter != 0;) {
         chunk_hdr_t* next = iter->next;
-        free((void*)iter);
+        uint32_t size = chunk_size(iter);
+        if ((uint64_t)mp->stats.retained + size <= mp->retain_limit) {
+            *kept_tail = iter;
+            kept_tail = &iter->next;
+            mp->stats.retained += size;
+        } else {
+            free_chunk(iter);
+            mp->stats.chunk_free++;
+        }
         iter = next;
     }
 
+    /* The chunks just released are reused first, in the order they were
+     * allocated, so that parsing similar jsons takes the same chunks again.
+     */
+    *kept_tail = mp->retained;
+    mp->retained = kept;
+
     chunk_hdr_t* chunk = &mp->chunk_hdr;
     chunk->next = 0;
     mp->last = chunk;
+    mp->chain_size = chunk_size(chunk);
 
     chunk->free = sizeof(mempool_t) + (char*)(void*)chunk;
     align_free_pointer(chunk, DEFAULT_ALIGN);
 }
+
+void
+mp_set_retain_limit(mempool_t* mp, uint32_t limit) {
+    mp->retain_limit = limit;
+    free_retained(mp, limit);
+}
+
+void
+mp_trim(mempool_t* mp) {
+    free_retained(mp, 0);
+}
+
+void
+mp_set_max_chunk(mempool_t* mp, uint32_t max_chunk, int huge_page) {
+    mp->max_chunk = max_chunk;
+    mp->huge_page = huge_page;
+}
@@ -12,32 +12,75 @@
  *  o. mp_destroy: destroy the memory pool instance.
  *  o. mp_alloc(mempool, size) : allocate a block having at least "size"-byte.
  *                               block is 8-byte aligned.
- *  o. mp_free_all() : free all blocks allocated so far.
+ *  o. mp_free_all() : free all blocks allocated so far. The chunks are
+ *                   retained for the subsequent allocations, up to the limit
+ *                   set by mp_set_retain_limit(), and the rest are free()ed.
+ *  o. mp_trim() : free() all retained chunks.
+ *  o. mp_set_max_chunk(): limit the growth of chunk size.
+ *  o. mp_set_size_hint(): hint the size of the next chunk.
+ *  o. mp_prealloc(): allocate the memory for the subsequent allocations in
+ *                   one chunk.
+ *  o. mp_get_stats(): get the counters of chunk allocation.
+ *  o. mp_reserve()/mp_commit(): for those who don't know the size of the
+ *                   block in advance. mp_reserve() returns the free space of
+ *                   the current chunk without allocating it, and mp_commit()
+ *                   allocates the leading part actually used.
  *
  * ****************************************************************************
  */
 #ifndef MEM_POOL_H
 #define MEM_POOL_H
 
-/* A chunk is typically 4k-byte in size; the management structure resides at
- * the beginning of the chunk.
+#include <stdint.h>
+
+/* The first chunk is typically 4k-byte in size, and the subsequent ones are
+ * as large as all the chunks before them, up to a limit (see
+ * mp_set_max_chunk()). The management structure resides at the beginning of
+ * the chunk.
  */
 typedef struct chunk_hdr chunk_hdr_t;
 struct chunk_hdr {
     chunk_hdr_t* next;
     char* chunk_end;
     char* free;
+    int flags;
 };
 
+/* chunk_hdr_t::flags */
+#define CHUNK_MMAP  1   /* allocated by mmap() rather than malloc() */
+
+typedef struct {
+    uint64_t chunk_malloc;  /* # of chunks obtained from malloc()/mmap() */
+    uint64_t chunk_free;    /* # of chunks given back by free()/munmap() */
+    uint64_t chunk_reuse;   /* # of chunks reused from the retained ones */
+    uint32_t retained;      /* size in bytes of the retained chunks */
+} mp_stats_t;
+
 struct mempool;
 typedef struct mempool mempool_t;
 struct mempool {
     chunk_hdr_t chunk_hdr;
     chunk_hdr_t* last;
+    chunk_hdr_t* retained;  /* the chunks kept by mp_free_all() */
+    uint32_t retain_limit;  /* max bytes of the retained chunks */
+    uint64_t chain_size;    /* bytes of the chunks in use */
+    uint32_t max_chunk;     /* the chunk stops growing at this size */
+    uint32_t size_hint;     /* the expected size of the next chunk */
+    int huge_page;          /* mmap() large chunks with huge page */
+    mp_stats_t stats;
 };
 
 #define DEFAULT_ALIGN 8
 
+/* Default limit of the retained chunks, in bytes */
+#define MP_DEFAULT_RETAIN (1024 * 1024)
+
+/* Default limit of the chunk size, in bytes */
+#define MP_DEFAULT_MAX_CHUNK (8 * 1024 * 1024)
+
+/* Chunks of this size or larger are backed by huge pages if requested */
+#define HUGE_PAGE_SZ (2 * 1024 * 1024)
+
 /* create a mempool */
 mempool_t* mp_create();
 
@@ -47,6 +90,44 @@ void mp_destroy(mempool_t*);
 /* Free all blocks allocated by the mempool */
 void mp_free_all(mempool_t*);
 
+/* Retain at most "limit" bytes of chunks in mp_free_all(). The chunks
+ * already retained beyond the new limit are free()ed.
+ */
+void mp_set_retain_limit(mempool_t*, uint32_t limit);
+
+/* free() all the retained chunks */
+void mp_trim(mempool_t*);
+
+/* Stop growing chunks at "max_chunk" bytes. If "huge_page" is non-zero, the
+ * chunks no smaller than HUGE_PAGE_SZ are mmap()ed and advised to be backed
+ * by transparent huge pages.
+ */
+void mp_set_max_chunk(mempool_t*, uint32_t max_chunk, int huge_page);
+
+/* Return the # of bytes allocated since the last mp_free_all(), including
+ * the padding for alignment.
+ */
+uint64_t mp_used(mempool_t*);
+
+/* Make sure the subsequent allocations of "size" bytes in total can be
+ * served by the current chunk, allocating a chunk of that size (regardless
+ * of the limit of mp_set_max_chunk()) if necessary. Return 0 on OOM.
+ */
+int mp_prealloc(mempool_t*, int size);
+
+/* Hint the mempool that about "size" bytes are to be allocated, which will
+ * be taken into account when allocating the next chunk.
+ */
+static inline void
+mp_set_size_hint(mempool_t* mp, uint32_t size) {
+    mp->size_hint = size;
+}
+
+static inline const mp_stats_t*
+mp_get_stats(mempool_t* mp) {
+    return &mp->stats;
+}
+
 /* Allocate a block of "size" bytes. Default alignment is 8-byte. */
 static inline void*
 mp_alloc(mempool_t* mp, int size) {
@@ -66,6 +147,32 @@ mp_alloc(mempool_t* mp, int size) {
     return mp_alloc_slow(mp, size);
 }
 
+/* Return the free space of the current chunk, which is at least "size"
+ * bytes, and set "*end" to the end of the space. Nothing is allocated until
+ * mp_commit() is called. In between, the mempool must not be used for other
+ * allocations. Return NULL on OOM.
+ */
+static inline char*
+mp_reserve(mempool_t* mp, int size, char** end) {
+    chunk_hdr_t* chunk = mp->last;
+    if (chunk->free + size <= chunk->chunk_end) {
+        *end = chunk->chunk_end;
+        return chunk->free;
+    }
+
+    char* mp_reserve_slow(mempool_t* mp, int size, char** end);
+    return mp_reserve_slow(mp, size, end);
+}
+
+/* Allocate the leading "size" bytes of the space returned by the last
+ * mp_reserve().
+ */
+static inline void
+mp_commit(mempool_t* mp, int size) {
+    size = (size + DEFAULT_ALIGN - 1) & ~(DEFAULT_ALIGN - 1);
+    mp->last->free += size;
+}
+
 /* To allocate a block of type "t" */
 #define MEMPOOL_ALLOC_TYPE(mp, t) ((t*)mp_alloc((mp), sizeof(t)))
 
@@ -26,6 +26,9 @@ typedef enum {
     /* See  ']' */
     PAE_CLOSE,
 
+    /* See the end of the slice of the out-most array, after ',' */
+    PAE_SLICE_END,
+
     PAE_ERR
 } PAE_STATE;
 
@@ -59,6 +62,14 @@ parse_array_elmt(parser_t* parser, obj_composite_t* array_obj, token_t* tk) {
             return PAE_CLOSE;
     }
 
+    /* case 4: The elements of the out-most array are parsed in slices, and
+     *  this slice ends (see parse_array_slice()).
+     */
+    if (tk->type == TT_END && parser->array_slice &&
+        pstack_top(parser)->prev == &parser->parse_stack) {
+        return PAE_SLICE_END;
+    }
+
     set_parser_err(parser, syntax_err);
     return PAE_ERR;
 }
@@ -107,6 +118,9 @@ parse_array(parser_t* parser) {
                         /* remember where we leave off */
                         state->parse_state = PA_PARSING_MORE_ELMT;
                         return 1;
+                    } else if (ret == PAE_SLICE_END) {
+                        emit_array(parser);
+                        return 1;
                     } else {
                         goto err_out;
                     }
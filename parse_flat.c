@@ -0,0 +1,82 @@
+/* ****************************************************************************
+ *
+ *   This file implements jp_parse_flat(), which lays the tape out as a
+ * structure of arrays (see jp_flat_t). The nodes are in the same order as
+ * the entries of the tape, and the arrays are carved out of a single
+ * buffer, which is reused across calls.
+ *
+ * ****************************************************************************
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "parser.h"
+
+/* bytes per node: value, length, slot and tag */
+#define NODE_SIZE (8 + 4 + 2 + 1)
+
+void
+flat_init(flat_t* flat) {
+    memset(&flat->result, 0, sizeof(flat->result));
+    flat->buf = 0;
+    flat->capacity = 0;
+}
+
+void
+flat_fini(flat_t* flat) {
+    free(flat->buf);
+    flat_init(flat);
+}
+
+/* Make room for "num" nodes, return 0 on OOM. The content is not kept. */
+static int
+flat_reserve(flat_t* flat, uint32_t num) {
+    if (likely(flat->capacity >= num))
+        return 1;
+
+    uint64_t cap = flat->capacity ? flat->capacity : 256;
+    while (cap < num)
+        cap *= 2;
+
+    void* buf = malloc(cap * NODE_SIZE);
+    if (unlikely(!buf))
+        return 0;
+
+    free(flat->buf);
+    flat->buf = buf;
+    flat->capacity = cap;
+
+    /* The arrays go in the order of alignment */
+    jp_flat_t* res = &flat->result;
+    res->ints = (const int64_t*)buf;
+    res->dbls = (const double*)buf;
+    res->strs = (const char* const*)buf;
+    res->lens = (const uint32_t*)(res->ints + cap);
+    res->slots = (const uint16_t*)(res->lens + cap);
+    res->tags = (const uint8_t*)(res->slots + cap);
+    return 1;
+}
+
+const jp_flat_t*
+flatten_tape(flat_t* flat, const jp_tape_t* tape, uint32_t num) {
+    if (unlikely(!flat_reserve(flat, num)))
+        return 0;
+
+    jp_flat_t* res = &flat->result;
+    int64_t* vals = (int64_t*)res->ints;
+    uint32_t* lens = (uint32_t*)res->lens;
+    uint16_t* slots = (uint16_t*)res->slots;
+    uint8_t* tags = (uint8_t*)res->tags;
+
+    uint32_t i;
+    for (i = 0; i < num; i++) {
+        const jp_tape_t* entry = tape + i;
+        tags[i] = entry->obj_ty;
+        slots[i] = JP_KEY_SLOT(entry->flags);
+        lens[i] = entry->str_len;
+        vals[i] = entry->int_val;
+    }
+
+    res->num = num;
+    return res;
+}
@@ -30,6 +30,9 @@ parse_keyval_pair(parser_t* parser, obj_composite_t* htab_obj) {
         if (unlikely(!emit_primitive_tk(parser->mempool, tk, htab_obj))) {
             return PKVP_ERR;
         }
+
+        obj_t* key = htab_obj->subobjs;
+        key->flags = intern_key(parser, tk->str_val, tk->str_len, key->flags);
     } else if (tk->type == TT_CHAR && tk->char_val == '}') {
         return PKVP_CLOSE;
     } else {
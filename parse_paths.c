@@ -0,0 +1,448 @@
+/* ****************************************************************************
+ *
+ *   This file implements jp_parse_paths(), which picks the values referred
+ * to by the given JSON pointers (RFC 6901) out of the json, building nothing
+ * for the rest of it.
+ *
+ *   The pointers are merged into a trie of reference tokens, and the json is
+ * walked along the trie: the array/hashtab on the way are scaned token by
+ * token, while the array/hashtab off the way are skipped by matching the
+ * brackets and quotes (see sc_skip_composite()), hence they are neither
+ * allocated nor validated. A value referred to by a pointer is parsed to
+ * the tape as jp_parse_tape() does, and the pointers below it are resolved
+ * on the tape. The walk stops as soon as all the values are found.
+ *
+ * ****************************************************************************
+ */
+#include <string.h>
+#include "util.h"
+#include "parser.h"
+
+/* The index of a reference token which is not an array index */
+#define NO_INDEX ((uint32_t)-1)
+
+/* The tape entry of a value not found */
+#define NOT_FOUND ((uint32_t)-1)
+
+typedef struct path_node_tag path_node_t;
+struct path_node_tag {
+    /* The reference token (unescaped), and its value as an array index */
+    const char* token;
+    uint32_t token_len;
+    uint32_t index;
+
+    path_node_t* parent;
+    path_node_t* child; /* the 1st child */
+    path_node_t* sibling;
+
+    /* # of the nodes in the subtree, which are referred to by pointers and
+     * not yet walked.
+     */
+    uint32_t pending;
+    int requested; /* non-zero if a pointer refers to this node */
+
+    uint32_t entry; /* the value on the tape, or NOT_FOUND */
+};
+
+enum {
+    WALK_ERR,
+    WALK_OK,
+    WALK_DONE, /* all the values are found, the rest is not walked */
+};
+
+/* Return the array index the reference token stands for, or NO_INDEX if
+ * it's not in the form of "0" or "[1-9][0-9]*".
+ */
+static uint32_t
+token_index(const char* token, uint32_t len) {
+    if (len == 0 || len > 9 || (token[0] == '0' && len > 1))
+        return NO_INDEX;
+
+    uint32_t i, index = 0;
+    for (i = 0; i < len; i++) {
+        if (token[i] < '0' || token[i] > '9')
+            return NO_INDEX;
+        index = index * 10 + token[i] - '0';
+    }
+    return index;
+}
+
+/* Return the child of "node" for the given reference token, which is added
+ * if not yet existing; return NULL on OOM.
+ */
+static path_node_t*
+get_child(mempool_t* mp, path_node_t* node, const char* token,
+          uint32_t len) {
+    path_node_t* child;
+    for (child = node->child; child; child = child->sibling) {
+        if (child->token_len == len && !memcmp(child->token, token, len))
+            return child;
+    }
+
+    child = MEMPOOL_ALLOC_TYPE(mp, path_node_t);
+    if (unlikely(!child))
+        return 0;
+
+    child->token = token;
+    child->token_len = len;
+    child->index = token_index(token, len);
+    child->parent = node;
+    child->child = 0;
+    child->sibling = node->child;
+    child->pending = 0;
+    child->requested = 0;
+    child->entry = NOT_FOUND;
+
+    node->child = child;
+    return child;
+}
+
+/* Add the pointer to the trie, return the node it refers to, or NULL if the
+ * pointer is malformed or on OOM (see parser_t::err_msg).
+ */
+static path_node_t*
+add_path(parser_t* parser, path_node_t* root, const char* path) {
+    mempool_t* mp = parser->mempool;
+    path_node_t* node = root;
+
+    if (*path && *path != '/') {
+        parser->err_msg = "JSON pointer must start with '/'";
+        return 0;
+    }
+
+    while (*path == '/') {
+        path++;
+        uint32_t len = strcspn(path, "/");
+
+        /* Unescape "~1" and "~0" to '/' and '~' respectively */
+        char* token = MEMPOOL_ALLOC_TYPE_N(mp, char, len + 1);
+        if (unlikely(!token))
+            goto oom;
+
+        uint32_t i, token_len = 0;
+        for (i = 0; i < len; i++) {
+            char c = path[i];
+            if (c == '~') {
+                c = path[++i];
+                if (c != '0' && c != '1') {
+                    parser->err_msg = "JSON pointer has illegal escape";
+                    return 0;
+                }
+                c = (c == '0') ? '~' : '/';
+            }
+            token[token_len++] = c;
+        }
+
+        node = get_child(mp, node, token, token_len);
+        if (unlikely(!node))
+            goto oom;
+        path += len;
+    }
+
+    if (!node->requested) {
+        node->requested = 1;
+        path_node_t* n;
+        for (n = node; n; n = n->parent)
+            n->pending++;
+    }
+    return node;
+
+oom:
+    parser->err_msg = "OOM";
+    return 0;
+}
+
+/* The node is walked: the nodes of the subtree that are not yet found will
+ * never be.
+ */
+static inline void
+finish_node(path_node_t* node) {
+    uint32_t pending = node->pending;
+    path_node_t* n;
+    for (n = node; n; n = n->parent)
+        n->pending -= pending;
+}
+
+/* Look for the value of "node" in the array/hashtab at the given entry */
+static uint32_t
+find_on_tape(const jp_tape_t* tape, uint32_t cobj, const path_node_t* node) {
+    const jp_tape_t* entry = tape + cobj;
+    const jp_tape_t* val;
+    if (entry->obj_ty == OT_HASHTAB)
+        val = jp_hashtab_get(entry, node->token, node->token_len);
+    else
+        val = jp_array_get(entry, node->index);
+
+    return val ? (uint32_t)(val - tape) : NOT_FOUND;
+}
+
+/* Resolve the children of "node", whose value is already on the tape */
+static void
+resolve_on_tape(const jp_tape_t* tape, path_node_t* node) {
+    if (node->entry == NOT_FOUND ||
+        tape[node->entry].obj_ty <= OT_LAST_PRIMITIVE) {
+        return;
+    }
+
+    path_node_t* child;
+    for (child = node->child; child; child = child->sibling) {
+        child->entry = find_on_tape(tape, node->entry, child);
+        resolve_on_tape(tape, child);
+    }
+}
+
+/* Parse the value of "node" to the tape */
+static int
+parse_value(parser_t* parser, path_node_t* node, obj_ty_t enclosing,
+            int zero_copy) {
+    tape_t* tape = &parser->tape;
+    node->entry = tape->entry_num;
+    tape->parent = NO_PARENT;
+    tape->state = TS_VALUE;
+    tape->enclosing = enclosing;
+
+    scaner_t* scaner = &parser->scaner;
+    scaner->zero_copy = zero_copy;
+    int res = tape_resume(parser);
+    scaner->zero_copy = 1;
+
+    if (unlikely(res != TP_DONE)) {
+        node->entry = NOT_FOUND;
+        return 0;
+    }
+
+    resolve_on_tape(tape->entries, node);
+    return 1;
+}
+
+/* The state of the walk */
+typedef struct {
+    parser_t* parser;
+    path_node_t* root;
+    int zero_copy; /* JP_ZERO_COPY is specified */
+} walk_t;
+
+static int walk(walk_t*, path_node_t* node, obj_ty_t enclosing);
+
+/* Skip the value following the scaner without looking into it if it is an
+ * array/hashtab.
+ */
+static int
+skip_value(parser_t* parser, obj_ty_t enclosing) {
+    scaner_t* scaner = &parser->scaner;
+    token_t* tk = sc_get_token(scaner, scaner->json_end);
+    if (tk_is_primitive(tk))
+        return 1;
+
+    if (tk->type == TT_CHAR && (tk->char_val == '[' || tk->char_val == '{')) {
+        if (likely(sc_skip_composite(scaner)))
+            return 1;
+        set_parser_err(parser, "");
+        return 0;
+    }
+
+    report_value_err(parser, enclosing, tk);
+    return 0;
+}
+
+/* Walk the elements of the hashtab whose '{' is just seen */
+static int
+walk_hashtab(walk_t* walk_st, path_node_t* node) {
+    parser_t* parser = walk_st->parser;
+    scaner_t* scaner = &parser->scaner;
+    const char* json_end = scaner->json_end;
+
+    token_t* tk = sc_get_token(scaner, json_end);
+    if (tk->type == TT_CHAR && tk->char_val == '}')
+        return WALK_OK;
+
+    while (1) {
+        if (unlikely(tk->type != TT_STR)) {
+            report_key_err(parser, tk);
+            return WALK_ERR;
+        }
+
+        /* The first one wins if the key is duplicated */
+        path_node_t* child;
+        for (child = node->child; child; child = child->sibling) {
+            if (child->pending && child->token_len == (uint32_t)tk->str_len &&
+                !memcmp(child->token, tk->str_val, tk->str_len)) {
+                break;
+            }
+        }
+
+        tk = sc_get_token(scaner, json_end);
+        if (unlikely(tk->type != TT_CHAR || tk->char_val != ':')) {
+            set_parser_err(parser, "expect ':'");
+            return WALK_ERR;
+        }
+
+        if (child) {
+            int res = walk(walk_st, child, OT_HASHTAB);
+            if (res != WALK_OK)
+                return res;
+
+            if (!node->pending) {
+                /* Nothing more to look for in this hashtab */
+                if (unlikely(!sc_skip_composite(scaner))) {
+                    set_parser_err(parser, "");
+                    return WALK_ERR;
+                }
+                return WALK_OK;
+            }
+        } else if (unlikely(!skip_value(parser, OT_HASHTAB))) {
+            return WALK_ERR;
+        }
+
+        tk = sc_get_token(scaner, json_end);
+        if (likely(tk->type == TT_CHAR)) {
+            if (tk->char_val == ',') {
+                tk = sc_get_token(scaner, json_end);
+                continue;
+            }
+            if (tk->char_val == '}')
+                return WALK_OK;
+        }
+
+        set_parser_err(parser, "hashtab syntax error");
+        return WALK_ERR;
+    }
+}
+
+/* Walk the elements of the array whose '[' is just seen */
+static int
+walk_array(walk_t* walk_st, path_node_t* node) {
+    parser_t* parser = walk_st->parser;
+    scaner_t* scaner = &parser->scaner;
+    const char* json_end = scaner->json_end;
+
+    token_t* tk = sc_get_token(scaner, json_end);
+    if (tk->type == TT_CHAR && tk->char_val == ']')
+        return WALK_OK;
+
+    if (unlikely(tk->type == TT_END || tk->type == TT_ERR)) {
+        report_value_err(parser, OT_ARRAY, tk);
+        return WALK_ERR;
+    }
+    sc_rewind(scaner);
+
+    uint32_t index;
+    for (index = 0; ; index++) {
+        path_node_t* child;
+        for (child = node->child; child; child = child->sibling) {
+            if (child->pending && child->index == index)
+                break;
+        }
+
+        if (child) {
+            int res = walk(walk_st, child, OT_ARRAY);
+            if (res != WALK_OK)
+                return res;
+
+            if (!node->pending) {
+                /* Nothing more to look for in this array */
+                if (unlikely(!sc_skip_composite(scaner))) {
+                    set_parser_err(parser, "");
+                    return WALK_ERR;
+                }
+                return WALK_OK;
+            }
+        } else if (unlikely(!skip_value(parser, OT_ARRAY))) {
+            return WALK_ERR;
+        }
+
+        tk = sc_get_token(scaner, json_end);
+        if (likely(tk->type == TT_CHAR)) {
+            if (tk->char_val == ',')
+                continue;
+            if (tk->char_val == ']')
+                return WALK_OK;
+        }
+
+        set_parser_err(parser, "Array syntax error, expect ',' or ']'");
+        return WALK_ERR;
+    }
+}
+
+/* Walk the value following the scaner, which is the one of "node" */
+static int
+walk(walk_t* walk_st, path_node_t* node, obj_ty_t enclosing) {
+    parser_t* parser = walk_st->parser;
+    int res = WALK_OK;
+
+    if (node->requested) {
+        if (unlikely(!parse_value(parser, node, enclosing,
+                                  walk_st->zero_copy))) {
+            return WALK_ERR;
+        }
+    } else {
+        scaner_t* scaner = &parser->scaner;
+        token_t* tk = sc_get_token(scaner, scaner->json_end);
+        if (tk->type == TT_CHAR && tk->char_val == '{') {
+            res = walk_hashtab(walk_st, node);
+        } else if (tk->type == TT_CHAR && tk->char_val == '[') {
+            res = walk_array(walk_st, node);
+        } else if (!tk_is_primitive(tk)) {
+            report_value_err(parser, enclosing, tk);
+            res = WALK_ERR;
+        }
+    }
+
+    if (res != WALK_OK)
+        return res;
+
+    finish_node(node);
+    return walk_st->root->pending ? WALK_OK : WALK_DONE;
+}
+
+const jp_tape_t**
+parse_paths(parser_t* parser, const char* const* paths, uint32_t path_num) {
+    mempool_t* mp = parser->mempool;
+    path_node_t root;
+    root.token = 0;
+    root.token_len = 0;
+    root.index = NO_INDEX;
+    root.parent = root.child = root.sibling = 0;
+    root.pending = 0;
+    root.requested = 0;
+    root.entry = NOT_FOUND;
+
+    /* The node of each pointer, and then the value of it */
+    path_node_t** nodes = MEMPOOL_ALLOC_TYPE_N(mp, path_node_t*, path_num + 1);
+    const jp_tape_t** values = MEMPOOL_ALLOC_TYPE_N(mp, const jp_tape_t*,
+                                                    path_num + 1);
+    if (unlikely(!nodes || !values)) {
+        parser->err_msg = "OOM";
+        return 0;
+    }
+
+    uint32_t i;
+    for (i = 0; i < path_num; i++) {
+        nodes[i] = add_path(parser, &root, paths[i]);
+        if (unlikely(!nodes[i]))
+            return 0;
+    }
+
+    /* The keys are compared only, so they need not be copied */
+    scaner_t* scaner = &parser->scaner;
+    walk_t walk_st;
+    walk_st.parser = parser;
+    walk_st.root = &root;
+    walk_st.zero_copy = scaner->zero_copy;
+    scaner->zero_copy = 1;
+
+    tape_start(&parser->tape, 0);
+    int res = root.pending ? walk(&walk_st, &root, OT_ROOT) : WALK_DONE;
+    scaner->zero_copy = walk_st.zero_copy;
+    if (unlikely(res == WALK_ERR))
+        return 0;
+
+    /* The tape is in place now */
+    const jp_tape_t* tape = parser->tape.entries;
+    for (i = 0; i < path_num; i++) {
+        uint32_t entry = nodes[i]->entry;
+        values[i] = entry == NOT_FOUND ? 0 : tape + entry;
+    }
+
+    return values;
+}
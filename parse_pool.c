@@ -0,0 +1,471 @@
+/* ****************************************************************************
+ *
+ *   This file implements jp_pool_parse_many(), which parses a large
+ * newline-delimited json (NDJSON) with a pool of threads.
+ *
+ *   The input is split at newlines into as many slices as threads, each of
+ * which is parsed by jp_parse_many() with a parser of its own, hence no
+ * memory is shared between threads. The calling thread takes the first slice
+ * itself, the threads of the pool take the rest.
+ *
+ *   The threads are created once and for all by jp_pool_create(), and sleep
+ * on a condition variable between calls.
+ *
+ *   jp_pool_parse() parses a single large array likewise: the structural
+ * index of the input tells where the elements of the out-most array are
+ * separated, and the elements are split into slices of similar size at
+ * those places. Each slice is parsed as an array of its own (see
+ * parse_array_slice()), then the arrays are stitched into one (see
+ * stitch_arrays()).
+ *
+ * ****************************************************************************
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "parser.h"
+
+/* Don't bother splitting the input into slices shorter than this */
+#define MIN_SLICE_LEN (64 * 1024)
+
+typedef struct worker_tag worker_t;
+
+struct worker_tag {
+    struct jp_pool* pool;
+    parser_t* parser;
+    pthread_t thread;
+
+    /* The slice of input taken by this worker */
+    const char* json;
+    uint32_t len;
+
+    /* The result of parse_array_slice() over the slice, i.e. the composite
+     * objects in reverse-nesting order, the last one of which is "array".
+     */
+    obj_composite_t* objs;
+    obj_composite_t* array;
+    obj_composite_t* before_array;  /* the one right before "array", if any */
+    obj_t* first_elmt;              /* the last one of array's subobjs */
+    uint32_t id_base;               /* the id of "array" in the whole json */
+};
+
+struct jp_pool {
+    worker_t* workers;
+    uint32_t thread_num;
+
+    /* The task being run by the workers [0, task_num) */
+    void (*task)(worker_t*);
+    uint32_t task_num;
+    uint32_t pending;       /* # of tasks not yet done by the pool threads */
+    uint64_t generation;    /* bumped for each run */
+    int quit;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+
+    uint32_t flags;
+    jp_slice_t* slices;
+    const char* err_msg;
+
+    /* The structural index of the input of jp_pool_parse() */
+    struct_index_t struct_idx;
+};
+
+static void*
+worker_main(void* arg) {
+    worker_t* worker = (worker_t*)arg;
+    struct jp_pool* pool = worker->pool;
+    uint32_t idx = worker - pool->workers;
+    uint64_t generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (1) {
+        while (!pool->quit && pool->generation == generation)
+            pthread_cond_wait(&pool->work_cond, &pool->mutex);
+
+        if (pool->quit)
+            break;
+
+        generation = pool->generation;
+        if (idx >= pool->task_num)
+            continue;
+
+        pthread_mutex_unlock(&pool->mutex);
+        pool->task(worker);
+        pthread_mutex_lock(&pool->mutex);
+
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return 0;
+}
+
+/* Run the task by the first "task_num" workers, and wait for them all. */
+static void
+run_task(struct jp_pool* pool, void (*task)(worker_t*), uint32_t task_num) {
+    ASSERT(task_num >= 1 && task_num <= pool->thread_num);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->task_num = task_num;
+    pool->pending = task_num - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    /* The 1st one is taken by the calling thread */
+    task(pool->workers);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->pending)
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void
+stop_threads(struct jp_pool* pool, uint32_t thread_num) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    uint32_t i;
+    for (i = 1; i < thread_num; i++)
+        pthread_join(pool->workers[i].thread, 0);
+}
+
+/* Free the pool, whose threads are all stopped (or not created at all) */
+static void
+free_pool(struct jp_pool* pool) {
+    if (pool->workers) {
+        uint32_t i;
+        for (i = 0; i < pool->thread_num; i++) {
+            parser_t* parser = pool->workers[i].parser;
+            if (parser)
+                jp_destroy((struct json_parser*)(void*)parser);
+        }
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    si_fini(&pool->struct_idx);
+
+    free(pool->workers);
+    free(pool->slices);
+    free(pool);
+}
+
+struct jp_pool*
+jp_pool_create(uint32_t thread_num) {
+    if (thread_num == 0)
+        thread_num = 1;
+
+    struct jp_pool* pool = (struct jp_pool*)calloc(1, sizeof(struct jp_pool));
+    if (unlikely(!pool))
+        return 0;
+
+    pool->thread_num = thread_num;
+    pool->err_msg = "Out of Memory";
+    si_init(&pool->struct_idx);
+    pthread_mutex_init(&pool->mutex, 0);
+    pthread_cond_init(&pool->work_cond, 0);
+    pthread_cond_init(&pool->done_cond, 0);
+
+    pool->workers = (worker_t*)calloc(thread_num, sizeof(worker_t));
+    pool->slices = (jp_slice_t*)calloc(thread_num, sizeof(jp_slice_t));
+    if (unlikely(!pool->workers || !pool->slices))
+        goto fail;
+
+    uint32_t i;
+    for (i = 0; i < thread_num; i++) {
+        worker_t* worker = pool->workers + i;
+        worker->pool = pool;
+        worker->parser = (parser_t*)(void*)jp_create();
+        if (unlikely(!worker->parser))
+            goto fail;
+    }
+
+    /* The 1st worker is the calling thread */
+    for (i = 1; i < thread_num; i++) {
+        worker_t* worker = pool->workers + i;
+        if (unlikely(pthread_create(&worker->thread, 0, worker_main,
+                                    worker))) {
+            stop_threads(pool, i);
+            goto fail;
+        }
+    }
+
+    return pool;
+
+fail:
+    free_pool(pool);
+    return 0;
+}
+
+void
+jp_pool_destroy(struct jp_pool* pool) {
+    stop_threads(pool, pool->thread_num);
+    free_pool(pool);
+}
+
+static void
+parse_slice(worker_t* worker) {
+    struct jp_pool* pool = worker->pool;
+    jp_slice_t* slice = pool->slices + (worker - pool->workers);
+    slice->json_num = 0;
+    slice->tape = parse_many(worker->parser, worker->json, worker->len,
+                             pool->flags, 1, &slice->json_num);
+}
+
+/* Split the input at newlines into "slice_num" slices of similar size */
+static void
+split_input(struct jp_pool* pool, const char* json, uint32_t len,
+            uint32_t slice_num) {
+    const char* p = json;
+    const char* json_end = json + len;
+
+    uint32_t i;
+    for (i = 0; i < slice_num; i++) {
+        const char* slice_end = json_end;
+        if (i + 1 < slice_num) {
+            const char* target = json + (uint64_t)len * (i + 1) / slice_num;
+            if (target < p)
+                target = p;
+
+            const char* nl = (const char*)memchr(target, '\n',
+                                                 json_end - target);
+            if (nl)
+                slice_end = nl + 1;
+        }
+
+        worker_t* worker = pool->workers + i;
+        worker->json = p;
+        worker->len = slice_end - p;
+        p = slice_end;
+    }
+}
+
+/* Tell the error of the first malformed slice, with the line number relative
+ * to the whole input.
+ */
+static void __attribute__((cold))
+set_pool_err(struct jp_pool* pool, const char* json, uint32_t slice_num) {
+    uint32_t i;
+    for (i = 0; pool->slices[i].tape; i++)
+        ASSERT(i + 1 < slice_num);
+
+    worker_t* worker = pool->workers + i;
+    int32_t line = 1;
+    const char* p = json;
+    const char* nl;
+    while ((nl = (const char*)memchr(p, '\n', worker->json - p))) {
+        line++;
+        p = nl + 1;
+    }
+
+    /* Parse it again, just for the sake of the error location */
+    uint32_t json_num;
+    parse_many(worker->parser, worker->json, worker->len, pool->flags, line,
+               &json_num);
+    pool->err_msg = jp_get_err((struct json_parser*)(void*)worker->parser);
+}
+
+const jp_slice_t*
+jp_pool_parse_many(struct jp_pool* pool, const char* json, uint32_t len,
+                   uint32_t flags, uint32_t* slice_num) {
+    uint32_t num = len / MIN_SLICE_LEN;
+    if (num > pool->thread_num)
+        num = pool->thread_num;
+    if (num == 0)
+        num = 1;
+
+    pool->flags = flags & ~JP_INTERN_KEYS;
+    split_input(pool, json, len, num);
+    run_task(pool, parse_slice, num);
+
+    uint32_t i;
+    for (i = 0; i < num; i++) {
+        if (unlikely(!pool->slices[i].tape)) {
+            set_pool_err(pool, json, num);
+            return 0;
+        }
+    }
+
+    *slice_num = num;
+    return pool->slices;
+}
+
+const char*
+jp_pool_get_err(struct jp_pool* pool) {
+    return pool->err_msg;
+}
+
+/* Split the elements of the out-most array into up to "slice_num" slices of
+ * similar size, each of which is followed by the ',' or ']' (for the last
+ * one) right after it. Return the # of slices, or 0 if the input is not
+ * an array. The input may well be malformed, which is told by parsing the
+ * slices.
+ */
+static uint32_t
+split_array(struct jp_pool* pool, const char* json, uint32_t len,
+            uint32_t slice_num) {
+    struct_index_t* si = &pool->struct_idx;
+    if (unlikely(!si_build(si, json, len)))
+        return 0;
+
+    const uint32_t* pos = si->pos;
+    uint32_t pos_num = si->pos_num - 1; /* excluding the terminating one */
+    if (pos_num == 0 || json[pos[0]] != '[')
+        return 0;
+
+    uint32_t num = 0;
+    uint32_t start = pos[0] + 1;
+    uint64_t target = (uint64_t)len / slice_num;
+    int depth = 0;
+
+    uint32_t i;
+    for (i = 0; i < pos_num && num + 1 < slice_num; i++) {
+        char c = json[pos[i]];
+        if (c == '[' || c == '{') {
+            depth++;
+        } else if (c == ']' || c == '}') {
+            if (--depth == 0)
+                break;
+        } else if (c == ',' && depth == 1 && pos[i] >= target) {
+            worker_t* worker = pool->workers + num++;
+            worker->json = json + start;
+            worker->len = pos[i] + 1 - start;
+            start = pos[i] + 1;
+            target = (uint64_t)len * (num + 1) / slice_num;
+        }
+    }
+
+    /* The last slice runs up to the end of input */
+    worker_t* worker = pool->workers + num++;
+    worker->json = json + start;
+    worker->len = len - start;
+    return num;
+}
+
+static void
+parse_array_elmts(worker_t* worker) {
+    struct jp_pool* pool = worker->pool;
+    int last = (worker - pool->workers) + 1 == pool->task_num;
+    worker->objs = (obj_composite_t*)(void*)
+        parse_array_slice(worker->parser, worker->json, worker->len,
+                          pool->flags, last);
+    if (worker->objs) {
+        obj_t* array = worker->parser->parse_stack.obj.subobjs;
+        worker->array = (obj_composite_t*)(void*)array;
+    }
+}
+
+/* Renumber the composite objects of the slice such that the ids are in the
+ * whole json, and find where to stitch the slice to the others.
+ */
+static void
+renumber_slice(worker_t* worker) {
+    if (worker == worker->pool->workers) {
+        /* The 1st slice is in place */
+        return;
+    }
+
+    uint32_t delta = worker->id_base - 1;
+    obj_composite_t* cobj = worker->objs;
+    obj_composite_t* prev = 0;
+    for (; cobj != worker->array; cobj = cobj->reverse_nesting_order) {
+        cobj->id += delta;
+        prev = cobj;
+    }
+    worker->before_array = prev;
+
+    obj_t* elmt = worker->array->subobjs;
+    while (elmt->next)
+        elmt = elmt->next;
+    worker->first_elmt = elmt;
+}
+
+/* Stitch the arrays of the slices into the one of the 1st slice. Recall
+ * that the composite objects are linked in reverse-nesting order, with the
+ * out-most one at the end, and so are the elements of an array, hence the
+ * slices are chained from the last to the 1st.
+ */
+static obj_t*
+stitch_arrays(struct jp_pool* pool, uint32_t slice_num) {
+    worker_t* workers = pool->workers;
+    obj_composite_t* array = workers[0].array;
+
+    uint32_t i;
+    uint32_t id_base = 1;
+    for (i = 0; i < slice_num; i++) {
+        worker_t* worker = workers + i;
+        /* None but the 1st slice can be empty, e.g. the last of "[1, ]" */
+        if (i && !worker->array->common.elmt_num)
+            return 0;
+        worker->id_base = id_base;
+        id_base += worker->objs->id - 1;
+    }
+
+    run_task(pool, renumber_slice, slice_num);
+
+    obj_t* elmts = array->subobjs;
+    obj_composite_t* objs = workers[0].objs;
+    for (i = 1; i < slice_num; i++) {
+        worker_t* worker = workers + i;
+        worker->first_elmt->next = elmts;
+        elmts = worker->array->subobjs;
+        array->common.elmt_num += worker->array->common.elmt_num;
+
+        if (worker->before_array) {
+            worker->before_array->reverse_nesting_order = objs;
+            objs = worker->objs;
+        }
+    }
+    array->subobjs = elmts;
+
+    return &objs->common;
+}
+
+obj_t*
+jp_pool_parse(struct jp_pool* pool, const char* json, uint32_t len,
+              uint32_t flags) {
+    struct json_parser* jp = (struct json_parser*)(void*)pool->workers->parser;
+
+    uint32_t slice_num = len / MIN_SLICE_LEN;
+    if (slice_num > pool->thread_num)
+        slice_num = pool->thread_num;
+
+    if (slice_num > 1)
+        slice_num = split_array(pool, json, len, slice_num);
+
+    flags &= ~JP_INTERN_KEYS;
+    if (slice_num > 1) {
+        pool->flags = flags;
+        run_task(pool, parse_array_elmts, slice_num);
+
+        uint32_t i;
+        for (i = 0; i < slice_num; i++) {
+            if (!pool->workers[i].objs)
+                break;
+        }
+
+        if (i == slice_num) {
+            obj_t* obj = stitch_arrays(pool, slice_num);
+            if (obj)
+                return obj;
+        }
+    }
+
+    /* Parse it as a whole if it's not worth splitting, or just for the sake
+     * of the error message.
+     */
+    obj_t* obj = jp_parse_ex(jp, json, len, flags);
+    if (unlikely(!obj))
+        pool->err_msg = jp_get_err(jp);
+    return obj;
+}
@@ -0,0 +1,132 @@
+/* ****************************************************************************
+ *
+ *   This file implements the buffering of jp_feed()/jp_finish(), which
+ * parse the json piece by piece into the tape (see parse_tape.c).
+ *
+ *   Each piece is parsed as far as possible with the scaner in partial mode,
+ * in which a token cut short by the end of the piece is left alone. That
+ * token, and only that token, is copied aside and concatenated with the
+ * next piece. As the strings are copied to the mempool by the scaner, the
+ * caller is free to discard a piece once it is fed.
+ *
+ *   A token may be longer than many pieces (think of a long string), to
+ * avoid rescanning it over and over again, the concatenation is not parsed
+ * until it is twice as long as the leftover.
+ *
+ * ****************************************************************************
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "parser.h"
+
+void
+stream_init(stream_t* stream) {
+    stream->buf = 0;
+    stream->len = 0;
+    stream->capacity = 0;
+    stream->retry_len = 0;
+    stream->line_num = 1;
+    stream->col_num = 1;
+    stream->end_line_num = 1;
+    stream->end_col_num = 1;
+    stream->state = STREAM_IDLE;
+}
+
+void
+stream_fini(stream_t* stream) {
+    free(stream->buf);
+    stream_init(stream);
+}
+
+/* Append the given input to the buffer, return 0 on OOM. */
+static int
+stream_append(stream_t* stream, const char* data, uint32_t len) {
+    if (!len)
+        return 1;
+
+    uint64_t min_cap = (uint64_t)stream->len + len;
+    if (unlikely(min_cap > stream->capacity)) {
+        uint64_t cap = stream->capacity ? stream->capacity : 256;
+        while (cap < min_cap)
+            cap *= 2;
+
+        if (unlikely(cap > UINT32_MAX))
+            return 0;
+
+        char* buf = (char*)realloc(stream->buf, cap);
+        if (unlikely(!buf))
+            return 0;
+
+        stream->buf = buf;
+        stream->capacity = cap;
+    }
+
+    memcpy(stream->buf + stream->len, data, len);
+    stream->len += len;
+    return 1;
+}
+
+int
+stream_feed(parser_t* parser, const char* data, uint32_t len, int last) {
+    stream_t* stream = &parser->stream;
+
+    if (!len && !last)
+        return TP_MORE;
+
+    /* step 1: Concatenate the input with the leftover of the last piece */
+    if (stream->len) {
+        if (unlikely(!stream_append(stream, data, len)))
+            goto oom;
+
+        if (!last && stream->len < stream->retry_len)
+            return TP_MORE;
+
+        data = stream->buf;
+        len = stream->len;
+    }
+
+    /* step 2: Parse as far as possible */
+    scaner_t* scaner = &parser->scaner;
+    sc_init_scaner(scaner, parser->mempool, data, len);
+    scaner->partial = !last;
+    scaner->line_num = stream->line_num;
+    scaner->col_num = stream->col_num;
+    scaner->end_line_num = stream->end_line_num;
+    scaner->end_col_num = stream->end_col_num;
+    if (!len) {
+        /* Nothing is left but the whitespaces, if any, of the last pieces.
+         * Locate the end of the json ahead of them like jp_parse_tape().
+         */
+        scaner->line_num = stream->end_line_num;
+        scaner->col_num = stream->end_col_num;
+    }
+
+    int ret = tape_resume(parser);
+    if (ret != TP_MORE)
+        return ret;
+
+    /* step 3: Keep the leftover for the next piece */
+    uint32_t consumed = scaner->scan_ptr - data;
+    uint32_t left = len - consumed;
+
+    stream->line_num = scaner->line_num;
+    stream->col_num = scaner->col_num;
+    stream->end_line_num = scaner->end_line_num;
+    stream->end_col_num = scaner->end_col_num;
+    if (data == stream->buf) {
+        memmove(stream->buf, data + consumed, left);
+        stream->len = left;
+    } else {
+        stream->len = 0;
+        if (unlikely(!stream_append(stream, data + consumed, left)))
+            goto oom;
+    }
+
+    stream->retry_len = left < UINT32_MAX / 2 ? left * 2 : UINT32_MAX;
+    return TP_MORE;
+
+oom:
+    parser->err_msg = "OOM";
+    return TP_ERR;
+}
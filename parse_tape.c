@@ -0,0 +1,453 @@
+/* ****************************************************************************
+ *
+ *   This file implements jp_parse_tape(), which drives the same scaner as
+ * the parser does, but emits the objects to a flat tape (see jp_tape_t)
+ * instead of linked lists.
+ *
+ *   The objects are appended to the tape in the order they appear in the
+ * json. The array/hashtab entry is appended when its starting delimiter is
+ * seen; its element count is bumped as the elements are appended, and its
+ * "skip" field is filled once its closing delimiter is seen. Until then,
+ * the "skip" field keeps the index of the immediate nesting composite
+ * object (if any) which is still open, so the open composite objects are
+ * chained up on the tape itself, and no parse-stack is needed.
+ *
+ *   The state of the parsing is therefore just the innermost open composite
+ * object along with what token is expected next (see tape_state_t), which
+ * is saved in tape_t when the parsing is suspended for more input (see
+ * jp_feed()).
+ *
+ * ****************************************************************************
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "parser.h"
+#include "key_cache.h"
+
+void
+tape_init(tape_t* tape) {
+    tape->entries = 0;
+    tape->entry_num = 0;
+    tape->capacity = 0;
+}
+
+void
+tape_fini(tape_t* tape) {
+    free(tape->entries);
+    tape_init(tape);
+}
+
+int
+tape_reserve(tape_t* tape, uint32_t entry_num) {
+    if (likely(tape->capacity >= entry_num))
+        return 1;
+
+    uint64_t cap = tape->capacity ? tape->capacity : 256;
+    while (cap < entry_num)
+        cap *= 2;
+
+    if (unlikely(cap > UINT32_MAX))
+        return 0;
+
+    jp_tape_t* entries = (jp_tape_t*)realloc(tape->entries,
+                                             sizeof(jp_tape_t) * cap);
+    if (unlikely(!entries))
+        return 0;
+
+    tape->entries = entries;
+    tape->capacity = cap;
+    return 1;
+}
+
+/* Append an entry as an element of the given composite object, return NULL
+ * on OOM.
+ */
+static inline jp_tape_t*
+append_entry(tape_t* tape, uint32_t parent) {
+    uint32_t idx = tape->entry_num;
+    if (unlikely(idx == tape->capacity) && !tape_reserve(tape, idx + 1))
+        return 0;
+
+    if (parent != NO_PARENT)
+        tape->entries[parent].elmt_num++;
+
+    tape->entry_num = idx + 1;
+    return tape->entries + idx;
+}
+
+static inline int
+append_primitive_tk(tape_t* tape, uint32_t parent, const token_t* tk) {
+    ASSERT(tk_is_primitive(tk));
+    jp_tape_t* entry = append_entry(tape, parent);
+    if (unlikely(!entry))
+        return 0;
+
+    entry->obj_ty = tk->type;
+    entry->flags = tk->type == TT_STR ? tk->str_flags : 0;
+    entry->str_len = tk->str_len;
+    entry->int_val = tk->int_val;
+    return 1;
+}
+
+/* Skip the array/hashtab whose opening delimiter is just seen, and append
+ * its raw text as a string, see jp_parse_shallow().
+ */
+static int __attribute__((noinline))
+append_raw(parser_t* parser, uint32_t parent) {
+    scaner_t* scaner = &parser->scaner;
+    const char* start = scaner->scan_ptr - 1;
+    if (unlikely(!sc_skip_composite(scaner))) {
+        set_parser_err(parser, "");
+        return 0;
+    }
+
+    jp_tape_t* entry = append_entry(&parser->tape, parent);
+    if (unlikely(!entry)) {
+        parser->err_msg = "OOM";
+        return 0;
+    }
+
+    entry->obj_ty = OT_STR;
+    entry->flags = OF_RAW | OF_BORROWED;
+    entry->str_len = scaner->scan_ptr - start;
+    entry->str_val = (char*)start;
+    return 1;
+}
+
+/* Close the given composite object, return its parent. */
+static inline uint32_t
+close_composite(tape_t* tape, uint32_t cobj) {
+    jp_tape_t* entry = tape->entries + cobj;
+    uint32_t parent = entry->skip;
+    entry->skip = tape->entry_num - cobj;
+    return parent;
+}
+
+void __attribute__((cold))
+report_value_err(parser_t* parser, obj_ty_t nesting, token_t* tk) {
+    if (nesting == OT_ROOT) {
+        if (tk->type == TT_END) {
+            parser->err_msg = "Input json is empty";
+        } else if (tk->type == TT_CHAR) {
+            set_parser_err_fmt(parser, "Unknow object starting with '%c'",
+                               tk->char_val);
+        } else {
+            set_parser_err(parser, "Extraneous stuff");
+        }
+    } else if (nesting == OT_ARRAY) {
+        set_parser_err(parser, "Array syntax error, expect ',' or ']'");
+    } else {
+        set_parser_err(parser, "value object syntax error");
+    }
+}
+
+void __attribute__((cold))
+report_key_err(parser_t* parser, token_t* tk) {
+    if (tk->type == TT_CHAR && tk->char_val == '}') {
+        set_parser_err(parser, "hashtab syntax error");
+        return;
+    }
+
+    /* In case of TT_ERR, the scaner's error message is taken */
+    if (tk->type != TT_ERR)
+        sc_rewind(&parser->scaner);
+    set_parser_err(parser, "Key must be a string");
+}
+
+void
+tape_start(tape_t* tape, int many) {
+    tape->entry_num = 0;
+    tape->parent = NO_PARENT;
+    tape->state = TS_VALUE;
+    tape->many = many;
+    tape->enclosing = OT_ROOT;
+    tape->shallow = 0;
+}
+
+/* The state once a value is done */
+#define VALUE_DONE(parent) ((parent) == NO_PARENT ? TS_END : TS_NEXT)
+
+int
+tape_resume(parser_t* parser) {
+    scaner_t* scaner = &parser->scaner;
+    const char* json_end = scaner->json_end;
+    tape_t* tape = &parser->tape;
+    uint32_t parent = tape->parent;
+    tape_state_t state = tape->state;
+
+    while (1) {
+        token_t* tk = sc_get_token(scaner, json_end);
+        if (unlikely(tk->type == TT_END) && scaner->partial) {
+            /* Wait for more input, see jp_feed() */
+            tape->parent = parent;
+            tape->state = state;
+            return TP_MORE;
+        }
+
+        switch (state) {
+        case TS_FIRST_ELMT:
+            if (tk->type == TT_CHAR && tk->char_val == ']') {
+                parent = close_composite(tape, parent);
+                state = VALUE_DONE(parent);
+                continue;
+            }
+            /* fall through */
+
+        case TS_VALUE:
+        value:
+            if (tk_is_primitive(tk)) {
+                if (unlikely(!append_primitive_tk(tape, parent, tk)))
+                    goto oom;
+                state = VALUE_DONE(parent);
+                continue;
+            }
+
+            if (tk->type == TT_CHAR &&
+                (tk->char_val == '[' || tk->char_val == '{')) {
+                if (unlikely(tape->shallow) && parent != NO_PARENT) {
+                    if (unlikely(!append_raw(parser, parent)))
+                        return TP_ERR;
+                    state = TS_NEXT;
+                    continue;
+                }
+
+                int is_array = (tk->char_val == '[');
+                uint32_t cobj = tape->entry_num;
+                jp_tape_t* entry = append_entry(tape, parent);
+                if (unlikely(!entry))
+                    goto oom;
+
+                entry->obj_ty = is_array ? OT_ARRAY : OT_HASHTAB;
+                entry->flags = 0;
+                entry->elmt_num = 0;
+                entry->skip = parent;
+                entry->key_index = 0;
+                parent = cobj;
+                state = is_array ? TS_FIRST_ELMT : TS_FIRST_KEY;
+                continue;
+            }
+
+            if (tk->type == TT_END && tape->many && parent == NO_PARENT) {
+                /* i.e. the input is empty */
+                return TP_DONE;
+            }
+
+            report_value_err(parser, parent == NO_PARENT ? tape->enclosing :
+                             tape->entries[parent].obj_ty, tk);
+            return TP_ERR;
+
+        case TS_FIRST_KEY:
+            if (tk->type == TT_CHAR && tk->char_val == '}') {
+                parent = close_composite(tape, parent);
+                state = VALUE_DONE(parent);
+                continue;
+            }
+            /* fall through */
+
+        case TS_KEY:
+            if (likely(tk->type == TT_STR)) {
+                if (unlikely(!append_primitive_tk(tape, parent, tk)))
+                    goto oom;
+
+                jp_tape_t* key = tape->entries + tape->entry_num - 1;
+                key->flags = intern_key(parser, tk->str_val, tk->str_len,
+                                        key->flags);
+                state = TS_COLON;
+                continue;
+            }
+
+            report_key_err(parser, tk);
+            return TP_ERR;
+
+        case TS_COLON:
+            if (likely(tk->type == TT_CHAR && tk->char_val == ':')) {
+                state = TS_VALUE;
+                continue;
+            }
+
+            set_parser_err(parser, "expect ':'");
+            return TP_ERR;
+
+        case TS_NEXT:
+            {
+                int is_array = (tape->entries[parent].obj_ty == OT_ARRAY);
+                if (likely(tk->type == TT_CHAR)) {
+                    char c = tk->char_val;
+                    if (c == ',') {
+                        state = is_array ? TS_VALUE : TS_KEY;
+                        continue;
+                    }
+
+                    if (c == (is_array ? ']' : '}')) {
+                        parent = close_composite(tape, parent);
+                        state = VALUE_DONE(parent);
+                        continue;
+                    }
+                }
+
+                set_parser_err(parser, is_array ?
+                               "Array syntax error, expect ',' or ']'" :
+                               "hashtab syntax error");
+                return TP_ERR;
+            }
+
+        default:
+            ASSERT(state == TS_END);
+            if (tk->type == TT_END)
+                return TP_DONE;
+
+            if (tape->enclosing != OT_ROOT && tk->type != TT_ERR) {
+                /* The rest is up to the caller */
+                sc_rewind(scaner);
+                return TP_DONE;
+            }
+
+            if (tape->many) {
+                /* The next json starts */
+                state = TS_VALUE;
+                goto value;
+            }
+
+            set_parser_err(parser, "Extraneous stuff");
+            return TP_ERR;
+        }
+    }
+
+oom:
+    parser->err_msg = "OOM";
+    return TP_ERR;
+}
+
+jp_tape_t*
+parse_tape(parser_t* parser, int many) {
+    tape_start(&parser->tape, many);
+    if (tape_resume(parser) != TP_DONE)
+        return 0;
+
+    return parser->tape.entries;
+}
+
+/* # of entries the value at the given entry takes along with its elements */
+static inline uint32_t
+entry_width(const jp_tape_t* entry) {
+    return entry->obj_ty <= OT_LAST_PRIMITIVE ? 1 : entry->skip;
+}
+
+/* The hashtabs with fewer keys are not indexed: walking the keys is fast
+ * enough.
+ */
+#define KEY_INDEX_MIN 16
+
+/* The index of a hashtab is laid on the tape after the entries of the
+ * json(s): a power-of-two # of slots followed by the slots, all uint32_t.
+ * A slot is empty (0), or tells how many entries the key is away from the
+ * hashtab. It's probed linearly from the slot of the key's hash (see
+ * key_hash()).
+ */
+
+/* Build the index of the hashtab of the given entry at the entry "end",
+ * return the # of entries the index takes, or 0 on OOM.
+ */
+static uint32_t
+index_keys(tape_t* tape, uint32_t cobj, uint32_t end) {
+    uint32_t key_num = tape->entries[cobj].elmt_num / 2;
+    uint32_t cap = 16;
+    while (cap < key_num * 2)
+        cap *= 2;
+
+    uint32_t width = (cap + 1 + 3) / 4;
+    if (unlikely(!tape_reserve(tape, end + width)))
+        return 0;
+
+    const jp_tape_t* hashtab = tape->entries + cobj;
+    uint32_t* slots = (uint32_t*)(void*)(tape->entries + end);
+    memset(slots, 0, sizeof(jp_tape_t) * width);
+    slots[0] = cap;
+    slots++;
+
+    uint32_t i, key = 1;
+    for (i = 0; i < key_num; i++) {
+        const jp_tape_t* entry = hashtab + key;
+        uint32_t s = key_hash(entry->str_val, entry->str_len);
+        while (slots[s & (cap - 1)])
+            s++;
+        slots[s & (cap - 1)] = key;
+        key += 1 + entry_width(entry + 1);
+    }
+
+    tape->entries[cobj].key_index = end - cobj;
+    return width;
+}
+
+int
+tape_index_keys(tape_t* tape) {
+    uint32_t i, end = tape->entry_num;
+    for (i = 0; i < tape->entry_num; i++) {
+        const jp_tape_t* entry = tape->entries + i;
+        if (entry->obj_ty != OT_HASHTAB || entry->elmt_num < KEY_INDEX_MIN * 2)
+            continue;
+
+        uint32_t width = index_keys(tape, i, end);
+        if (unlikely(!width))
+            return 0;
+        end += width;
+    }
+    return 1;
+}
+
+static const jp_tape_t*
+lookup_index(const jp_tape_t* hashtab, const char* key, uint32_t key_len) {
+    const uint32_t* slots = (const uint32_t*)(const void*)
+                            (hashtab + hashtab->key_index);
+    uint32_t mask = slots[0] - 1;
+    slots++;
+
+    uint32_t s;
+    for (s = key_hash(key, key_len); slots[s & mask]; s++) {
+        const jp_tape_t* entry = hashtab + slots[s & mask];
+        if ((uint32_t)entry->str_len == key_len &&
+            !memcmp(entry->str_val, key, key_len)) {
+            return entry + 1;
+        }
+    }
+    return 0;
+}
+
+const jp_tape_t*
+jp_hashtab_get(const jp_tape_t* hashtab, const char* key, uint32_t key_len) {
+    if (unlikely(hashtab->obj_ty != OT_HASHTAB))
+        return 0;
+
+    if (hashtab->key_index)
+        return lookup_index(hashtab, key, key_len);
+
+    const jp_tape_t* entry = hashtab + 1;
+    int32_t i, elmt_num = hashtab->elmt_num;
+    for (i = 0; i < elmt_num; i += 2) {
+        if ((uint32_t)entry->str_len == key_len &&
+            !memcmp(entry->str_val, key, key_len)) {
+            return entry + 1;
+        }
+        entry += 1 + entry_width(entry + 1);
+    }
+
+    return 0;
+}
+
+const jp_tape_t*
+jp_array_get(const jp_tape_t* array, uint32_t idx) {
+    if (unlikely(array->obj_ty != OT_ARRAY || idx >= (uint32_t)array->elmt_num))
+        return 0;
+
+    /* No element is array/hashtab: each takes a single entry */
+    if (array->skip == (uint32_t)array->elmt_num + 1)
+        return array + 1 + idx;
+
+    const jp_tape_t* entry = array + 1;
+    uint32_t i;
+    for (i = 0; i < idx; i++)
+        entry += entry_width(entry);
+
+    return entry;
+}
@@ -72,6 +72,7 @@ static inline void
 init_obj(obj_t* obj, obj_ty_t ty) {
     obj->next = 0;
     obj->obj_ty = ty;
+    obj->flags = 0;
     obj->elmt_num = 0;
 }
 
@@ -159,6 +160,7 @@ cvt_primitive_tk(mempool_t* mp, token_t* tk) {
             ((int)TT_NULL == (int)OT_NULL)));
 
     obj->common.obj_ty = tk->type;
+    obj->common.flags = tk->type == TT_STR ? tk->str_flags : 0;
     obj->common.str_len = tk->str_len;
     obj->int_val = tk->int_val;
 
@@ -190,6 +192,30 @@ emit_primitive_tk(mempool_t* mp, token_t* tk,
  *
  ***************************************************************************
  */
+
+/* Parse the composite object being on the top of the parse-stack, along
+ * with the objects nested in it, return 0 on error.
+ */
+static int
+parse_composite(parser_t* parser) {
+    while (1) {
+        composite_state_t* top = pstack_top(parser);
+        obj_ty_t ot = top->obj.common.obj_ty;
+        int succ;
+        if (ot == OT_HASHTAB) {
+            succ = parse_hashtab(parser);
+        } else if (ot == OT_ARRAY) {
+            succ = parse_array(parser);
+        } else {
+            ASSERT(ot == OT_ROOT);
+            return 1;
+        }
+
+        if (unlikely(!succ))
+            return 0;
+    }
+}
+
 obj_t*
 parse(parser_t* parser, const char* json,  uint32_t json_len) {
     scaner_t* scaner = &parser->scaner;
@@ -214,20 +240,7 @@ parse(parser_t* parser, const char* json,  uint32_t json_len) {
             return 0;
         }
 
-        while (succ) {
-            composite_state_t* top = pstack_top(parser);
-            obj_ty_t ot = top->obj.common.obj_ty;
-            if (ot == OT_HASHTAB) {
-                succ = parse_hashtab(parser);
-            } else if (ot == OT_ARRAY) {
-                succ = parse_array(parser);
-            } else {
-                ASSERT(ot == OT_ROOT);
-                break;
-            }
-        }
-
-        if (unlikely(!succ))
+        if (unlikely(!succ || !parse_composite(parser)))
             return 0;
 
         token_t* end_tk = sc_get_token(scaner, json_end);
@@ -260,17 +273,56 @@ trailing_junk:
     return 0;
 }
 
+/* The memory taken by the resulting objects is typically 1-5 times as large
+ * as the input json; this ratio is used to size the first chunk of mempool.
+ * With the tape, the mempool takes the strings only, which are no larger
+ * than the input.
+ */
+#define MEM_HINT_RATIO 2
+
+#define DEFAULT_PREALLOC_RATIO 4
+
+/* Return the size of memory to be preallocated for JP_PREALLOC. Given the
+ * bound on the # of tokens, each token takes at most one composite_state_t,
+ * and the strings take no more than the input plus alignment, which makes an
+ * upper bound. The tape (if "tape" is non-zero) is not carved from the mempool,
+ * which then takes the strings only.
+ */
+static int
+prealloc_size(parser_t* parser, uint32_t json_len, uint32_t flags, int tape) {
+    uint64_t size;
+    if (parser->token_bound) {
+        uint64_t tk_num = parser->token_bound;
+        uint64_t obj_size = tape ? 0 : sizeof(composite_state_t);
+        size = tk_num * (obj_size + DEFAULT_ALIGN) + json_len + 64;
+    } else if (tape) {
+        size = (uint64_t)json_len + 64;
+    } else {
+        size = (uint64_t)json_len * parser->prealloc_ratio;
+    }
+
+    /* Keep it within the range of mempool */
+    return size < (1U << 30) ? (int)size : (1 << 30);
+}
+
 static void
-reset_parser(parser_t* parser, const char* json, uint32_t json_len) {
+reset_parser(parser_t* parser, const char* json, uint32_t json_len,
+             int tape) {
     mempool_t* mp = parser->mempool;
     mp_free_all(mp);
 
+    uint64_t hint = (uint64_t)json_len * (tape ? 1 : MEM_HINT_RATIO);
+    mp_set_size_hint(mp, hint < UINT32_MAX ? hint : UINT32_MAX);
+    parser->tape.entry_num = 0;
+    parser->stream.state = STREAM_IDLE;
+
     pstack_init(parser);
     sc_init_scaner(&parser->scaner, mp, json, json_len);
     parser->result = 0;
 
     parser->err_msg = 0;
     parser->next_cobj_id = 1;
+    parser->intern_keys = 0;
 }
 
 /****************************************************************************
@@ -292,6 +344,14 @@ jp_create(void) {
     p->mempool = mp;
     p->result = 0;
     p->err_msg = "Out of Memory"; /* default error message :-)*/
+    p->prealloc_ratio = DEFAULT_PREALLOC_RATIO;
+    p->array_slice = 0;
+    p->nesting = 0;
+    p->nesting_cap = 0;
+    kc_init(&p->key_cache);
+    tape_init(&p->tape);
+    stream_init(&p->stream);
+    flat_init(&p->flat);
 
     pstack_init(p);
     return (struct json_parser*)(void*)p;
@@ -299,17 +359,296 @@ jp_create(void) {
 
 obj_t*
 jp_parse(struct json_parser* jp, const char* json, uint32_t len) {
+    return jp_parse_ex(jp, json, len, 0);
+}
+
+/* Get ready for parsing as per the given flags, return 0 on OOM. */
+static int
+prepare_parsing(parser_t* parser, const char* json, uint32_t len,
+                uint32_t flags, int tape) {
+    reset_parser(parser, json, len, tape);
+    parser->scaner.zero_copy = flags & JP_ZERO_COPY;
+    parser->intern_keys = flags & JP_INTERN_KEYS;
+
+    /* The bound is of use to size the tape, or the memory to preallocate */
+    parser->token_bound = 0;
+    if ((flags & JP_STRUCT_INDEX) && (tape || (flags & JP_PREALLOC)))
+        parser->token_bound = si_count(json, len);
+
+    if (flags & JP_PREALLOC) {
+        int size = prealloc_size(parser, len, flags, tape);
+        if (unlikely(!mp_prealloc(parser->mempool, size))) {
+            parser->err_msg = "OOM";
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+obj_t*
+jp_parse_ex(struct json_parser* jp, const char* json, uint32_t len,
+            uint32_t flags) {
     parser_t* parser = (parser_t*)(void*)jp;
-    reset_parser(parser, json, len);
+    if (unlikely(!prepare_parsing(parser, json, len, flags, 0)))
+        return 0;
 
     obj_t* obj = parse(parser, json,  len);
     ASSERT(verfiy_reverse_nesting_order(obj));
     return obj;
 }
 
+obj_t*
+parse_array_slice(parser_t* parser, const char* json, uint32_t len,
+                  uint32_t flags, int last) {
+    if (unlikely(!prepare_parsing(parser, json, len, flags, 0)))
+        return 0;
+
+    /* The last slice must be closed by ']' like any array */
+    parser->array_slice = !last;
+    int succ = start_parsing_array(parser) && parse_composite(parser);
+    parser->array_slice = 0;
+    if (unlikely(!succ))
+        return 0;
+
+    scaner_t* scaner = &parser->scaner;
+    if (unlikely(sc_get_token(scaner, scaner->json_end)->type != TT_END)) {
+        set_parser_err(parser, "Extraneous stuff");
+        return 0;
+    }
+
+    ASSERT(verfiy_reverse_nesting_order(parser->result));
+    return parser->result;
+}
+
+/* The tape takes roughly one entry for every 8 bytes of the input json */
+#define TAPE_HINT_RATIO 8
+
+/* Parse the input into the tape, which is a sequence of jsons if "many"
+ * is non-zero, and starts at the given line.
+ */
+static jp_tape_t*
+parse_to_tape(parser_t* parser, const char* json, uint32_t len,
+              uint32_t flags, int many, int32_t first_line) {
+    if (unlikely(!prepare_parsing(parser, json, len, flags, 1)))
+        return 0;
+
+    parser->scaner.line_num = first_line;
+
+    /* Each token takes at most one entry, so the bound on the # of tokens
+     * is that of the tape.
+     */
+    uint32_t entry_num = parser->token_bound ? parser->token_bound :
+                         len / TAPE_HINT_RATIO + 1;
+    if (unlikely(!tape_reserve(&parser->tape, entry_num))) {
+        parser->err_msg = "OOM";
+        return 0;
+    }
+
+    jp_tape_t* tape = parse_tape(parser, many);
+    if (tape && (flags & JP_KEY_INDEX)) {
+        if (unlikely(!tape_index_keys(&parser->tape))) {
+            parser->err_msg = "OOM";
+            return 0;
+        }
+        tape = parser->tape.entries;
+    }
+    return tape;
+}
+
+const jp_tape_t*
+jp_parse_tape(struct json_parser* jp, const char* json, uint32_t len,
+              uint32_t flags) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    return parse_to_tape(parser, json, len, flags, 0, 1);
+}
+
+const jp_flat_t*
+jp_parse_flat(struct json_parser* jp, const char* json, uint32_t len,
+              uint32_t flags) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    jp_tape_t* tape = parse_to_tape(parser, json, len, flags, 0, 1);
+    if (unlikely(!tape))
+        return 0;
+
+    const jp_flat_t* flat = flatten_tape(&parser->flat, tape,
+                                         parser->tape.entry_num);
+    if (unlikely(!flat))
+        parser->err_msg = "OOM";
+    return flat;
+}
+
+jp_tape_t*
+parse_many(parser_t* parser, const char* json, uint32_t len, uint32_t flags,
+           int32_t first_line, uint32_t* json_num) {
+    jp_tape_t* tape = parse_to_tape(parser, json, len, flags, 1, first_line);
+    if (unlikely(!tape))
+        return 0;
+
+    /* The jsons are laid one after another */
+    uint32_t num = 0;
+    uint32_t idx, entry_num = parser->tape.entry_num;
+    for (idx = 0; idx < entry_num; num++) {
+        jp_tape_t* entry = tape + idx;
+        idx += entry->obj_ty <= OT_LAST_PRIMITIVE ? 1 : entry->skip;
+    }
+
+    *json_num = num;
+    return tape;
+}
+
+const jp_tape_t*
+jp_parse_many(struct json_parser* jp, const char* json, uint32_t len,
+              uint32_t flags, uint32_t* json_num) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    return parse_many(parser, json, len, flags, 1, json_num);
+}
+
+const jp_tape_t*
+jp_parse_shallow(struct json_parser* jp, const char* json, uint32_t len,
+                 uint32_t flags) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    if (unlikely(!prepare_parsing(parser, json, len, flags & JP_ZERO_COPY,
+                                  1))) {
+        return 0;
+    }
+
+    tape_t* tape = &parser->tape;
+    tape_start(tape, 0);
+    tape->shallow = 1;
+    if (tape_resume(parser) != TP_DONE)
+        return 0;
+
+    return tape->entries;
+}
+
+uint32_t
+jp_skip_value(const char* json, uint32_t len) {
+    const char* end = sc_skip_value(json, json + len);
+    return end ? end - json : 0;
+}
+
+const jp_tape_t* const*
+jp_parse_paths(struct json_parser* jp, const char* json, uint32_t len,
+               uint32_t flags, const char* const* paths, uint32_t path_num) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    if (unlikely(!prepare_parsing(parser, json, len, flags & JP_ZERO_COPY,
+                                  1))) {
+        return 0;
+    }
+
+    /* Most of the input is skipped */
+    mp_set_size_hint(parser->mempool, 0);
+    return parse_paths(parser, paths, path_num);
+}
+
+int
+jp_validate(struct json_parser* jp, const char* json, uint32_t len,
+            uint32_t flags) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    if (unlikely(!prepare_parsing(parser, json, len, 0, 1)))
+        return 0;
+
+    /* Nothing but the error message is allocated */
+    mp_set_size_hint(parser->mempool, 0);
+    parser->scaner.validate = 1;
+    return validate(parser);
+}
+
+/* Get ready for parsing a json fed piece by piece */
+static void
+start_stream(parser_t* parser) {
+    reset_parser(parser, 0, 0, 1);
+    tape_start(&parser->tape, 0);
+
+    stream_t* stream = &parser->stream;
+    stream->len = 0;
+    stream->retry_len = 0;
+    stream->line_num = 1;
+    stream->col_num = 1;
+    stream->end_line_num = 1;
+    stream->end_col_num = 1;
+    stream->state = STREAM_ACTIVE;
+}
+
+int
+jp_feed(struct json_parser* jp, const char* data, uint32_t len) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    stream_t* stream = &parser->stream;
+
+    if (stream->state == STREAM_IDLE)
+        start_stream(parser);
+    else if (unlikely(stream->state == STREAM_FAILED))
+        return 0;
+
+    if (unlikely(stream_feed(parser, data, len, 0) == TP_ERR)) {
+        stream->state = STREAM_FAILED;
+        return 0;
+    }
+
+    return 1;
+}
+
+const jp_tape_t*
+jp_finish(struct json_parser* jp) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    stream_t* stream = &parser->stream;
+
+    if (stream->state == STREAM_IDLE)
+        start_stream(parser);
+
+    int ret = TP_ERR;
+    if (stream->state == STREAM_ACTIVE)
+        ret = stream_feed(parser, "", 0, 1);
+
+    stream->state = STREAM_IDLE;
+    return ret == TP_DONE ? parser->tape.entries : 0;
+}
+
+void
+jp_set_mem_retain(struct json_parser* jp, uint32_t bytes) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    mp_set_retain_limit(parser->mempool, bytes);
+}
+
+void
+jp_trim_mem(struct json_parser* jp) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    mp_trim(parser->mempool);
+}
+
+void
+jp_set_prealloc_ratio(struct json_parser* jp, uint32_t ratio) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    parser->prealloc_ratio = ratio;
+}
+
+void
+jp_set_mem_chunk(struct json_parser* jp, uint32_t max_chunk, int huge_page) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    mp_set_max_chunk(parser->mempool, max_chunk, huge_page);
+}
+
+void
+jp_get_mem_stats(struct json_parser* jp, jp_mem_stats_t* stats) {
+    parser_t* parser = (parser_t*)(void*)jp;
+    const mp_stats_t* mp_stats = mp_get_stats(parser->mempool);
+    stats->chunk_malloc = mp_stats->chunk_malloc;
+    stats->chunk_free = mp_stats->chunk_free;
+    stats->chunk_reuse = mp_stats->chunk_reuse;
+    stats->retained = mp_stats->retained;
+    stats->result_size = mp_used(parser->mempool) +
+                         (uint64_t)parser->tape.entry_num * sizeof(jp_tape_t);
+}
+
 void
 jp_destroy(struct json_parser* p) {
     parser_t* parser = (parser_t*)(void*)p;
+    tape_fini(&parser->tape);
+    stream_fini(&parser->stream);
+    flat_fini(&parser->flat);
+    free(parser->nesting);
+    kc_fini(&parser->key_cache);
     mp_destroy(parser->mempool);
     free((void*)p);
 }
@@ -505,9 +844,10 @@ verfiy_reverse_nesting_order(obj_t* parse_result) {
     if (!parse_result)
         return 1;
 
+    /* The json is a lone primitive */
     obj_ty_t type = parse_result->obj_ty;
     if (type <= OT_LAST_PRIMITIVE)
-        return 0;
+        return 1;
 
     obj_composite_t* cobj = (obj_composite_t*)(void*)parse_result;
 
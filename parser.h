@@ -5,6 +5,8 @@
 #include "mempool.h"
 #include "ljson_parser.h"
 #include "scaner.h"
+#include "struct_index.h"
+#include "key_cache.h"
 
 /****************************************************************************
  *
@@ -22,6 +24,82 @@ struct composite_state_tag {
     composite_state_t* next;
 };
 
+/* What jp_parse_tape() expects to see next */
+typedef enum {
+    TS_VALUE,       /* a value */
+    TS_FIRST_ELMT,  /* a value or ']', right after '[' */
+    TS_FIRST_KEY,   /* a key or '}', right after '{' */
+    TS_KEY,         /* a key, right after ',' */
+    TS_COLON,       /* ':' */
+    TS_NEXT,        /* ',' or the closing delimiter of the innermost object */
+    TS_END,         /* the end of input */
+} tape_state_t;
+
+/* The "parent" of the out-most object */
+#define NO_PARENT ((uint32_t)-1)
+
+/* The tape of jp_parse_tape(), its buffer is reused across calls */
+typedef struct {
+    jp_tape_t* entries;
+    uint32_t entry_num;
+    uint32_t capacity;  /* capacity of "entries" in # of entries */
+
+    /* The innermost open composite object, and the parsing state */
+    uint32_t parent;
+    tape_state_t state;
+
+    /* If non-zero, the input is a sequence of jsons (see jp_parse_many()) */
+    int many;
+
+    /* The type of the composite object enclosing the out-most value, or
+     * OT_ROOT if none. Unless it's OT_ROOT, the parsing stops right after
+     * the out-most value, leaving the rest of input to the caller (see
+     * jp_parse_paths()).
+     */
+    obj_ty_t enclosing;
+
+    /* If non-zero, the array/hashtab nested in the out-most one are laid on
+     * the tape as raw strings, see jp_parse_shallow().
+     */
+    int shallow;
+} tape_t;
+
+/* The result of jp_parse_flat(), its buffer is reused across calls */
+typedef struct {
+    jp_flat_t result;
+    void* buf;
+    uint32_t capacity;  /* in # of nodes */
+} flat_t;
+
+/* The state of jp_feed()/jp_finish() */
+typedef enum {
+    STREAM_IDLE,    /* the next jp_feed() starts a new json */
+    STREAM_ACTIVE,
+    STREAM_FAILED,
+} stream_state_t;
+
+typedef struct {
+    /* The bytes fed but not yet consumed, i.e. the token cut short by the
+     * end of the last input, plus the input fed after it.
+     */
+    char* buf;
+    uint32_t len;
+    uint32_t capacity;
+
+    /* Don't bother parsing "buf" again until it has so many bytes */
+    uint32_t retry_len;
+
+    /* location of buf[0] in the json */
+    int32_t line_num;
+    int32_t col_num;
+
+    /* location right after the last token, see scaner_t::end_line_num */
+    int32_t end_line_num;
+    int32_t end_col_num;
+
+    stream_state_t state;
+} stream_t;
+
 typedef struct {
     composite_state_t parse_stack;
     scaner_t scaner;
@@ -34,6 +112,35 @@ typedef struct {
      */
     obj_t* result;
     int next_cobj_id; /* next composite object id */
+
+    /* With JP_STRUCT_INDEX, the # of entries of the structural index of the
+     * input (see si_count()), which bounds the # of tokens; 0 otherwise.
+     */
+    uint32_t token_bound;
+
+    /* JP_PREALLOC allocates this many times as much memory as the input */
+    uint32_t prealloc_ratio;
+
+    tape_t tape;
+    stream_t stream;
+    flat_t flat;
+
+    /* Non-zero if parsing a slice of the out-most array's elements, see
+     * parse_array_slice().
+     */
+    int array_slice;
+
+    /* The types of the open composite objects of validate(), from the
+     * out-most to the innermost. The buffer is reused across calls.
+     */
+    uint8_t* nesting;
+    uint32_t nesting_cap;
+
+    /* The keys interned across calls, and whether to intern the keys of the
+     * current parsing (see JP_INTERN_KEYS).
+     */
+    key_cache_t key_cache;
+    int intern_keys;
 } parser_t;
 
 /****************************************************************************
@@ -61,6 +168,16 @@ int emit_primitive_tk(mempool_t* mp, token_t* tk, obj_composite_t* nesting_obj);
 
 void insert_subobj(obj_composite_t* nesting, obj_t* nested);
 
+/* Return the flags of the given key, i.e. "flags" along with the slot of
+ * the key in the key cache if JP_INTERN_KEYS is specified.
+ */
+static inline uint16_t
+intern_key(parser_t* parser, const char* key, uint32_t len, uint16_t flags) {
+    if (likely(!parser->intern_keys))
+        return flags;
+    return flags | (kc_intern(&parser->key_cache, key, len) << 4);
+}
+
 void __attribute__((format(printf, 2, 3), cold))
 set_parser_err_fmt(parser_t* parser, const char* fmt, ...);
 
@@ -72,4 +189,111 @@ int start_parsing_hashtab(parser_t*);
 int parse_hashtab(parser_t* parser);
 int parse_array(parser_t* parser);
 
+/* Parse a slice of the elements of an array, i.e. "e1, e2, ..., en" followed
+ * by ',', or by the closing ']' of the array if "last" is non-zero. The result
+ * is the same as the one of jp_parse_ex() over "[e1, e2, ..., en]".
+ */
+obj_t* parse_array_slice(parser_t*, const char* json, uint32_t len,
+                         uint32_t flags, int last);
+
+/****************************************************************************
+ *
+ *              Tape (see parse_tape.c)
+ *
+ ****************************************************************************
+ */
+void tape_init(tape_t*);
+void tape_fini(tape_t*);
+
+/* Make room for at least "entry_num" entries, return 0 on OOM. */
+int tape_reserve(tape_t*, uint32_t entry_num);
+
+/* Parse the input of the scaner into the tape. If "many" is non-zero, the
+ * input is a sequence of jsons.
+ */
+jp_tape_t* parse_tape(parser_t*, int many);
+
+/* The same as jp_parse_many() except that the input starts at the given line
+ * of a larger input, which the error location is relative to.
+ */
+jp_tape_t* parse_many(parser_t*, const char* json, uint32_t len,
+                      uint32_t flags, int32_t first_line, uint32_t* json_num);
+
+/* Report the error of seeing "tk" where a value is expected, "nesting"
+ * being the type of the innermost composite object, or OT_ROOT if none.
+ */
+void __attribute__((cold))
+report_value_err(parser_t*, obj_ty_t nesting, token_t* tk);
+
+/* Report the error of seeing "tk" where a key is expected */
+void __attribute__((cold)) report_key_err(parser_t*, token_t* tk);
+
+/* Index the keys of the hashtabs on the tape, see JP_KEY_INDEX. Return 0
+ * on OOM.
+ */
+int tape_index_keys(tape_t*);
+
+/* Get ready for tape_resume() */
+void tape_start(tape_t*, int many);
+
+/* return value of tape_resume() */
+enum {
+    TP_DONE,
+    TP_MORE,    /* The scaner is in partial mode, and runs out of input */
+    TP_ERR,
+};
+
+/* Parse the input of the scaner, picking up where the last call left off.
+ * Return one of the TP_* values.
+ */
+int tape_resume(parser_t*);
+
+/****************************************************************************
+ *
+ *              Structure of arrays (see parse_flat.c)
+ *
+ ****************************************************************************
+ */
+void flat_init(flat_t*);
+void flat_fini(flat_t*);
+
+/* Lay the given tape of "num" entries out as jp_flat_t, return NULL on OOM */
+const jp_flat_t* flatten_tape(flat_t*, const jp_tape_t* tape, uint32_t num);
+
+/****************************************************************************
+ *
+ *              Validation (see validate.c)
+ *
+ ****************************************************************************
+ */
+
+/* Check the input of the scaner, return 1 if it's well-formed, 0 otherwise */
+int validate(parser_t*);
+
+/****************************************************************************
+ *
+ *              JSON pointers (see parse_paths.c)
+ *
+ ****************************************************************************
+ */
+/* Pick the values referred to by the pointers out of the input of the
+ * scaner, see jp_parse_paths().
+ */
+const jp_tape_t** parse_paths(parser_t*, const char* const* paths,
+                              uint32_t path_num);
+
+/****************************************************************************
+ *
+ *              Streaming (see parse_stream.c)
+ *
+ ****************************************************************************
+ */
+void stream_init(stream_t*);
+void stream_fini(stream_t*);
+
+/* Parse the given piece of input as far as possible, which is the last
+ * piece if "last" is non-zero. Return one of the TP_* values.
+ */
+int stream_feed(parser_t*, const char* data, uint32_t len, int last);
+
 #endif /* PARSER_H */
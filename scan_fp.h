@@ -11,4 +11,16 @@ typedef union {
  */
 int scan_fp(const char** scan_str, const char* str_e, int_db_union_t* result);
 
+/* The correctly rounded scanner of the strict mode, which the relaxed modes
+ * resort to for the literals they cannot handle. Same return value as
+ * scan_fp().
+ */
+int scan_fp_exact(const char** scan_str, const char* str_e,
+                  int_db_union_t* result);
+
+/* Same as scan_fp_exact() except that the literal is checked only, without
+ * being converted. Return 1 if it is well-formed, 0 otherwise.
+ */
+int scan_fp_check(const char** scan_str, const char* str_e);
+
 #endif
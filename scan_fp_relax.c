@@ -18,8 +18,8 @@
  * Variant-2) is *almost* restrict. It can efficiently parse a floating point
  * literal if it's in the form of nnnn.mmm, and the integer part contains no
  * more than 20 digits, fraction part contains than 16 digits (it the liternal
- * does not satisfy this restrct, it would resort to expensive strtod() libc
- * function call). Variant 2) evaluate a liternal, say 123.456 this way:
+ * does not satisfy this restrct, it would resort to the slower, correctly
+ * rounded scan_fp_exact()). Variant 2) evaluate a liternal, say 123.456 this way:
  *   a) let d1 = 123
  *   b) let d2 = 456/10**3
  *   c) let result = d1 + d2
@@ -35,13 +35,11 @@
  *             ripple to step c) and hence incur 1/(2**53) relative error.
  *  }
  *
- * TODO: Implement the algorithm depicted in
- *  http://www.exploringbinary.com/correct-decimal-to-floating-point-using-big-integers/,
- *  Make sure the common cases can be parsed as fast as the variant-1
- *  and variant-2.
+ *  NOTE: The strict mode (FP_RELAX == 0, see scan_fp_strict.c) is now
+ * correctly rounded and about as fast as variant-2, so it should be
+ * preferred to both variants.
  */
 #include <stdint.h>
-#include <stdlib.h> /* for str2od() */
 #include "util.h"
 #include "scan_fp.h"
 
@@ -150,11 +148,10 @@ scan_fp(const char** scan_ptr, const char* str_end, int_db_union_t* result) {
     }
 
     if (unlikely(p >= str_end)) {
-        /* The floating-point literal per se is nothing wrong. However, this
-         * condition implies that the literal is the last token of the json
-         * being processed, which is not correct.
+        /* The literal is the last token of the input, which is rare enough
+         * to be left to scan_fp_exact().
          */
-        return 0;
+        goto too_nasty;
     }
 
     /* step 3: Calculate the exponent part */
@@ -197,17 +194,8 @@ scan_fp(const char** scan_ptr, const char* str_end, int_db_union_t* result) {
     return 2;
 
 too_nasty:
-    {
-    fprintf(stderr, "too nasty %s!\n", str);
-    char* fp_end;
-    double d = strtod(str, &fp_end);
-    if (fp_end != str) {
-        result->db_val = d;
-        *scan_ptr = fp_end;
-        return 2;
-    }
-    }
-    return 0;
+    *scan_ptr = str;
+    return scan_fp_exact(scan_ptr, str_end, result);
 }
 #endif
 
@@ -292,11 +280,10 @@ scan_fp(const char** scan_ptr, const char* str_end, int_db_union_t* result) {
     }
 
     if (unlikely(p >= str_end)) {
-        /* The floating-point literal per se is nothing wrong. However, this
-         * condition implies that the literal is the last token of the json
-         * being processed, which is not correct.
+        /* The literal is the last token of the input, which is rare enough
+         * to be left to scan_fp_exact().
          */
-        return 0;
+        goto too_nasty;
     }
 
     /* step 3: give up if it's in scientific notation */
@@ -309,15 +296,7 @@ scan_fp(const char** scan_ptr, const char* str_end, int_db_union_t* result) {
     return 2;
 
 too_nasty:
-    {
-    char* fp_end;
-    double d = strtod(str, &fp_end);
-    if (fp_end != str) {
-        result->db_val = d;
-        *scan_ptr = fp_end;
-        return 2;
-    }
-    }
-    return 0;
+    *scan_ptr = str;
+    return scan_fp_exact(scan_ptr, str_end, result);
 }
 #endif
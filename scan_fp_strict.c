@@ -1,55 +1,202 @@
 #include <stdint.h>
-#include <stdlib.h> /* for str2od() */
 #include "util.h"
 #include "scan_fp.h"
+#include "fp_conv.h"
 
-#if FP_RELAX == 0
-/* i.e strict floating point mode */
+/* # of significant digits guaranteed to fit in uint64_t */
+#define MAX_SIG_DIGITS  19
+
+static const uint64_t pow10_u64[MAX_SIG_DIGITS + 1] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL,
+    10000000000000000000ULL
+};
+
+/* Try to evaluate w * 10^exp10 as an integer in the range of int64_t. */
+static inline int
+to_int64(uint64_t w, int64_t exp10, int is_negative, int64_t* result) {
+    uint64_t limit = (uint64_t)INT64_MAX + is_negative;
+    if (w == 0) {
+        /* zero, whatever the exponent is */
+    } else if (exp10 >= 0) {
+        if (exp10 > MAX_SIG_DIGITS || w > limit / pow10_u64[exp10])
+            return 0;
+        w *= pow10_u64[exp10];
+    } else {
+        if (exp10 < -MAX_SIG_DIGITS || w % pow10_u64[-exp10])
+            return 0;
+        w /= pow10_u64[-exp10];
+    }
+
+    if (w > limit)
+        return 0;
 
+    *result = is_negative ? (int64_t)(0 - w) : (int64_t)w;
+    return 1;
+}
+
+/* Scan the literal in [*scan_str, str_e) without looking beyond "str_e" or
+ * relying on the locale. The literal may end right at "str_e".
+ */
 int
-scan_fp(const char** scan_str, const char* str_e, int_db_union_t* result) {
-    const char* str_save = *scan_str;
+scan_fp_exact(const char** scan_str, const char* str_e,
+              int_db_union_t* result) {
     const char* str = *scan_str;
+    const char* p = str;
 
-    int is_negative = (*str == '-') ? 1 : 0;
-    str += is_negative;
+    int is_negative = (*p == '-') ? 1 : 0;
+    p += is_negative;
 
-    /* More often than not, the number is of interger type that can fit in
-     * int64_t. So, we speculatively try to convert input string into
-     * an int64_t as we go along. In case it turns out to be a floating
-     * point number, or the interger is too big to fit in int64_t, we start
-     * over converting the string to "double"-typed value.
+    /* Accumulate up to MAX_SIG_DIGITS significant digits in "w", such that
+     * the value is w * 10^exp10. Should more non-zero digits follow, the
+     * "truncated" flag is set.
      */
-    int64_t int_val = 0;
+    uint64_t w = 0;
+    int64_t exp10 = 0;
+    int sig_digits = 0;
+    int truncated = 0;
 
-    while (str < str_e) {
-        char c = *str;
-        if (c >= '0' && c <= '9') {
-            int_val = int_val * 10 + (c - '0');
-            str++;
+    /* step 1: the integer part */
+    const char* int_start = p;
+    for (; p < str_e; p++) {
+        unsigned digit = (unsigned)(*p - '0');
+        if (digit > 9)
+            break;
+
+        if (sig_digits < MAX_SIG_DIGITS) {
+            w = w * 10 + digit;
+            sig_digits += (w != 0);
         } else {
-            if (c != '.' && (c | 0x20) != 'e') {
-                if (str - str_save < 20) {
-                    /* It's guaranteed to fit in int64_t */
-                    if (!is_negative) {
-                        result->int_val = int_val;
-                    } else {
-                        result->int_val = - int_val;
-                    }
-                    *scan_str = str;
-                    return 1;
-                }
-            }
+            exp10++;
+            truncated |= (digit != 0);
+        }
+    }
+
+    if (unlikely(p == int_start))
+        return 0;
 
-            double d = strtod(str_save, (char**)scan_str);
-            if (*scan_str != str_save) {
-                result->db_val = d;
-                return 2;
+    char c = (p < str_e) ? *p : 0;
+    if (c != '.' && (c | 0x20) != 'e') {
+        /* More often than not, the number is an integer fitting in int64_t */
+        if (likely(!exp10 && w <= (uint64_t)INT64_MAX + is_negative)) {
+            result->int_val = is_negative ? (int64_t)(0 - w) : (int64_t)w;
+            *scan_str = p;
+            return 1;
+        }
+    }
+
+    /* step 2: the fraction part */
+    int has_frac = (c == '.');
+    if (has_frac) {
+        const char* frac_start = ++p;
+        for (; p < str_e; p++) {
+            unsigned digit = (unsigned)(*p - '0');
+            if (digit > 9)
+                break;
+
+            if (sig_digits < MAX_SIG_DIGITS) {
+                w = w * 10 + digit;
+                sig_digits += (w != 0);
+                exp10--;
+            } else {
+                truncated |= (digit != 0);
             }
+        }
+
+        if (unlikely(p == frac_start))
             return 0;
+    }
+
+    /* step 3: the exponent part */
+    if (p < str_e && (*p | 0x20) == 'e') {
+        p++;
+        int neg_exp = 0;
+        if (p < str_e && (*p == '-' || *p == '+')) {
+            neg_exp = (*p == '-');
+            p++;
+        }
+
+        const char* exp_start = p;
+        int64_t exp = 0;
+        for (; p < str_e; p++) {
+            unsigned digit = (unsigned)(*p - '0');
+            if (digit > 9)
+                break;
+
+            /* Anything beyond the limit is zero or infinity anyway */
+            if (exp < 0x10000)
+                exp = exp * 10 + digit;
+        }
+
+        if (unlikely(p == exp_start))
+            return 0;
+
+        exp10 += neg_exp ? -exp : exp;
+
+        /* Literals like 1E6 are integers as long as they are exact. */
+        if (!has_frac && !truncated &&
+            to_int64(w, exp10, is_negative, &result->int_val)) {
+            *scan_str = p;
+            return 1;
         }
     }
-    return 0;
+
+    result->db_val = fp_decimal_to_double(w, exp10, is_negative, truncated,
+                                          str, p);
+    *scan_str = p;
+    return 2;
 }
 
+int
+scan_fp_check(const char** scan_str, const char* str_e) {
+    const char* p = *scan_str;
+    p += (*p == '-');
+
+    /* step 1: the integer part */
+    const char* start = p;
+    while (p < str_e && (unsigned)(*p - '0') <= 9)
+        p++;
+
+    if (unlikely(p == start))
+        return 0;
+
+    /* step 2: the fraction part */
+    if (p < str_e && *p == '.') {
+        start = ++p;
+        while (p < str_e && (unsigned)(*p - '0') <= 9)
+            p++;
+
+        if (unlikely(p == start))
+            return 0;
+    }
+
+    /* step 3: the exponent part */
+    if (p < str_e && (*p | 0x20) == 'e') {
+        p++;
+        if (p < str_e && (*p == '-' || *p == '+'))
+            p++;
+
+        start = p;
+        while (p < str_e && (unsigned)(*p - '0') <= 9)
+            p++;
+
+        if (unlikely(p == start))
+            return 0;
+    }
+
+    *scan_str = p;
+    return 1;
+}
+
+#if FP_RELAX == 0
+/* i.e strict floating point mode: the result is correctly rounded (see
+ * fp_conv.h), yet the common cases are as fast as the relaxed modes.
+ */
+int
+scan_fp(const char** scan_str, const char* str_e, int_db_union_t* result) {
+    return scan_fp_exact(scan_str, str_e, result);
+}
 #endif /*  FP_RELAX == 0 */
@@ -1,12 +1,13 @@
 #include <ctype.h>  /* for isdigit */
 #include <string.h> /* for memchr() */
 #include <stdio.h>
-#include <stdlib.h> /* for strtod() */
 #include <stdarg.h>
 #include <math.h> /* for the time being */
 #include "util.h"
 #include "scaner.h"
 #include "scan_fp.h"
+#include "simd.h"
+#include "struct_index.h" /* for the bit tricks */
 
 static const char* unrecog_token = "Unrecognizable token";
 
@@ -108,6 +109,16 @@ update_ptr_on_failure(scaner_t* scaner, const char* scan_starts,
     scaner->token.type = TT_ERR;
 }
 
+/* In partial mode, the token starting at "str" is cut short by the end of
+ * input: pretend the input ended right before the token.
+ */
+static token_t* __attribute__((cold))
+need_more_input(scaner_t* scaner, const char* str) {
+    scaner->scan_ptr = str;
+    scaner->token.type = TT_END;
+    return &scaner->token;
+}
+
 static token_t*
 char_handler(scaner_t* scaner, const char* str, const char* str_e) {
     update_ptr_on_succ(scaner, str, 1);
@@ -123,12 +134,15 @@ static token_t*
 null_handler(scaner_t* scaner, const char* str, const char* str_e) {
     token_t* tk = &scaner->token;
 
-    if (str + 4 < str_e && !strncmp(str, "null", 4)) {
+    if (str + 4 <= str_e && !strncmp(str, "null", 4)) {
         update_ptr_on_succ(scaner, str, 4);
         tk->type = TT_NULL;
         return tk;
     }
 
+    if (scaner->partial && str + 4 >= str_e)
+        return need_more_input(scaner, str);
+
     update_ptr_on_failure(scaner, str, 0);
     if (str + 4 < str_e && !strncasecmp(str, "null", 4)) {
         set_scan_err(scaner, str, "'null' must be in lower case");
@@ -138,47 +152,90 @@ null_handler(scaner_t* scaner, const char* str, const char* str_e) {
     return tk;
 }
 
-static token_t*
-fp_handler(scaner_t* scaner, const char* str, const char* str_e) {
-    const char* advance = str;
-    int_db_union_t val;
-    int res = scan_fp(&advance, str_e, &val);
+/* Scan the literal at "*str", return the same as scan_fp() */
+static inline int
+scan_literal(scaner_t* scaner, const char** str, const char* str_e,
+             int_db_union_t* val) {
+#if FP_RELAX == 0
+    if (unlikely(scaner->validate)) {
+        /* The relaxed modes accept other literals, which are checked by
+         * converting them as usual.
+         */
+        val->int_val = 0;
+        return scan_fp_check(str, str_e);
+    }
+#endif
+    return scan_fp(str, str_e, val);
+}
 
+/* See if the malformed literal at "str" runs up to the end of input */
+static int __attribute__((cold))
+literal_runs_to_end(const char* str, const char* str_e) {
+    const char* p = str;
+    while (p < str_e && (isdigit(*p) || *p == '.' || *p == '-' ||
+                         *p == '+' || (*p | 0x20) == 'e')) {
+        p++;
+    }
+    return p == str_e;
+}
+
+/* Emit the token of the literal [str, str + span) scanned by scan_literal() */
+static token_t*
+emit_literal(scaner_t* scaner, const char* str, int res, int32_t span,
+             const int_db_union_t* val) {
     token_t* tk = &scaner->token;
     if (res == 1) {
-        update_ptr_on_succ(scaner, str, advance - str);
+        update_ptr_on_succ(scaner, str, span);
         tk->type = TT_INT64,
-        tk->int_val = val.int_val;
+        tk->int_val = val->int_val;
     } else if (res == 2) {
-        update_ptr_on_succ(scaner, str, advance - str);
+        update_ptr_on_succ(scaner, str, span);
         tk->type = TT_FP,
-        tk->db_val = val.db_val;
+        tk->db_val = val->db_val;
     } else {
-        update_ptr_on_failure(scaner, str, advance - str);
+        update_ptr_on_failure(scaner, str, span);
     }
 
     return tk;
 }
 
+static token_t*
+fp_handler(scaner_t* scaner, const char* str, const char* str_e) {
+    const char* advance = str;
+    int_db_union_t val;
+    int res = scan_literal(scaner, &advance, str_e, &val);
+
+    /* In partial mode, a literal running up to the end of input may be cut
+     * short, e.g. "12" of "123", or "1e" of "1e5".
+     */
+    if (unlikely(scaner->partial) &&
+        (res ? advance == str_e : literal_runs_to_end(str, str_e))) {
+        return need_more_input(scaner, str);
+    }
+
+    return emit_literal(scaner, str, res, advance - str, &val);
+}
+
 static token_t*
 bool_handler(scaner_t* scaner, const char* str, const char* str_e) {
     int len = str_e - str;
     token_t* tk = &scaner->token;
     tk->type = TT_BOOL;
-    if (len >= 5) {
-        if (!strncmp(str, "true", 4)) {
-            tk->int_val = 1;
-            update_ptr_on_succ(scaner, str, 4);
-            return tk;
-        }
+    if (len >= 4 && !strncmp(str, "true", 4)) {
+        tk->int_val = 1;
+        update_ptr_on_succ(scaner, str, 4);
+        return tk;
+    }
 
-        if (!strncmp(str, "false", 5)) {
-            tk->int_val = 0;
-            update_ptr_on_succ(scaner, str, 5);
-            return tk;
-        }
+    if (len >= 5 && !strncmp(str, "false", 5)) {
+        tk->int_val = 0;
+        update_ptr_on_succ(scaner, str, 5);
+        return tk;
     }
 
+    if (scaner->partial && len < 5)
+        return need_more_input(scaner, str);
+
     update_ptr_on_failure(scaner, str, 0);
 
     /* Emit eror-message if true/false is not in lower case, or the token
@@ -324,9 +381,13 @@ process_u_esc(scaner_t* scaner, const char* src, const char* src_end,
               char* dest, int* src_advance, int* dest_advance) {
     int32_t codepoint;
 
-    /* Step 1: get the codepoint */
-    if (unlikely(src + 6 > src_end))
+    /* Step 1: get the codepoint. If the string ends within the four
+     * hex-digits, it's reported as illegal escape by the caller.
+     */
+    if (unlikely(src + 6 > src_end) ||
+        unlikely(memchr(src + 2, '"', 4) != 0)) {
         return 0;
+    }
 
     codepoint = hex4_to_int(src + 2);
     if (unlikely(codepoint < 0)) {
@@ -383,101 +444,231 @@ process_u_esc(scaner_t* scaner, const char* src, const char* src_end,
     return 1;
 }
 
-static token_t*
-str_handler(scaner_t* scaner, const char* str, const char* str_e) {
-    /* step 1: determine the end of string */
-    const char* str_quote = str;
+/* The minimum free space the str_handler() reserves for the string: one
+ * vector, the longest UTF-8 sequence of an escape (which follows the bytes
+ * copied from the vector, with no room check in between), and the trailing
+ * '\0'.
+ */
+#define STR_MIN_ROOM (SIMD_WIDTH + 4 + 1)
+
+/* The string being copied by str_handler() runs out of the space reserved
+ * for it. Reserve a bigger space and move the "len"-byte copied so far
+ * over. "remain" is the # of bytes of the input json not yet scaned; the
+ * string cannot be longer than len + remain.
+ */
+static char* __attribute__((noinline))
+grow_str_buf(scaner_t* scaner, const char* buf, int len, int remain,
+             char** buf_end) {
+    int size = 2 * (len + STR_MIN_ROOM);
+    if (size > len + remain + STR_MIN_ROOM)
+        size = len + remain + STR_MIN_ROOM;
+
+    char* new_buf = mp_reserve(scaner->mempool, size, buf_end);
+    if (likely(new_buf != 0))
+        memcpy(new_buf, buf, len);
+
+    return new_buf;
+}
+
+/* Scan and copy the string in one pass. The input is processed one vector
+ * at a time: the vector is copied to the destination unconditionally, and
+ * the quotes, backslashes and control characters are located with vector
+ * comparisons. As escapes never take more space than the character they
+ * represent, the string is no longer than its input.
+ *
+ * If "copy" is zero, the string is checked only (see jp_validate()); the
+ * function is always inlined, such that the copying is compiled out.
+ */
+static inline __attribute__((always_inline)) token_t*
+scan_str(scaner_t* scaner, const char* str, const char* str_e, int copy) {
     token_t* tk = &scaner->token;
 
-    do {
-        str_quote = memchr(str_quote + 1, '"', str_e - str_quote);
-        if (unlikely(!str_quote)) {
-            /* The string dose not end with quote*/
-            set_scan_err(scaner, str, "String does not end with quote");
+    char* buf_end = 0;
+    char* new_str = 0;
+    char* dest = 0;
+    if (copy) {
+        new_str = mp_reserve(scaner->mempool, STR_MIN_ROOM, &buf_end);
+        if (unlikely(!new_str)) {
+            set_scan_err(scaner, str, "OOM");
             return tk;
         }
+        dest = new_str;
+    }
 
-        if (likely(*(str_quote - 1) != '\\')) {
-            break;
-        } else {
-            /* Consider the cases like "Junk\\" */
-            const char* t = str_quote - 2;
-            int cnt = 1;
-            for (; *t == '\\'; t--, cnt++) {}
-            if ((cnt & 1) == 0) {
-                break;
+    const char* src = str + 1;
+
+    while (1) {
+        if (copy && unlikely(buf_end - dest < STR_MIN_ROOM)) {
+            int len = dest - new_str;
+            new_str = grow_str_buf(scaner, new_str, len, str_e - src,
+                                   &buf_end);
+            if (unlikely(!new_str)) {
+                set_scan_err(scaner, str, "OOM");
+                return tk;
             }
+            dest = new_str + len;
         }
-    } while(1);
 
-    /* step 2: allocate space for the string. The new string has trailing
-     * '\0' for easing purpose.
-     */
-    char* new_str =
-        MEMPOOL_ALLOC_TYPE_N(scaner->mempool, char, str_quote - str);
-    if (unlikely(!new_str)) {
-        set_scan_err(scaner, str, "OOM");
-        return tk;
-    }
+        /* step 1: copy the input up to the first quote, backslash or
+         * control character.
+         */
+        if (likely(str_e - src >= SIMD_WIDTH)) {
+            simd_vec_t v = simd_load(src);
+            if (copy)
+                simd_store(dest, v);
+
+            uint32_t stop = simd_eq(v, '"') | simd_eq(v, '\\') |
+                            simd_lt(v, 0x20);
+            if (likely(!stop)) {
+                src += SIMD_WIDTH;
+                if (copy)
+                    dest += SIMD_WIDTH;
+                continue;
+            }
 
-    /* step 3: copy the string */
-    {
-        char* dest = new_str;
-        const char* src = str + 1;
-        do {
-            int len = str_quote - src;
-            char* esc = (char*)memchr(src, '\\', len);
-            if (!esc) {
-                memcpy(dest, src, len);
-                src += len;
+            int len = __builtin_ctz(stop);
+            src += len;
+            if (copy)
                 dest += len;
+        } else {
+            for (; src < str_e; src++) {
+                unsigned char c = *src;
+                if (c == '"' || c == '\\' || c < 0x20)
+                    break;
+                if (copy)
+                    *dest++ = c;
+            }
+
+            if (unlikely(src == str_e)) {
+                if (scaner->partial)
+                    return need_more_input(scaner, str);
+                set_scan_err(scaner, str, "String does not end with quote");
+                return tk;
+            }
+        }
+
+        /* step 2: see the closing quote */
+        char c = *src;
+        if (likely(c == '"')) {
+            if (copy) {
                 *dest = '\0'; /* to ease debugging*/
 
+                int len = dest - new_str;
+                mp_commit(scaner->mempool, len + 1);
+
                 tk->str_val = new_str;
-                tk->str_len = dest - new_str;
-                tk->type = TT_STR;
-                update_ptr_on_succ(scaner, str, str_quote - str + 1);
-                return tk;
+                tk->str_len = len;
+                tk->str_flags = 0;
+            } else {
+                tk->str_val = 0;
+                tk->str_len = 0;
             }
 
-            /* Handle escape */
-            len = esc - src;
-            memcpy(dest, src, len);
-            src = esc;
-            dest += len;
+            tk->type = TT_STR;
+            update_ptr_on_succ(scaner, str, src - str + 1);
+            return tk;
+        }
+
+        /* step 3: control characters must be escaped */
+        if (unlikely(c != '\\')) {
+            set_scan_err_fmt(scaner, src, "control character 0x%02x must be "
+                             "escaped", (int)(unsigned char)c);
+            return tk;
+        }
+
+        /* step 4: handle escape */
+        if (unlikely(src + 1 >= str_e)) {
+            if (scaner->partial)
+                return need_more_input(scaner, str);
+            set_scan_err(scaner, str, "String does not end with quote");
+            return tk;
+        }
 
-            char esc_key = esc[1];
-            char esc_val = esc_char[(unsigned char)esc_key];
+        char esc_key = src[1];
+        char esc_val = esc_char[(unsigned char)esc_key];
 
-            /* successfully processed non-unicode (\u) escape */
-            if (esc_val) {
+        /* successfully processed non-unicode (\u) escape */
+        if (esc_val) {
+            if (copy)
                 *dest++ = esc_val;
-                src += sizeof("\\n") - 1;
-                continue;
-            }
+            src += sizeof("\\n") - 1;
+            continue;
+        }
 
-            /* process unicode escape */
-            if (esc_key == 'u') {
-                int src_adv, dest_adv;
-                if (process_u_esc(scaner, src, str_quote, dest,
-                                  &src_adv, &dest_adv)) {
-                    src += src_adv;
+        /* process unicode escape */
+        if (esc_key == 'u') {
+            /* The escape may be followed by a surrogate "\\uxxxx" */
+            if (scaner->partial && str_e - src < 12)
+                return need_more_input(scaner, str);
+
+            char utf8[4];
+            int src_adv, dest_adv;
+            if (process_u_esc(scaner, src, str_e, copy ? dest : utf8,
+                              &src_adv, &dest_adv)) {
+                src += src_adv;
+                if (copy)
                     dest += dest_adv;
-                    continue;
-                }
+                continue;
             }
+        }
 
-            /* illegal escape */
-            set_scan_err_fmt(scaner, esc, "illegal escape \\%c", esc[1]);
+        /* illegal escape */
+        set_scan_err_fmt(scaner, src, "illegal escape \\%c", esc_key);
+        return tk;
+    }
+}
+
+/* Let the token point into the input if the string starting at "str" is
+ * free of escapes (see JP_ZERO_COPY). Otherwise, NULL is returned, leaving
+ * the string to scan_str().
+ */
+static inline token_t*
+borrow_str(scaner_t* scaner, const char* str, const char* str_e) {
+    const char* src = str + 1;
+
+    while (str_e - src >= SIMD_WIDTH) {
+        simd_vec_t v = simd_load(src);
+        uint32_t stop = simd_eq(v, '"') | simd_eq(v, '\\') |
+                        simd_lt(v, 0x20);
+        if (stop) {
+            src += __builtin_ctz(stop);
+            goto stop;
+        }
+        src += SIMD_WIDTH;
+    }
+
+    for (; src < str_e; src++) {
+        unsigned char c = *src;
+        if (c == '"' || c == '\\' || c < 0x20)
+            goto stop;
+    }
+    return 0;
+
+stop:
+    if (unlikely(*src != '"'))
+        return 0;
+
+    token_t* tk = &scaner->token;
+    tk->type = TT_STR;
+    tk->str_val = (char*)(str + 1);
+    tk->str_len = src - str - 1;
+    tk->str_flags = OF_BORROWED;
+    update_ptr_on_succ(scaner, str, src - str + 1);
+    return tk;
+}
+
+static token_t*
+str_handler(scaner_t* scaner, const char* str, const char* str_e) {
+    if (unlikely(scaner->validate))
+        return scan_str(scaner, str, str_e, 0);
+
+    if (scaner->zero_copy) {
+        token_t* tk = borrow_str(scaner, str, str_e);
+        if (likely(tk != 0))
             return tk;
-        } while(1);
     }
 
-    /* Should not reach here. The return-statement is just to make
-     * stupid compilers happy.
-     */
-    ASSERT(0);
-    return NULL;
+    return scan_str(scaner, str, str_e, 1);
 }
 
 static token_t* space_handler(scaner_t*, const char*, const char*);
@@ -494,34 +685,89 @@ tk_hd_func token_handler[] = {
     [TT_IS_SPACE] = space_handler,
 };
 
+/* Skip the whitespaces starting from "str_ptr", SIMD_WIDTH bytes at a time.
+ * The line/column are not updated byte by byte; instead, the newlines of the
+ * skipped bytes are counted with popcount, and the column is derived from
+ * the last newline.
+ */
 static token_t*
 space_handler(scaner_t* scaner, const char* str_ptr, const char* str_end) {
+    const char* p = str_ptr;
+    const char* last_nl = NULL;
     int32_t ln = 0;
-    int32_t col = 0;
 
-    char lookahead = *str_ptr;
-    token_ty_t tt;
-    do {
-        col = (lookahead == '\n') ? 1 : col + 1;
-        ln += ((lookahead == '\n') ? 1 : 0);
-
-        if (unlikely(str_end <= ++str_ptr)) {
-            scaner->token.type = TT_END;
-            return &scaner->token;
+    if (*p == '\n') {
+        ln = 1;
+        last_nl = p;
+    }
+    p++;
+
+    while (str_end - p >= SIMD_WIDTH) {
+        simd_vec_t v = simd_load(p);
+        uint32_t non_space = ~simd_space(v) & SIMD_ALL_ONES;
+        uint32_t nl = simd_eq(v, '\n');
+
+        if (non_space) {
+            int space_len = __builtin_ctz(non_space);
+            nl &= (((uint32_t)1) << space_len) - 1;
+            if (nl) {
+                ln += __builtin_popcount(nl);
+                last_nl = p + 31 - __builtin_clz(nl);
+            }
+            p += space_len;
+            goto done;
+        }
+
+        if (nl) {
+            ln += __builtin_popcount(nl);
+            last_nl = p + 31 - __builtin_clz(nl);
+        }
+        p += SIMD_WIDTH;
+    }
+
+    for (; p < str_end; p++) {
+        char c = *p;
+        if (token_predict[(uint32_t)(uint8_t)c] != TT_IS_SPACE)
+            goto done;
+
+        if (c == '\n') {
+            ln++;
+            last_nl = p;
+        }
+    }
+
+    if (scaner->partial) {
+        /* Consume the whitespaces, such that they are not carried over to
+         * the next input. Those at the beginning of input continue the ones
+         * of the last input, which are ahead of the last token's end.
+         */
+        if (str_ptr != scaner->json_begin) {
+            scaner->end_line_num = scaner->line_num;
+            scaner->end_col_num = scaner->col_num;
         }
+        scaner->line_num += ln;
+        if (last_nl) {
+            scaner->col_num = p - last_nl;
+        } else {
+            scaner->col_num += p - str_ptr;
+        }
+        scaner->scan_ptr = p;
+    }
 
-        lookahead = *str_ptr;
-        tt = (token_ty_t)token_predict[(uint32_t)(uint8_t)lookahead];
-        if (tt != TT_IS_SPACE)
-            break;
-    } while (1);
+    scaner->token.type = TT_END;
+    return &scaner->token;
 
+done:
     scaner->line_num += ln;
-    scaner->col_num += col;
-    /* It is not necessary to set scan_ptr as token-handler will update it.*/
-    /*scaner->scan_ptr = str_ptr; */
+    if (last_nl) {
+        scaner->col_num = p - last_nl;
+    } else {
+        scaner->col_num += p - str_ptr;
+    }
+    scaner->scan_ptr = p;
 
-    return token_handler[tt](scaner, str_ptr, str_end);
+    token_ty_t tt = (token_ty_t)token_predict[(uint32_t)(uint8_t)*p];
+    return token_handler[tt](scaner, p, str_end);
 }
 
 token_t*
@@ -530,6 +776,10 @@ sc_get_token(scaner_t* scaner, const char* str_end) {
     ASSERT(str_end == scaner->json_end);
 
     if (unlikely(str_ptr >= str_end)) {
+        if (str_ptr != scaner->json_begin) {
+            scaner->end_line_num = scaner->line_num;
+            scaner->end_col_num = scaner->col_num;
+        }
         scaner->token.type = TT_END;
         return &scaner->token;
     }
@@ -548,16 +798,200 @@ sc_init_scaner(scaner_t* scaner, mempool_t* mp,
     scaner->scan_ptr = json;
     scaner->line_num = 1;
     scaner->col_num = 1;
+    scaner->end_line_num = 1;
+    scaner->end_col_num = 1;
+    scaner->partial = 0;
+    scaner->validate = 0;
+    scaner->zero_copy = 0;
     scaner->err_msg = NULL;
 }
 
 void
 sc_rewind (scaner_t* scaner) {
     int span = scaner->token.span;
-    scaner->scan_ptr -= span;
+    /* The token may be of an earlier piece of jp_feed(), which is gone */
+    if (likely(scaner->scan_ptr - scaner->json_begin >= span))
+        scaner->scan_ptr -= span;
+    else
+        scaner->scan_ptr = scaner->json_begin;
     scaner->col_num -= span;
 }
 
+/* Classify a 64-byte block for skip_composite() */
+static inline void
+classify_skip_blk(const char* p, uint64_t* quote, uint64_t* bslash,
+                  uint64_t* open, uint64_t* close, uint64_t* nl) {
+    uint64_t q = 0, b = 0, o = 0, c = 0, n = 0;
+    int i;
+    for (i = 0; i < 64; i += SIMD_WIDTH) {
+        simd_vec_t v = simd_load(p + i);
+        q |= (uint64_t)simd_eq(v, '"') << i;
+        b |= (uint64_t)simd_eq(v, '\\') << i;
+        o |= (uint64_t)(simd_eq(v, '[') | simd_eq(v, '{')) << i;
+        c |= (uint64_t)(simd_eq(v, ']') | simd_eq(v, '}')) << i;
+        n |= (uint64_t)simd_eq(v, '\n') << i;
+    }
+
+    *quote = q;
+    *bslash = b;
+    *open = o;
+    *close = c;
+    *nl = n;
+}
+
+/* Return the end of the array/hashtab whose opening delimiter is right
+ * before "p", i.e. right past its closing delimiter, or NULL if it's not
+ * closed before "e". The newlines skipped are counted in "lines", and
+ * "line_start" is set to the start of the last line if any.
+ *
+ *   The input is processed 64 bytes at a time, the same way as the
+ * structural index is built: the strings are located with the bitmaps of
+ * quotes and backslashes, and the brackets outside of them are counted with
+ * popcount. The brackets are looked at one by one only in the block where
+ * the nesting depth may drop to zero.
+ */
+static const char*
+skip_composite(const char* p, const char* e, int32_t* lines,
+               const char** line_start) {
+    uint32_t depth = 1;
+    uint64_t prev_escaped = 0;
+    uint64_t prev_in_str = 0;
+
+    for (; e - p >= 64; p += 64) {
+        uint64_t quote, bslash, open, close, nl;
+        classify_skip_blk(p, &quote, &bslash, &open, &close, &nl);
+
+        uint64_t escaped = find_escaped(bslash, &prev_escaped);
+        uint64_t in_str = prefix_xor(quote & ~escaped) ^ prev_in_str;
+        prev_in_str = (uint64_t)(((int64_t)in_str) >> 63);
+
+        open &= ~in_str;
+        close &= ~in_str;
+
+        uint32_t close_num = __builtin_popcountll(close);
+        if (close_num >= depth) {
+            uint64_t brackets = open | close;
+            while (brackets) {
+                uint64_t bit = brackets & -brackets;
+                brackets ^= bit;
+                if (open & bit) {
+                    depth++;
+                } else if (--depth == 0) {
+                    nl &= (bit << 1) - 1;
+                    if (nl) {
+                        *lines += __builtin_popcountll(nl);
+                        *line_start = p + 64 - __builtin_clzll(nl);
+                    }
+                    return p + __builtin_ctzll(bit) + 1;
+                }
+            }
+        } else {
+            depth += __builtin_popcountll(open) - close_num;
+        }
+
+        if (nl) {
+            *lines += __builtin_popcountll(nl);
+            *line_start = p + 64 - __builtin_clzll(nl);
+        }
+    }
+
+    /* The rest is done byte by byte, picking up the state of the string */
+    int in_str = prev_in_str & 1;
+    int esc = prev_escaped & 1;
+    for (; p < e; p++) {
+        char c = *p;
+        if (c == '\n') {
+            (*lines)++;
+            *line_start = p + 1;
+        }
+
+        if (in_str) {
+            if (esc)
+                esc = 0;
+            else if (c == '\\')
+                esc = 1;
+            else if (c == '"')
+                in_str = 0;
+            continue;
+        }
+
+        if (c == '"') {
+            in_str = 1;
+        } else if (c == '[' || c == '{') {
+            depth++;
+        } else if ((c == ']' || c == '}') && --depth == 0) {
+            return p + 1;
+        }
+    }
+
+    return 0;
+}
+
+int
+sc_skip_composite(scaner_t* scaner) {
+    int32_t lines = 0;
+    const char* line_start = 0;
+    const char* p = skip_composite(scaner->scan_ptr, scaner->json_end,
+                                   &lines, &line_start);
+    int closed = (p != 0);
+    if (unlikely(!closed))
+        p = scaner->json_end;
+
+    scaner->line_num += lines;
+    scaner->col_num = line_start ? p - line_start + 1 :
+                                   scaner->col_num + (p - scaner->scan_ptr);
+    scaner->scan_ptr = p;
+
+    if (unlikely(!closed)) {
+        set_scan_err(scaner, p, "Array/hashtab is not closed");
+        return 0;
+    }
+    return 1;
+}
+
+const char*
+sc_skip_value(const char* p, const char* e) {
+    while (p < e && token_predict[(uint8_t)*p] == TT_IS_SPACE)
+        p++;
+
+    if (unlikely(p == e))
+        return 0;
+
+    char c = *p;
+    if (c == '[' || c == '{') {
+        int32_t lines = 0;
+        const char* line_start;
+        return skip_composite(p + 1, e, &lines, &line_start);
+    }
+
+    if (c == '"') {
+        /* Look for the quote not escaped, i.e. preceded by an even # of
+         * backslashes.
+         */
+        const char* str = p + 1;
+        while (1) {
+            const char* q = (const char*)memchr(str, '"', e - str);
+            if (!q)
+                return 0;
+
+            const char* b = q;
+            while (b > p + 1 && b[-1] == '\\')
+                b--;
+            if (((q - b) & 1) == 0)
+                return q + 1;
+            str = q + 1;
+        }
+    }
+
+    /* number/true/false/null, or junk */
+    const char* start = p;
+    while (p < e && token_predict[(uint8_t)*p] != TT_IS_SPACE && *p != ',' &&
+           *p != ':' && *p != ']' && *p != '}') {
+        p++;
+    }
+    return p != start ? p : 0;
+}
+
 /****************************************************************
  *
  *   Error handling and other cold code cluster here
@@ -76,6 +76,7 @@ typedef struct {
 
     /* valid iff the token is a string */
     int32_t str_len;
+    int32_t str_flags; /* bitwise-or of obj_flag_t */
 
     /* How many chars in the input json string representing this token. In
      * the even of lexical problem, the span points to starting location where
@@ -102,6 +103,29 @@ typedef struct {
     int32_t line_num;
     int32_t col_num;
 
+    /* In partial mode, the location right after the last token, i.e. ahead
+     * of the whitespaces consumed at the end of input (see jp_finish()).
+     */
+    int32_t end_line_num;
+    int32_t end_col_num;
+
+    /* If non-zero, more input may follow json_end (see jp_feed()). The
+     * tokens cut short by json_end are reported as TT_END, leaving the
+     * scan_ptr at the start of the token.
+     */
+    int partial;
+
+    /* If non-zero, the tokens are checked only, i.e. the strings are neither
+     * copied nor unescaped, and the numbers are not converted in the strict
+     * mode; see jp_validate().
+     */
+    int validate;
+
+    /* If non-zero, the strings free of escapes point into the input json
+     * instead of being copied, see JP_ZERO_COPY.
+     */
+    int zero_copy;
+
     const char* err_msg;
 } scaner_t;
 
@@ -121,4 +145,16 @@ token_t* sc_get_token(scaner_t*, const char* str_end);
  */
 void sc_rewind(scaner_t*);
 
+/* Skip the rest of the innermost open array/hashtab, i.e. move past its
+ * closing delimiter by matching brackets and quotes, without looking into
+ * the tokens (see jp_parse_paths()). Return 0 if it's not closed.
+ */
+int sc_skip_composite(scaner_t*);
+
+/* Return the end of the json value starting at "p" (whitespaces ahead of it
+ * skipped), i.e. right past it, or NULL if it does not end before "e". The
+ * value is not validated, see jp_skip_value().
+ */
+const char* sc_skip_value(const char* p, const char* e);
+
 #endif
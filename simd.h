@@ -0,0 +1,145 @@
+/* ****************************************************************************
+ *
+ *   Thin wrappers of the vector instructions used by the scaner. A vector is
+ * SIMD_WIDTH bytes wide: 32 if compiled with AVX2, 16 with SSE2 (which
+ * every x86-64 has), and 8 bytes processed one by one otherwise.
+ *
+ *   The comparison functions return a bitmask, bit i corresponding to the
+ * i-th byte of the vector.
+ *
+ * ****************************************************************************
+ */
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define SIMD_WIDTH 32
+typedef __m256i simd_vec_t;
+
+static inline simd_vec_t
+simd_load(const char* p) {
+    return _mm256_loadu_si256((const __m256i*)(const void*)p);
+}
+
+static inline void
+simd_store(char* p, simd_vec_t v) {
+    _mm256_storeu_si256((__m256i*)(void*)p, v);
+}
+
+static inline uint32_t
+simd_eq(simd_vec_t v, char c) {
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+}
+
+/* bytes less than "c" (unsigned comparison) */
+static inline uint32_t
+simd_lt(simd_vec_t v, uint8_t c) {
+    __m256i bound = _mm256_set1_epi8(c - 1);
+    return _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_min_epu8(v, bound), v));
+}
+
+/* bytes in the range of [lo, lo + n] */
+static inline uint32_t
+simd_in_range(simd_vec_t v, uint8_t lo, uint8_t n) {
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(n)), t));
+}
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+#define SIMD_WIDTH 16
+typedef __m128i simd_vec_t;
+
+static inline simd_vec_t
+simd_load(const char* p) {
+    return _mm_loadu_si128((const __m128i*)(const void*)p);
+}
+
+static inline void
+simd_store(char* p, simd_vec_t v) {
+    _mm_storeu_si128((__m128i*)(void*)p, v);
+}
+
+static inline uint32_t
+simd_eq(simd_vec_t v, char c) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+}
+
+static inline uint32_t
+simd_lt(simd_vec_t v, uint8_t c) {
+    __m128i bound = _mm_set1_epi8(c - 1);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, bound), v));
+}
+
+static inline uint32_t
+simd_in_range(simd_vec_t v, uint8_t lo, uint8_t n) {
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(n)), t));
+}
+
+#else
+
+#define SIMD_WIDTH 8
+typedef struct {
+    uint8_t b[SIMD_WIDTH];
+} simd_vec_t;
+
+static inline simd_vec_t
+simd_load(const char* p) {
+    simd_vec_t v;
+    __builtin_memcpy(v.b, p, SIMD_WIDTH);
+    return v;
+}
+
+static inline void
+simd_store(char* p, simd_vec_t v) {
+    __builtin_memcpy(p, v.b, SIMD_WIDTH);
+}
+
+static inline uint32_t
+simd_eq(simd_vec_t v, char c) {
+    uint32_t mask = 0;
+    int i;
+    for (i = 0; i < SIMD_WIDTH; i++)
+        mask |= (uint32_t)(v.b[i] == (uint8_t)c) << i;
+    return mask;
+}
+
+static inline uint32_t
+simd_lt(simd_vec_t v, uint8_t c) {
+    uint32_t mask = 0;
+    int i;
+    for (i = 0; i < SIMD_WIDTH; i++)
+        mask |= (uint32_t)(v.b[i] < c) << i;
+    return mask;
+}
+
+static inline uint32_t
+simd_in_range(simd_vec_t v, uint8_t lo, uint8_t n) {
+    uint32_t mask = 0;
+    int i;
+    for (i = 0; i < SIMD_WIDTH; i++)
+        mask |= (uint32_t)((uint8_t)(v.b[i] - lo) <= n) << i;
+    return mask;
+}
+
+#endif
+
+#define SIMD_ALL_ONES ((uint32_t)(((uint64_t)1 << SIMD_WIDTH) - 1))
+
+/* whitespaces, i.e. one of " \t\n\v\f\r" */
+static inline uint32_t
+simd_space(simd_vec_t v) {
+    /* '\t', '\n', '\v', '\f', '\r' are in the range of [9, 13] */
+    return simd_eq(v, ' ') | simd_in_range(v, '\t', 4);
+}
+
+#endif /* SIMD_H */
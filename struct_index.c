@@ -0,0 +1,303 @@
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "struct_index.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SI_X86 1
+#endif
+
+#define BLK_SZ 64
+
+/* The bitmaps of a 64-byte block, bit i corresponds to the i-th byte. */
+typedef struct {
+    uint64_t quote;
+    uint64_t bslash;
+    uint64_t op;    /* one of "{}[],:" */
+    uint64_t ws;    /* whitespace */
+} blk_mask_t;
+
+typedef void (*classify_func_t)(const uint8_t* blk, blk_mask_t* mask);
+
+/* ***********************************************************************
+ *
+ *      Classify a block with plain C
+ *
+ * ***********************************************************************
+ */
+#define CC_QUOTE  1
+#define CC_BSLASH 2
+#define CC_OP     4
+#define CC_WS     8
+
+static uint8_t char_class[256];
+
+static void
+classify_scalar(const uint8_t* blk, blk_mask_t* mask) {
+    uint64_t quote = 0, bslash = 0, op = 0, ws = 0;
+    int i;
+    for (i = 0; i < BLK_SZ; i++) {
+        uint64_t bit = ((uint64_t)1) << i;
+        uint8_t cc = char_class[blk[i]];
+        if (likely(!cc))
+            continue;
+
+        if (cc & CC_QUOTE) quote |= bit;
+        if (cc & CC_BSLASH) bslash |= bit;
+        if (cc & CC_OP) op |= bit;
+        if (cc & CC_WS) ws |= bit;
+    }
+
+    mask->quote = quote;
+    mask->bslash = bslash;
+    mask->op = op;
+    mask->ws = ws;
+}
+
+/* ***********************************************************************
+ *
+ *      Classify a block with SSE4.2 and AVX2
+ *
+ * ***********************************************************************
+ */
+#ifdef SI_X86
+__attribute__((target("sse4.2"))) static void
+classify_sse42(const uint8_t* blk, blk_mask_t* mask) {
+    uint64_t quote = 0, bslash = 0, op = 0, ws = 0;
+
+    const __m128i v_quote = _mm_set1_epi8('"');
+    const __m128i v_bslash = _mm_set1_epi8('\\');
+    const __m128i v_lcase = _mm_set1_epi8(0x20);
+    const __m128i v_lbrace = _mm_set1_epi8('{');
+    const __m128i v_rbrace = _mm_set1_epi8('}');
+    const __m128i v_comma = _mm_set1_epi8(',');
+    const __m128i v_colon = _mm_set1_epi8(':');
+    const __m128i v_space = _mm_set1_epi8(' ');
+    const __m128i v_9 = _mm_set1_epi8(9);
+    const __m128i v_4 = _mm_set1_epi8(4);
+
+    int i;
+    for (i = 0; i < BLK_SZ; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(blk + i));
+
+        /* '[' and ']' differ from '{' and '}' only in bit 0x20 */
+        __m128i lc = _mm_or_si128(v, v_lcase);
+        __m128i o = _mm_or_si128(_mm_cmpeq_epi8(lc, v_lbrace),
+                                 _mm_cmpeq_epi8(lc, v_rbrace));
+        o = _mm_or_si128(o, _mm_cmpeq_epi8(v, v_comma));
+        o = _mm_or_si128(o, _mm_cmpeq_epi8(v, v_colon));
+
+        /* '\t', '\n', '\v', '\f', '\r' are in the range of [9, 13] */
+        __m128i t = _mm_sub_epi8(v, v_9);
+        __m128i w = _mm_cmpeq_epi8(_mm_min_epu8(t, v_4), t);
+        w = _mm_or_si128(w, _mm_cmpeq_epi8(v, v_space));
+
+        uint64_t q = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, v_quote));
+        uint64_t b = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, v_bslash));
+        quote |= q << i;
+        bslash |= b << i;
+        op |= ((uint64_t)(uint16_t)_mm_movemask_epi8(o)) << i;
+        ws |= ((uint64_t)(uint16_t)_mm_movemask_epi8(w)) << i;
+    }
+
+    mask->quote = quote;
+    mask->bslash = bslash;
+    mask->op = op;
+    mask->ws = ws;
+}
+
+__attribute__((target("avx2"))) static void
+classify_avx2(const uint8_t* blk, blk_mask_t* mask) {
+    uint64_t quote = 0, bslash = 0, op = 0, ws = 0;
+
+    const __m256i v_quote = _mm256_set1_epi8('"');
+    const __m256i v_bslash = _mm256_set1_epi8('\\');
+    const __m256i v_lcase = _mm256_set1_epi8(0x20);
+    const __m256i v_lbrace = _mm256_set1_epi8('{');
+    const __m256i v_rbrace = _mm256_set1_epi8('}');
+    const __m256i v_comma = _mm256_set1_epi8(',');
+    const __m256i v_colon = _mm256_set1_epi8(':');
+    const __m256i v_space = _mm256_set1_epi8(' ');
+    const __m256i v_9 = _mm256_set1_epi8(9);
+    const __m256i v_4 = _mm256_set1_epi8(4);
+
+    int i;
+    for (i = 0; i < BLK_SZ; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(blk + i));
+
+        __m256i lc = _mm256_or_si256(v, v_lcase);
+        __m256i o = _mm256_or_si256(_mm256_cmpeq_epi8(lc, v_lbrace),
+                                    _mm256_cmpeq_epi8(lc, v_rbrace));
+        o = _mm256_or_si256(o, _mm256_cmpeq_epi8(v, v_comma));
+        o = _mm256_or_si256(o, _mm256_cmpeq_epi8(v, v_colon));
+
+        __m256i t = _mm256_sub_epi8(v, v_9);
+        __m256i w = _mm256_cmpeq_epi8(_mm256_min_epu8(t, v_4), t);
+        w = _mm256_or_si256(w, _mm256_cmpeq_epi8(v, v_space));
+
+        uint64_t q =
+            (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, v_quote));
+        uint64_t b =
+            (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, v_bslash));
+        quote |= q << i;
+        bslash |= b << i;
+        op |= ((uint64_t)(uint32_t)_mm256_movemask_epi8(o)) << i;
+        ws |= ((uint64_t)(uint32_t)_mm256_movemask_epi8(w)) << i;
+    }
+
+    mask->quote = quote;
+    mask->bslash = bslash;
+    mask->op = op;
+    mask->ws = ws;
+}
+#endif
+
+static classify_func_t classify = classify_scalar;
+static const char* impl_name = "scalar";
+
+static void __attribute__((constructor))
+init_struct_index() {
+    const char* ws = " \t\n\r\f\v";
+    const char* op = "{}[],:";
+
+    memset(char_class, 0, sizeof(char_class));
+    for (; *ws; ws++)
+        char_class[(uint8_t)*ws] = CC_WS;
+    for (; *op; op++)
+        char_class[(uint8_t)*op] = CC_OP;
+    char_class['"'] = CC_QUOTE;
+    char_class['\\'] = CC_BSLASH;
+
+#ifdef SI_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        classify = classify_avx2;
+        impl_name = "avx2";
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        classify = classify_sse42;
+        impl_name = "sse4.2";
+    }
+#endif
+}
+
+/* ***********************************************************************
+ *
+ *      Build the index
+ *
+ * ***********************************************************************
+ */
+
+static int
+reserve_index(struct_index_t* si, uint32_t min_cap) {
+    if (likely(si->capacity >= min_cap))
+        return 1;
+
+    uint32_t cap = si->capacity ? si->capacity : 1024;
+    while (cap < min_cap)
+        cap *= 2;
+
+    uint32_t* pos = (uint32_t*)realloc(si->pos, sizeof(uint32_t) * cap);
+    if (unlikely(!pos))
+        return 0;
+
+    si->pos = pos;
+    si->capacity = cap;
+    return 1;
+}
+
+void
+si_init(struct_index_t* si) {
+    si->pos = 0;
+    si->pos_num = 0;
+    si->capacity = 0;
+}
+
+void
+si_fini(struct_index_t* si) {
+    free(si->pos);
+    si_init(si);
+}
+
+/* The state carried over from block to block */
+typedef struct {
+    uint64_t prev_escaped;
+    uint64_t prev_in_str;
+    uint64_t prev_scalar;
+} blk_state_t;
+
+/* Return the bitmap of the places where a token could start (see
+ * struct_index.h) in the block at "ofst".
+ */
+static inline uint64_t
+token_starts(const char* json, uint32_t len, uint32_t ofst,
+             blk_state_t* st) {
+    blk_mask_t m;
+    if (likely(len - ofst >= BLK_SZ)) {
+        classify((const uint8_t*)json + ofst, &m);
+    } else {
+        /* pad the last partial block with whitespaces */
+        uint8_t last_blk[BLK_SZ];
+        memset(last_blk, ' ', BLK_SZ);
+        memcpy(last_blk, json + ofst, len - ofst);
+        classify(last_blk, &m);
+    }
+
+    uint64_t escaped = find_escaped(m.bslash, &st->prev_escaped);
+    uint64_t quote = m.quote & ~escaped;
+
+    /* The bits of opening quotes and the string contents are set, while
+     * the bits of closing quotes are clear.
+     */
+    uint64_t in_str = prefix_xor(quote) ^ st->prev_in_str;
+    st->prev_in_str = (uint64_t)(((int64_t)in_str) >> 63);
+
+    uint64_t scalar = ~(m.op | m.ws | m.quote) & ~in_str;
+    uint64_t scalar_start = scalar & ~((scalar << 1) | st->prev_scalar);
+    st->prev_scalar = scalar >> 63;
+
+    return (m.op & ~in_str) | (quote & in_str) | scalar_start;
+}
+
+int
+si_build(struct_index_t* si, const char* json, uint32_t len) {
+    blk_state_t st = { 0, 0, 0 };
+    uint32_t n = 0;
+    uint32_t ofst;
+
+    for (ofst = 0; ofst < len; ofst += BLK_SZ) {
+        if (unlikely(!reserve_index(si, n + BLK_SZ + 1)))
+            return 0;
+
+        uint64_t starts = token_starts(json, len, ofst, &st);
+        uint32_t* pos = si->pos;
+        while (starts) {
+            pos[n++] = ofst + __builtin_ctzll(starts);
+            starts &= starts - 1;
+        }
+    }
+
+    if (unlikely(!reserve_index(si, n + 1)))
+        return 0;
+
+    si->pos[n++] = len;
+    si->pos_num = n;
+    return 1;
+}
+
+uint32_t
+si_count(const char* json, uint32_t len) {
+    blk_state_t st = { 0, 0, 0 };
+    uint32_t n = 1;
+    uint32_t ofst;
+
+    for (ofst = 0; ofst < len; ofst += BLK_SZ)
+        n += __builtin_popcountll(token_starts(json, len, ofst, &st));
+
+    return n;
+}
+
+const char*
+si_impl_name(void) {
+    return impl_name;
+}
@@ -0,0 +1,87 @@
+/* ****************************************************************************
+ *
+ *   The structural index is an optional "stage-1" pass over the input json.
+ * It classifies the input in 64-byte blocks, and records in an array the
+ * offset of every place where a token could start, namely:
+ *
+ *   o. the delimiters "{}[],:" which are not inside a string,
+ *   o. the opening quote of a string, and
+ *   o. the first byte of a run of non-whitespace, non-delimiter bytes outside
+ *      of strings (i.e. the first byte of number/true/false/null or junk).
+ *
+ *   The index is terminated by an entry equal to the length of the input
+ * json. jp_pool_parse() finds the elements of the out-most array with it,
+ * and the # of entries bounds the # of tokens (see JP_STRUCT_INDEX). The
+ * scaner does not walk the index: its vectorized skipping of whitespaces
+ * costs less than building the index.
+ *
+ *   The classification is done by AVX2 or SSE4.2 if the CPU supports them,
+ * otherwise by plain C. The choice is made at runtime.
+ *
+ * ****************************************************************************
+ */
+#ifndef STRUCT_INDEX_H
+#define STRUCT_INDEX_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t* pos;      /* the offsets, the last one being the json length */
+    uint32_t pos_num;   /* # of entries, including the terminating one. */
+    uint32_t capacity;  /* capacity of "pos" in # of entries */
+} struct_index_t;
+
+void si_init(struct_index_t*);
+void si_fini(struct_index_t*);
+
+/* Build the structural index for the given json, return 1 on success, 0
+ * on OOM. The buffer of the index is reused across calls.
+ */
+int si_build(struct_index_t*, const char* json, uint32_t len);
+
+/* Return the # of entries si_build() would make, without building the
+ * index.
+ */
+uint32_t si_count(const char* json, uint32_t len);
+
+/* Return the name of the implementation chosen for this CPU. */
+const char* si_impl_name(void);
+
+/* The bit tricks below work on the bitmaps of 64-byte blocks, bit i
+ * corresponding to the i-th byte. They are shared with sc_skip_composite().
+ */
+
+/* bit i of the result is the xor of bit 0..i of the input */
+static inline uint64_t
+prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/* Return the bitmap of the characters escaped by a backslash. "prev_escaped"
+ * carries, from block to block, whether the 1st byte of the next block is
+ * escaped.
+ */
+static inline uint64_t
+find_escaped(uint64_t bslash, uint64_t* prev_escaped) {
+    const uint64_t even_bits = 0x5555555555555555ULL;
+
+    bslash &= ~*prev_escaped;
+    uint64_t follows_escape = (bslash << 1) | *prev_escaped;
+
+    /* A run of backslashes starting at an odd position flips the parity */
+    uint64_t odd_seq_starts = bslash & ~even_bits & ~follows_escape;
+    uint64_t seq_starting_on_even;
+    *prev_escaped = __builtin_add_overflow(odd_seq_starts, bslash,
+                                           &seq_starting_on_even);
+
+    uint64_t invert_mask = seq_starting_on_even << 1;
+    return (even_bits ^ invert_mask) & follows_escape;
+}
+
+#endif
@@ -1,5 +1,5 @@
 package.cpath = package.cpath..";../?.so"
-package.path = package.cpath..";../?.lua"
+package.path = package.path..";../?.lua"
 
 local ljson_decoder = require 'json_decoder'
 local decoder = ljson_decoder.new()
@@ -42,11 +42,24 @@ end
 local test_fail_num = 0;
 local test_total = 0;
 
+-- The Lua C-API module, if it's built (make ljson_c.so)
+local has_c, ljson_c = pcall(require, 'ljson_c')
+local c_decoder = has_c and ljson_c.new()
+
 local function ljson_test(test_id, parser, input, expect)
     test_total = test_total + 1
     io.write(string.format("Testing %s ...", test_id))
     local result = decoder:decode(input)
-    if cmp_lua_var(result, expect) then
+
+    -- decode_tape(), decode_flat() and ljson_c should give the same result
+    local tape_result = decoder:decode_tape(input)
+    local flat_result = decoder:decode_flat(input)
+    local c_result = expect
+    if c_decoder then
+        c_result = c_decoder:decode(input)
+    end
+    if cmp_lua_var(result, expect) and cmp_lua_var(tape_result, expect) and
+       cmp_lua_var(flat_result, expect) and cmp_lua_var(c_result, expect) then
         print("succ!")
     else
         test_fail_num = test_fail_num + 1
@@ -94,6 +107,337 @@ input = string.format("[ %c]", 181)
 output = nil
 ljson_test("test8", json_parser, input, output);
 
+input = [=[{"a":[1, [2, [], {}], {"b":{"c":[null, 3.5]}}], "d":"e", "f":[[[]]]}]=]
+output = {a = {1, {2, {}, {}}, {b = {c = {nil, 3.5}}}}, d = "e", f = {{{}}}}
+ljson_test("test9", json_parser, input, output);
+
+input = [=["str"]=]
+output = "str"
+ljson_test("test10", json_parser, input, output);
+
+-- Strings with and without escapes, the latter are not copied by the parser.
+input = [=[{"k":"v", "k\u00e9":"a\"b", "":["", "\\", "xyz"]}]=]
+output = {k = "v", ["k\195\169"] = 'a"b', [""] = {"", "\\", "xyz"}}
+ljson_test("test11", json_parser, input, output);
+
+-- Feeding the JSON piece by piece should give the same result.
+do
+    test_total = test_total + 1
+    io.write("Testing feed/finish ...")
+
+    input = [=[{"a":[1, [2, [], {}], {"b":{"c":[null, 3.5]}}], "d":"e\u00e9"}]=]
+    output = {a = {1, {2, {}, {}}, {b = {c = {nil, 3.5}}}}, d = "e\195\169"}
+
+    local succ = true
+    for piece_len = 1, 8 do
+        for i = 1, #input, piece_len do
+            succ = succ and decoder:feed(input:sub(i, i + piece_len - 1))
+        end
+        succ = succ and cmp_lua_var(decoder:finish(), output)
+    end
+
+    local ok, err = decoder:feed("[1,}")
+    local result, err2 = decoder:finish()
+    if succ and not ok and err and not result and err2 then
+        print("succ!")
+    else
+        test_fail_num = test_fail_num + 1
+        print("failed!")
+    end
+end
+
+-- Validation should agree with decoding.
+do
+    test_total = test_total + 1
+    io.write("Testing validate ...")
+
+    local inputs = { [=[{"a":[1, {"b":"\u00e9"}], "c":-1.5e3}]=], "[1, 2",
+                     [=[{"a" 1}]=], "[true, nul]", "" }
+    local succ = true
+    for _, input in ipairs(inputs) do
+        local _, err = decoder:decode(input)
+        local ok, err2 = decoder:validate(input)
+        if (ok and err) or (not ok and err ~= err2) then
+            succ = false
+        end
+    end
+
+    if succ and decoder:validate(inputs[1]) then
+        print("succ!")
+    else
+        test_fail_num = test_fail_num + 1
+        print("failed!")
+    end
+end
+
+-- Only the values referred to by the JSON pointers are decoded.
+do
+    test_total = test_total + 1
+    io.write("Testing decode_paths ...")
+
+    input = [=[{"user":{"id":42, "tags":["x", "y"]}, "events":[{"type":"click"},
+               {"type":"view"}], "a/b":null, "skipped":[1, {"x":"]"}]}]=]
+    local paths = { "/user/id", "/events/1/type", "/user/tags", "/a~1b",
+                    "/events/2", "/user/tags/0" }
+    output = { 42, "view", {"x", "y"}, nil, nil, "x" }
+
+    local result = decoder:decode_paths(input, paths)
+    local bad, err = decoder:decode_paths('{"user":{"id" 1}}', { "/user/id" })
+    local bad2, err2 = decoder:decode_paths(input, { "user" })
+    if cmp_lua_var(result, output) and not bad and err and not bad2 and err2
+    then
+        print("succ!")
+    else
+        test_fail_num = test_fail_num + 1
+        print("failed!")
+    end
+end
+
+-- Nested arrays/hashtabs are left as their raw JSON by decode_shallow.
+do
+    test_total = test_total + 1
+    io.write("Testing decode_shallow ...")
+
+    input = [=[{"id":1, "tags":["x", "]"], "meta":{"a":{}} , "s":"str"}]=]
+    output = { id = 1, tags = '["x", "]"]', meta = '{"a":{}}', s = "str" }
+
+    local result = decoder:decode_shallow(input)
+    local raw = decoder:decode(result.tags)
+    local scalar = decoder:decode_shallow('"abc"')
+    local bad, err = decoder:decode_shallow('{"a":[1, 2}')
+    if cmp_lua_var(result, output) and cmp_lua_var(raw, {"x", "]"}) and
+       scalar == "abc" and not bad and err then
+        print("succ!")
+    else
+        test_fail_num = test_fail_num + 1
+        print("failed!")
+    end
+end
+
+-- The proxies of decode_lazy() should look like the tables of decode().
+do
+    test_total = test_total + 1
+    io.write("Testing decode_lazy ...")
+
+    input = [=[{"a":[1, {"b":"x"}, [2, 3]], "n":null, "s":"str"}]=]
+    local lazy = decoder:decode_lazy(input)
+    local a = lazy.a
+    local succ = a[1] == 1 and a[2].b == "x" and a[3][2] == 3 and
+                 a[4] == nil and a.x == nil and lazy.n == nil and
+                 lazy.s == "str" and lazy.c == nil and
+                 decoder.lazy_len(a) == 3 and decoder.lazy_len(lazy) == 3 and
+                 rawget(lazy, "a") == a and
+                 cmp_lua_var(decoder:materialize(lazy), decoder:decode(input))
+
+    -- not the index of an element, nor cached as such
+    succ = succ and a[1.5] == nil and a[2.9] == nil and
+           a[4294967297] == nil and rawget(a, 1.5) == nil
+
+    -- the first of the duplicated keys, unlike decode_tape()
+    local dup = ljson_decoder.new()
+    local dup_proxy = dup:decode_lazy('{"k":1, "k":2}')
+    succ = succ and dup_proxy.k == 1 and dup:materialize(dup_proxy).k == 2 and
+           dup:decode_tape('{"k":1, "k":2}').k == 2
+
+    -- the proxies of the last JSON are stale, except for what they cached
+    local lazy2 = decoder:decode_lazy('[[true]]')
+    succ = succ and lazy2[1][1] == true
+    local cached = pcall(function() return a[3] end)
+    local stale = pcall(function() return lazy.n end)
+    local bad, err = decoder:decode_lazy('{"a":}')
+    if succ and cached and not stale and not bad and err and
+       decoder:decode_lazy('"12"') == "12" then
+        print("succ!")
+    else
+        test_fail_num = test_fail_num + 1
+        print("failed!")
+    end
+end
+
+-- The interned keys should decode the same as the keys not interned.
+do
+    test_total = test_total + 1
+    io.write("Testing key interning ...")
+
+    input = [=[[{"id":1, "name":"a", "sub":{"id":2}},
+                {"id":3, "name":"b", "a_key_longer_than_24_bytes":4}]]=]
+    output = {{id = 1, name = "a", sub = {id = 2}},
+              {id = 3, name = "b", a_key_longer_than_24_bytes = 4}}
+
+    local decoder2 = ljson_decoder.new()
+    local first = decoder2:decode(input)
+    local again = decoder2:decode(input)
+    local tape = decoder2:decode_tape('{"name":"c", "new":5}')
+    decoder2:set_intern_keys(false)
+    local plain = decoder2:decode(input)
+    if cmp_lua_var(first, output) and cmp_lua_var(again, output) and
+       cmp_lua_var(plain, output) and cmp_lua_var(tape, {name="c", new=5})
+    then
+        print("succ!")
+    else
+        test_fail_num = test_fail_num + 1
+        print("failed!")
+    end
+end
+
+-- Each line of the NDJSON should be decoded as if it were decoded alone.
+do
+    test_total = test_total + 1
+    io.write("Testing decode_many ...")
+
+    input = '{"a":[1, {"b":null}]}\n"str"\nnull\n[[], {}]\n'
+    output = {{a = {1, {}}}, "str", nil, {{}, {}}}
+
+    local result, num = decoder:decode_many(input)
+    local empty, empty_num = decoder:decode_many("\n")
+    local bad, err = decoder:decode_many('{"a":1}\n{"a":}\n')
+    if num == 4 and cmp_lua_var(result, output) and empty_num == 0 and
+       next(empty) == nil and not bad and err then
+        print("succ!")
+    else
+        test_fail_num = test_fail_num + 1
+        print("failed!")
+    end
+end
+
+-- The null sentinel and the metatables of the arrays/hashtabs
+do
+    test_total = test_total + 1
+    io.write("Testing null sentinel and metatables ...")
+
+    local null = setmetatable({}, { __tostring = function() return "null" end })
+    local array_mt, hashtab_mt = {}, {}
+    input = [=[{"a":[1, null, []], "b":null, "c":{}, "d":[[{"e":[2]}]]}]=]
+
+    local function check(result)
+        return result and result.b == null and result.a[2] == null and
+               #result.a == 3 and getmetatable(result) == hashtab_mt and
+               getmetatable(result.a) == array_mt and
+               getmetatable(result.a[3]) == array_mt and
+               getmetatable(result.c) == hashtab_mt and
+               getmetatable(result.d[1]) == array_mt and
+               getmetatable(result.d[1][1]) == hashtab_mt and
+               getmetatable(result.d[1][1].e) == array_mt
+    end
+
+    local opt_decoder = ljson_decoder.new()
+    opt_decoder:set_null(null)
+    opt_decoder:set_metatables(array_mt, hashtab_mt)
+
+    local succ = check(opt_decoder:decode(input)) and
+                 check(opt_decoder:decode_tape(input)) and
+                 check(opt_decoder:decode_flat(input)) and
+                 check(opt_decoder:decode_many(input .. "\n" .. input)[2])
+    succ = succ and opt_decoder:decode("null ") == null
+
+    local many, num = opt_decoder:decode_many("null 1 null\n")
+    succ = succ and num == 3 and many[1] == null and many[3] == null
+
+    local proxy = opt_decoder:decode_lazy(input)
+    succ = succ and proxy.b == null and proxy.a[2] == null and
+           check(opt_decoder:materialize(proxy))
+
+    if c_decoder then
+        local c_opt = ljson_c.new()
+        c_opt:set_null(null)
+        c_opt:set_metatables(array_mt, hashtab_mt)
+        succ = succ and check(c_opt:decode(input)) and
+               c_opt:decode("null ") == null
+    end
+
+    -- back to the defaults
+    opt_decoder:set_null(nil)
+    opt_decoder:set_metatables(nil, nil)
+    local result = opt_decoder:decode(input)
+    succ = succ and result.b == nil and result.a[2] == nil and
+           result.a[3] ~= nil and getmetatable(result) == nil
+
+    if succ then
+        print("succ!")
+    else
+        test_fail_num = test_fail_num + 1
+        print("failed!")
+    end
+end
+
+-- The intermediate vector of decode() is empty after each call, reused for
+-- jsons of similar size, and shrunk after a run of much smaller jsons.
+do
+    test_total = test_total + 1
+    io.write("Testing cobj_vect reuse ...")
+
+    local elmts = {}
+    for i = 1, 1000 do
+        elmts[i] = [=[{"a":[1, {}]}]=]
+    end
+    local big = "[" .. table.concat(elmts, ",") .. "]"
+    local small = [=[[[1], {"a":{"b":[]}}]]=]
+    local small_out = {{1}, {a = {b = {}}}}
+
+    local vect_decoder = ljson_decoder.new()
+    local succ = #vect_decoder:decode(big) == 1000
+    local vect = vect_decoder.cobj_vect
+    if vect_decoder.c_decoder then
+        -- decode() is done by ljson_c with the JIT off, leaving the vector
+        -- alone.
+        succ = succ and vect[0] == 100 and next(vect, 0) == nil and
+               cmp_lua_var(vect_decoder:decode(small), small_out)
+    else
+        succ = succ and vect[0] >= 3002 and next(vect, 0) == nil
+
+        -- reused, even if it's a bit too large
+        local medium = "[" .. table.concat(elmts, ",", 1, 400) .. "]"
+        succ = succ and #vect_decoder:decode(medium) == 400
+        succ = succ and vect_decoder.cobj_vect == vect
+
+        for i = 1, 16 do
+            succ = succ and cmp_lua_var(vect_decoder:decode(small), small_out)
+        end
+        local new_vect = vect_decoder.cobj_vect
+        succ = succ and new_vect ~= vect and new_vect[0] < vect[0] and
+               next(new_vect, 0) == nil
+    end
+
+    if succ then
+        print("succ!")
+    else
+        test_fail_num = test_fail_num + 1
+        print("failed!")
+    end
+end
+
+-- Decoding jsons of similar size over and over again should not malloc.
+do
+    test_total = test_total + 1
+    io.write("Testing memory retention ...")
+
+    local elmts = {}
+    for i = 1, 1000 do
+        elmts[i] = [=[{"key":"value", "array":[1, 2, 3]}]=]
+    end
+    input = "[" .. table.concat(elmts, ",") .. "]"
+
+    decoder:decode(input)
+    local stats1 = decoder:mem_stats()
+    decoder:decode(input)
+    local stats2 = decoder:mem_stats()
+    decoder:trim_mem()
+    local stats3 = decoder:mem_stats()
+
+    -- ljson_c (see new()) parses to the tape leaving the strings in the
+    -- input, which takes no chunk but the first one.
+    local reused = stats2.chunk_reuse > stats1.chunk_reuse or
+                   decoder.c_decoder and stats2.result_size > 0
+
+    if stats1.chunk_malloc == stats2.chunk_malloc and reused and
+       stats2.retained == 0 and stats3.retained == 0 then
+        print("succ!")
+    else
+        test_fail_num = test_fail_num + 1
+        print("failed!")
+    end
+end
+
 io.write(string.format(
         "\n============================\nTotal test count %d, fail %d\n",
         test_total, test_fail_num))
@@ -295,6 +295,72 @@ JsonDumper::dump(const obj_t* obj) {
     _buf[_content_len] = '\0';
 }
 
+// Dump the object at the given entry of the tape, return the # of entries
+// it takes.
+uint32_t
+JsonDumper::dump_tape_entry(const jp_tape_t* entry) {
+    obj_ty_t ot = (obj_ty_t) entry->obj_ty;
+    if (ot <= OT_LAST_PRIMITIVE) {
+        obj_primitive_t obj;
+        obj.common.next = 0;
+        obj.common.obj_ty = ot;
+        obj.common.str_len = entry->str_len;
+        obj.int_val = entry->int_val;
+        dump_primitive(&obj.common);
+        return 1;
+    }
+
+    if (ot != OT_ARRAY && ot != OT_HASHTAB) {
+        append_str("(unknown tape entry)", 20);
+        return 1;
+    }
+
+    bool is_array = (ot == OT_ARRAY);
+    output_char(is_array ? '[' : '{');
+
+    uint32_t entry_num = 1;
+    for (int i = 0; i < entry->elmt_num; i++) {
+        if (i)
+            output_char((!is_array && (i & 1)) ? ':' : ',');
+        entry_num += dump_tape_entry(entry + entry_num);
+    }
+    output_char(is_array ? ']' : '}');
+
+    if (entry_num != entry->skip) {
+        fprintf(stderr, "tape entry seems to be corrupted\n");
+        append_str("(corrupted)", 11);
+    }
+
+    return entry->skip;
+}
+
+void
+JsonDumper::dump_tape(const jp_tape_t* tape) {
+    if (!_buf) {
+        _buf_len = 128;
+        _content_len = 0;
+        _buf = (char*)malloc(_buf_len);
+    }
+
+    dump_tape_entry(tape);
+    _buf[_content_len] = '\0';
+}
+
+void
+JsonDumper::dump_tape_many(const jp_tape_t* tape, uint32_t json_num) {
+    if (!_buf) {
+        _buf_len = 128;
+        _content_len = 0;
+        _buf = (char*)malloc(_buf_len);
+    }
+
+    for (uint32_t i = 0; i < json_num; i++) {
+        tape += dump_tape_entry(tape);
+        output_char('\n');
+    }
+    _buf[_content_len] = '\0';
+}
+
 void
 JsonDumper::output_char(char c) {
     resize(1);
@@ -15,7 +15,8 @@
 
 //////////////////////////////////////////////////////////////////////
 //
-// JsonDumper is for dumpping obj_t into a human-readable json format
+// JsonDumper is for dumpping obj_t (or the tape) into a human-readable json
+// format
 //
 //////////////////////////////////////////////////////////////////////
 //
@@ -25,6 +26,9 @@ public:
     ~JsonDumper() { free_buf(); }
 
     void dump(const obj_t* obj);
+    void dump_tape(const jp_tape_t* tape);
+    // Dump the result of jp_parse_many(), one json per line
+    void dump_tape_many(const jp_tape_t* tape, uint32_t json_num);
     const char* get_buf() { return _buf; }
     void free_buf();
 
@@ -34,6 +38,7 @@ private:
     void dump_hashtab(const obj_t*);
     void dump_array(const obj_t*);
     void dump_obj(const obj_t*);
+    uint32_t dump_tape_entry(const jp_tape_t*);
 
     void resize(uint32_t min_remain_sz);
     void output_char(char);
@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <string>
+#include <vector>
 
 #include "../ljson_parser.h"
 #include "test_util.h"
@@ -37,9 +38,29 @@ trim_space_both_ends(string& str) {
     }
 }
 
+// How test_driver() parses the input
+enum {
+    PARSE_LIST,     // jp_parse_ex()
+    PARSE_TAPE,     // jp_parse_tape()
+    PARSE_STREAM,   // jp_feed() one byte at a time, then jp_finish()
+    PARSE_VALIDATE, // jp_validate()
+};
+
+static const void*
+parse_stream(struct json_parser* parser, const string& input) {
+    for (size_t i = 0; i < input.size(); i++) {
+        if (!jp_feed(parser, input.c_str() + i, 1)) {
+            jp_finish(parser);
+            return 0;
+        }
+    }
+    return jp_finish(parser);
+}
+
 void
 test_driver(const char* test_spec_file, const char* message,
-            bool expect_fail = false) {
+            bool expect_fail = false, uint32_t parse_flags = 0,
+            int parse_mode = PARSE_LIST) {
     fprintf(stdout, "\n\n%s \n  (test-spec:%s)\n"
                     "========================================\n",
             message, test_spec_file);
@@ -63,7 +84,21 @@ test_driver(const char* test_spec_file, const char* message,
 
         string real_output;
 
-        obj_t* result = jp_parse(parser, input.c_str(), input.size());
+        const void* result;
+        if (parse_mode == PARSE_TAPE) {
+            result = jp_parse_tape(parser, input.c_str(), input.size(),
+                                   parse_flags);
+        } else if (parse_mode == PARSE_STREAM) {
+            result = parse_stream(parser, input);
+        } else if (parse_mode == PARSE_VALIDATE) {
+            // Nothing to dump, the input is all it takes
+            result = jp_validate(parser, input.c_str(), input.size(),
+                                 parse_flags) ? input.c_str() : 0;
+        } else {
+            result = jp_parse_ex(parser, input.c_str(), input.size(),
+                                 parse_flags);
+        }
+
         if (!result) {
             if (expect_fail) {
                 real_output = jp_get_err(parser);
@@ -72,9 +107,14 @@ test_driver(const char* test_spec_file, const char* message,
                 fail_num++;
                 continue;
             }
+        } else if (parse_mode == PARSE_VALIDATE) {
+            real_output = expect_fail ? "(valid)" : expect_output;
         } else {
             JsonDumper dumper;
-            dumper.dump(result);
+            if (parse_mode != PARSE_LIST)
+                dumper.dump_tape((const jp_tape_t*)result);
+            else
+                dumper.dump((const obj_t*)result);
             real_output = dumper.get_buf();
         }
 
@@ -98,6 +138,1356 @@ test_driver(const char* test_spec_file, const char* message,
     jp_destroy(parser);
 }
 
+// The inputs of test-spec files are one-liners. This function is to make
+// sure the location in diagnostic information is right for multi-line inputs,
+// and for whitespaces long enough to be skipped by vector instructions.
+static void
+test_err_location(uint32_t parse_flags, int parse_mode = PARSE_LIST) {
+    fprintf(stdout, "\n\nTest error location (flags:%u, mode:%d)\n"
+                    "========================================\n",
+            parse_flags, parse_mode);
+
+    static const struct {
+        const char* input;
+        const char* expect;
+    } cases[] = {
+        { "[1,\n  tru]", "(line:2,col:3) boolean value must be in lower case" },
+        { "[1,\r\n\n\n  \"\\q\"]", "(line:4,col:4) illegal escape \\q" },
+        { "[ \"\\u\",\"\"]", "(line:1,col:4) illegal escape \\u" },
+        { "{\n                                        \t\t  lol}",
+          "(line:2,col:45) Unrecognizable token" },
+        { "[\n  \n    \n      \n        \n          \n            Null]",
+          "(line:7,col:13) 'null' must be in lower case" },
+        { "[\"0123456789abcdef0123456789abcdef\tx\"]",
+          "(line:1,col:35) control character 0x09 must be escaped" },
+        { "[\"0123456789\x01\"]",
+          "(line:1,col:13) control character 0x01 must be escaped" },
+        { "[                                                        1] junk",
+          "(line:1,col:61) Unrecognizable token" },
+        // Truncated, with whitespaces at the end of input
+        { "{\"\":null\n\t", "(line:1,col:9) hashtab syntax error" },
+        { "{\"a\":1, ", "(line:1,col:7) Key must be a string" },
+        { "[1,\n ", "(line:1,col:4) Array syntax error, expect ',' or ']'" },
+    };
+
+    struct json_parser* parser = jp_create();
+    for (uint32_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++) {
+        test_num++;
+        fprintf(stdout, "Testing case:%3u ... ", i);
+
+        const char* input = cases[i].input;
+        const void* result;
+        if (parse_mode == PARSE_STREAM)
+            result = parse_stream(parser, input);
+        else if (parse_mode == PARSE_VALIDATE)
+            result = jp_validate(parser, input, strlen(input), parse_flags) ?
+                     input : 0;
+        else
+            result = jp_parse_ex(parser, input, strlen(input), parse_flags);
+
+        if (result) {
+            fprintf(stdout, "fail! expect error\n");
+            fail_num++;
+            continue;
+        }
+
+        const char* err = jp_get_err(parser);
+        if (strcmp(err, cases[i].expect)) {
+            fprintf(stdout, "fail!\n   >>>expect:%s\n   >>>got:%s\n",
+                    cases[i].expect, err);
+            fail_num++;
+            continue;
+        }
+        fprintf(stdout, "succ\n");
+    }
+    jp_destroy(parser);
+}
+
+// The test-spec files print floating point numbers with 8 digits only. This
+// function is to make sure the conversion is correctly rounded, i.e. bit-wise
+// identical to strtod(), for the cases known to be hard.
+static void
+test_fp_conversion() {
+    fprintf(stdout, "\n\nTest floating point conversion\n"
+                    "========================================\n");
+
+    static const char* cases[] = {
+        "0.1", "-0.0", "1.7976931348623157e308", "1.7976931348623159e308",
+        "1e400", "-1e400", "2.2250738585072011e-308",
+        "2.2250738585072012e-308", "4.9406564584124654e-324",
+        "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400",
+        "9007199254740993.0", "9007199254740992.5", "9007199254740993.0000001",
+        "123456789012345678901234567890e-30",
+        "7.0420557077594588669468784357561207962098443483187940792729600000e-59",
+        "2.470328229206232720882538e-324",
+        "3.1415926535897932384626433832795028841971",
+        "1.448997445238699", "1e23", "8.589973e9", "0.000001", "1e-7",
+        "179769313486231580793728971405303415079934132710037826936173778980444"
+        "968292764750946649017977587207096330286416692887910946555547851940402"
+        "630657488671505820681908902000708383676273854845817711531764475730270"
+        "069855571366959622842914819860834936475292719074168444365510704342711"
+        "559699508093042880177904174497791.9999999999999999999999999999999999",
+        "0.0000000000000000000000000000000000000000000000000000000000000000"
+        "0000000000000000000000000000000000000000000000000000000000000000"
+        "0000000000000000000000000000000000000000000000000000000000000000"
+        "0000000000000000000000000000000000000000000000000000000000000000"
+        "0000000000000000000000000000000000000000000000000000000000000024703"
+        "282292062327208828439643411068618252990130716238221279284125033775"
+        "363510437593264991818081799618989828234772285886546332835517796989"
+        "819938739800539093906315035659515570226392290858392449105184435931"
+        "802849936536152500319370457678249219365623669863658480757001585769"
+        "269903706311928279558551332927834338409351978015531246597263579574"
+        "622766465272827220056374006485499977096599470454020828166226237857"
+        "393450736339007967761930577506740176324673600968951340535537458516"
+        "661134223766678604162159680461914467291840300530057530849048765391"
+        "711386591646239524912623653881879636239373280423891018672348497668"
+        "235089863388587925628302755995657524455507255189313690836254779186"
+        "948667994968324049705821028513185451396213837722826145437693412532"
+        "098591327667236328125000001",
+    };
+
+    for (uint32_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++) {
+        test_num++;
+        fprintf(stdout, "Testing case:%3u ... ", i);
+
+        string input = string("[") + cases[i] + "]";
+        struct json_parser* parser = jp_create();
+        obj_t* result = jp_parse(parser, input.c_str(), input.size());
+        obj_composite_t* array = (obj_composite_t*)result;
+        if (!result || result->obj_ty != OT_ARRAY || !array->subobjs ||
+            array->subobjs->obj_ty != OT_FP) {
+            fprintf(stdout, "fail! expect a floating point number\n");
+            fail_num++;
+            jp_destroy(parser);
+            continue;
+        }
+
+        double got = ((obj_primitive_t*)array->subobjs)->db_val;
+        double expect = strtod(cases[i], 0);
+        jp_destroy(parser);
+
+        if (memcmp(&got, &expect, sizeof(double))) {
+            fprintf(stdout, "fail!\n   >>>expect:%.17g\n   >>>got:%.17g\n",
+                    expect, got);
+            fail_num++;
+            continue;
+        }
+        fprintf(stdout, "succ\n");
+    }
+}
+
+// The input is not necessarily NUL-terminated; make sure the scaner does not
+// look beyond the given length, by parsing the proper prefixes of valid jsons
+// whose remaining would make them valid again, e.g. "[2.5" of "[2.5e3]".
+static void
+test_bounded_input() {
+    fprintf(stdout, "\n\nTest inputs not terminated by NUL\n"
+                    "========================================\n");
+
+    static const char* cases[] = {
+        "[2.5e3]", "[-12E+2,0.125]", "[18446744073709551616]",
+        "{\"key\":1.7976931348623157e308}",
+    };
+
+    struct json_parser* parser = jp_create();
+    for (uint32_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++) {
+        test_num++;
+        fprintf(stdout, "Testing case:%3u ... ", i);
+
+        uint32_t len = strlen(cases[i]);
+        uint32_t prefix_len;
+        for (prefix_len = 1; prefix_len < len; prefix_len++) {
+            if (jp_parse(parser, cases[i], prefix_len))
+                break;
+        }
+
+        if (prefix_len != len) {
+            fprintf(stdout, "fail! prefix of length %u is accepted\n",
+                    prefix_len);
+            fail_num++;
+        } else if (!jp_parse(parser, cases[i], len)) {
+            fprintf(stdout, "fail! %s\n", jp_get_err(parser));
+            fail_num++;
+        } else {
+            fprintf(stdout, "succ\n");
+        }
+    }
+    jp_destroy(parser);
+}
+
+// Parsing jsons of similar size should reuse the memory of the previous
+// parsing instead of calling malloc() again.
+static void
+test_mem_retention() {
+    fprintf(stdout, "\n\nTest memory retention\n"
+                    "========================================\n");
+
+    string json = "[";
+    for (int i = 0; i < 2000; i++) {
+        if (i)
+            json += ",";
+        json += "{\"key\":\"value\", \"array\":[1,2,3]}";
+    }
+    json += "]";
+
+    struct json_parser* parser = jp_create();
+    jp_mem_stats_t stats1, stats2, stats3;
+
+    test_num++;
+    fprintf(stdout, "Testing steady state ... ");
+    jp_parse(parser, json.c_str(), json.size());
+    jp_parse(parser, json.c_str(), json.size());
+    jp_get_mem_stats(parser, &stats1);
+    jp_parse(parser, json.c_str(), json.size());
+    jp_get_mem_stats(parser, &stats2);
+    if (stats1.chunk_malloc == 1 ||
+        stats2.chunk_malloc != stats1.chunk_malloc ||
+        stats2.chunk_free != 0 || stats2.chunk_reuse <= stats1.chunk_reuse) {
+        fprintf(stdout, "fail! malloc:%lu->%lu free:%lu reuse:%lu->%lu\n",
+                (unsigned long)stats1.chunk_malloc,
+                (unsigned long)stats2.chunk_malloc,
+                (unsigned long)stats2.chunk_free,
+                (unsigned long)stats1.chunk_reuse,
+                (unsigned long)stats2.chunk_reuse);
+        fail_num++;
+    } else {
+        fprintf(stdout, "succ\n");
+    }
+
+    test_num++;
+    fprintf(stdout, "Testing trim ... ");
+    jp_parse(parser, "[1]", 3);
+    jp_get_mem_stats(parser, &stats2);
+    jp_trim_mem(parser);
+    jp_get_mem_stats(parser, &stats3);
+    if (stats2.retained == 0 || stats3.retained != 0 ||
+        stats3.chunk_free == stats2.chunk_free) {
+        fprintf(stdout, "fail! retained:%u->%u\n", stats2.retained,
+                stats3.retained);
+        fail_num++;
+    } else {
+        fprintf(stdout, "succ\n");
+    }
+
+    test_num++;
+    fprintf(stdout, "Testing retain limit ... ");
+    jp_set_mem_retain(parser, 0);
+    jp_parse(parser, json.c_str(), json.size());
+    jp_parse(parser, json.c_str(), json.size());
+    jp_get_mem_stats(parser, &stats1);
+    jp_parse(parser, json.c_str(), json.size());
+    jp_get_mem_stats(parser, &stats2);
+    if (stats2.retained != 0 ||
+        stats2.chunk_malloc - stats1.chunk_malloc !=
+        stats2.chunk_free - stats1.chunk_free) {
+        fprintf(stdout, "fail! retained:%u\n", stats2.retained);
+        fail_num++;
+    } else {
+        fprintf(stdout, "succ\n");
+    }
+
+    jp_destroy(parser);
+
+    // The chunks should grow geometrically for large jsons, whether they are
+    // backed by huge pages or not.
+    string big_json = "[";
+    for (int i = 0; i < 100000; i++) {
+        if (i)
+            big_json += ",";
+        big_json += "{\"key\":\"value\", \"array\":[1,2,3]}";
+    }
+    big_json += "]";
+
+    for (int huge_page = 0; huge_page < 2; huge_page++) {
+        test_num++;
+        fprintf(stdout, "Testing chunk growth (huge page:%d) ... ", huge_page);
+
+        parser = jp_create();
+        jp_set_mem_chunk(parser, 8 * 1024 * 1024, huge_page);
+        obj_t* obj = jp_parse(parser, big_json.c_str(), big_json.size());
+        jp_get_mem_stats(parser, &stats1);
+        jp_destroy(parser);
+
+        if (!obj || stats1.chunk_malloc > 16) {
+            fprintf(stdout, "fail! %lu chunks\n",
+                    (unsigned long)stats1.chunk_malloc);
+            fail_num++;
+        } else {
+            fprintf(stdout, "succ\n");
+        }
+    }
+
+    // With the structural index, JP_PREALLOC knows the upper bound of the
+    // memory, which is allocated in one chunk.
+    test_num++;
+    fprintf(stdout, "Testing preallocation ... ");
+    parser = jp_create();
+    obj_t* obj = jp_parse_ex(parser, big_json.c_str(), big_json.size(),
+                             JP_PREALLOC | JP_STRUCT_INDEX);
+    jp_get_mem_stats(parser, &stats1);
+    jp_destroy(parser);
+    if (!obj || stats1.chunk_malloc != 2) {
+        fprintf(stdout, "fail! %lu chunks\n",
+                (unsigned long)stats1.chunk_malloc);
+        fail_num++;
+    } else {
+        fprintf(stdout, "succ\n");
+    }
+
+    // An array of n integers takes n + 1 entries of the tape, and nothing
+    // else, which is less than the linked lists take.
+    test_num++;
+    fprintf(stdout, "Testing result size ... ");
+    string int_json = "[";
+    for (int i = 0; i < 1000; i++) {
+        if (i)
+            int_json += ",";
+        int_json += "12345";
+    }
+    int_json += "]";
+
+    parser = jp_create();
+    jp_parse(parser, int_json.c_str(), int_json.size());
+    jp_get_mem_stats(parser, &stats1);
+    const jp_tape_t* tape = jp_parse_tape(parser, int_json.c_str(),
+                                          int_json.size(), 0);
+    jp_get_mem_stats(parser, &stats2);
+    jp_destroy(parser);
+    if (!tape || stats2.result_size != 1001 * sizeof(jp_tape_t) ||
+        stats1.result_size <= stats2.result_size) {
+        fprintf(stdout, "fail! list:%lu tape:%lu\n",
+                (unsigned long)stats1.result_size,
+                (unsigned long)stats2.result_size);
+        fail_num++;
+    } else {
+        fprintf(stdout, "succ\n");
+    }
+}
+
+// jp_validate() should agree with jp_parse() on whether the input is
+// well-formed, and on the error message if it is not.
+static void
+test_validate() {
+    fprintf(stdout, "\n\nTest validation\n"
+                    "========================================\n");
+
+    string deep = string(1000, '[') + string(1000, ']');
+    string deep_hashtab;
+    for (int i = 0; i < 300; i++)
+        deep_hashtab += "{\"k\":[";
+    deep_hashtab += "1";
+    for (int i = 0; i < 300; i++)
+        deep_hashtab += "]}";
+
+    string inputs[] = {
+        deep, deep_hashtab, deep.substr(0, 1999), deep + "]",
+        deep_hashtab.substr(0, deep_hashtab.size() - 2) + "}]",
+        "[1.]", "[-]", "[1e]", "[1e+]", "[-0.5e-3, 01, 1E6]", "[.5]",
+        "[1.5x]", "{\"a\":1,}", "{\"a\" 1}", "{1:2}", "[\"\\ud800\"]",
+        "[\"\\ud83d\\ude00\\u00e9\\n\"]", "\"str\"", "12", "12 ",
+        "  ", "[nul]", "[true, false, null]", "[1]]", "{\"a\":[}]",
+    };
+
+    struct json_parser* parser = jp_create();
+    for (uint32_t i = 0; i < sizeof(inputs)/sizeof(inputs[0]); i++) {
+        for (uint32_t flags = 0; flags <= JP_STRUCT_INDEX; flags++) {
+            test_num++;
+            fprintf(stdout, "Testing case:%3u (flags:%u) ... ", i, flags);
+
+            const string& input = inputs[i];
+            bool expect = jp_parse_ex(parser, input.c_str(), input.size(),
+                                      flags);
+            string expect_err = expect ? "" : jp_get_err(parser);
+
+            bool valid = jp_validate(parser, input.c_str(), input.size(),
+                                     flags);
+            string err = valid ? "" : jp_get_err(parser);
+            if (valid != expect || err.compare(expect_err)) {
+                fprintf(stdout, "fail! expect:%d(%s) got:%d(%s)\n", expect,
+                        expect_err.c_str(), valid, err.c_str());
+                fail_num++;
+            } else {
+                fprintf(stdout, "succ\n");
+            }
+        }
+    }
+    jp_destroy(parser);
+}
+
+// Dump the values picked by jp_parse_paths(), one per line
+static string
+dump_paths(const jp_tape_t* const* values, uint32_t num) {
+    string result;
+    for (uint32_t i = 0; i < num; i++) {
+        if (values[i]) {
+            JsonDumper dumper;
+            dumper.dump_tape(values[i]);
+            result += dumper.get_buf();
+        } else {
+            result += "(none)";
+        }
+        result += "\n";
+    }
+    return result;
+}
+
+static void
+test_paths() {
+    fprintf(stdout, "\n\nTest JSON pointers\n"
+                    "========================================\n");
+
+    const char* json =
+        "{\"user\":{\"id\":42, \"name\":\"a\\\"b\", \"tags\":[\"x\", \"y\"]},\n"
+        " \"a/b\":1, \"m~n\":2,\n"
+        " \"events\":[{\"type\":\"click\", \"ts\":1},\n"
+        "            {\"type\":\"view\", \"skip\":[{\"x\":\"]}\"}]}, 3],\n"
+        " \"\":0, \"dup\":1, \"dup\":2, \"meta\":{\"v\":\"1.0\"}}";
+
+    struct json_parser* parser = jp_create();
+    string whole;
+    {
+        JsonDumper dumper;
+        dumper.dump_tape(jp_parse_tape(parser, json, strlen(json), 0));
+        whole = dumper.get_buf();
+    }
+
+    const struct {
+        const char* path;
+        string expect;
+    } cases[] = {
+        { "/user/id", "42" },
+        { "/user/tags", "[\"x\",\"y\"]" },
+        { "/user/tags/1", "\"y\"" },
+        { "/a~1b", "1" },
+        { "/m~0n", "2" },
+        { "/events/0/type", "\"click\"" },
+        { "/events/1/skip/0/x", "\"]}\"" },
+        { "/events/2", "3" },
+        { "/events/3", "(none)" },
+        { "/events/01", "(none)" },
+        { "/events/-", "(none)" },
+        { "/", "0" },
+        { "/dup", "1" },
+        { "/user/id/x", "(none)" },
+        { "/meta/v", "\"1.0\"" },
+        { "/nope", "(none)" },
+        { "", whole },
+    };
+    const uint32_t case_num = sizeof(cases)/sizeof(cases[0]);
+
+    // Each pointer alone, then all of them at once
+    const char* paths[case_num];
+    string expect_all;
+    for (uint32_t i = 0; i <= case_num; i++) {
+        uint32_t num = (i == case_num) ? case_num : 1;
+        const char** ptrs = (i == case_num) ? paths : &paths[i];
+        string expect;
+        if (i < case_num) {
+            paths[i] = cases[i].path;
+            expect = cases[i].expect + "\n";
+            expect_all += expect;
+        } else {
+            expect = expect_all;
+        }
+
+        for (uint32_t flags = 0; flags <= JP_ZERO_COPY; flags += JP_ZERO_COPY) {
+            test_num++;
+            fprintf(stdout, "Testing \"%s\" (flags:%u) ... ",
+                    i < case_num ? cases[i].path : "(all)", flags);
+
+            const jp_tape_t* const* values =
+                jp_parse_paths(parser, json, strlen(json), flags, ptrs, num);
+            if (!values) {
+                fprintf(stdout, "fail! %s\n", jp_get_err(parser));
+                fail_num++;
+                continue;
+            }
+
+            string result = dump_paths(values, num);
+            if (result.compare(expect)) {
+                fprintf(stdout, "fail!\n   >>>expect:%s   >>>got:%s",
+                        expect.c_str(), result.c_str());
+                fail_num++;
+            } else {
+                fprintf(stdout, "succ\n");
+            }
+        }
+    }
+
+    // Malformed json on the way to the values is reported as jp_parse_tape()
+    // does, the one off the way is not looked into.
+    const struct {
+        const char* json;
+        const char* path;
+        bool valid;
+    } errs[] = {
+        { "{\"user\":{\"id\" 42}}", "/user/id", false },
+        { "{\"user\":{\"id\":}}", "/user/id", false },
+        { "{\"user\":{\"id\":4x}}", "/user/id", false },
+        { "{\"user\":[1, 2}", "/user/5", false },
+        { "{\"user\":[", "/user/0", false },
+        { "{\"a\":1,\n \"b\": [\n1,\n2],\n \"c\":{\"d\" 1}}", "/c/d", false },
+        { "{\"a\":[1,\n2], \"b\":nul}", "/b", false },
+        { "{\"a\":[1,,{2:}], \"b\":3}", "/b", true },
+        { "[1, 2] x", "/0", true },
+    };
+    for (uint32_t i = 0; i < sizeof(errs)/sizeof(errs[0]); i++) {
+        test_num++;
+        fprintf(stdout, "Testing malformed json %u ... ", i);
+
+        const char* input = errs[i].json;
+        const char* path = errs[i].path;
+        string expect_err;
+        if (!errs[i].valid) {
+            jp_parse_tape(parser, input, strlen(input), 0);
+            expect_err = jp_get_err(parser);
+        }
+
+        const jp_tape_t* const* values =
+            jp_parse_paths(parser, input, strlen(input), 0, &path, 1);
+        string err = values ? "" : jp_get_err(parser);
+        if ((values != 0) != errs[i].valid || err.compare(expect_err)) {
+            fprintf(stdout, "fail! expect:%s got:%s\n", expect_err.c_str(),
+                    err.c_str());
+            fail_num++;
+        } else {
+            fprintf(stdout, "succ\n");
+        }
+    }
+
+    // Malformed pointers, and an array not closed off the way
+    const char* bad_paths[] = { "user", "/a~2", "/b" };
+    const char* unclosed = "{\"a\":[1, {\"b\":2}, \"b\":3";
+    for (uint32_t i = 0; i < sizeof(bad_paths)/sizeof(bad_paths[0]); i++) {
+        test_num++;
+        fprintf(stdout, "Testing bad input %u ... ", i);
+        if (jp_parse_paths(parser, unclosed, strlen(unclosed), 0,
+                           &bad_paths[i], 1)) {
+            fprintf(stdout, "fail!\n");
+            fail_num++;
+        } else {
+            fprintf(stdout, "succ (%s)\n", jp_get_err(parser));
+        }
+    }
+
+    jp_destroy(parser);
+}
+
+// jp_skip_value() should tell where the value ends, wherever the strings,
+// escapes and brackets fall in the 64-byte blocks.
+static void
+test_skip() {
+    fprintf(stdout, "\n\nTest skipping values\n"
+                    "========================================\n");
+
+    string tricky = "{\"k\\\\\":\"]}\\\"[\", \"\\\\\\\\\":[{}, \"\\\\\"], \"n\":\n"
+                    "  [1.5, null, true, \"\\u005d\"]}";
+    bool succ = true;
+    for (uint32_t pad = 0; pad < 140 && succ; pad++) {
+        string value = " \n[" + string(pad, ' ') + tricky + "," +
+                       string(pad % 7, 'x') + "\"" + string(pad, '\\') +
+                       string(pad, '\\') + "\"]";
+        string input = value + " ,[\"junk\"]";
+        succ = (jp_skip_value(input.c_str(), input.size()) == value.size()) &&
+               (jp_skip_value(value.c_str(), value.size() - 1) == 0);
+    }
+
+    const struct {
+        const char* input;
+        uint32_t len;
+    } cases[] = {
+        { "  \"a\\\"b\\\\\" ,", 10 }, { "-12.5e3]", 7 }, { "true}", 4 },
+        { "[[]] []", 4 }, { "{\"a\":{}}", 8 }, { "\"abc", 0 }, { "[[]", 0 },
+        { "   ", 0 }, { ",", 0 },
+    };
+    for (uint32_t i = 0; i < sizeof(cases)/sizeof(cases[0]) && succ; i++) {
+        succ = jp_skip_value(cases[i].input, strlen(cases[i].input)) ==
+               cases[i].len;
+    }
+
+    test_num++;
+    fprintf(stdout, "Testing jp_skip_value ... %s\n", succ ? "succ" : "fail!");
+    if (!succ)
+        fail_num++;
+
+    // Only the out-most object is parsed by jp_parse_shallow()
+    const char* json = "{\"a\":1, \"b\":{\"c\":[1, 2]}, \"d\":[{\"e\":\"]\"}],"
+                       " \"f\":\"s\"}";
+    const char* raw[] = { "{\"c\":[1, 2]}", "[{\"e\":\"]\"}]" };
+
+    struct json_parser* parser = jp_create();
+    test_num++;
+    fprintf(stdout, "Testing jp_parse_shallow ... ");
+    const jp_tape_t* tape = jp_parse_shallow(parser, json, strlen(json), 0);
+    succ = tape && tape[0].obj_ty == OT_HASHTAB && tape[0].elmt_num == 8 &&
+           tape[0].skip == 9;
+    for (uint32_t i = 0; i < 2 && succ; i++) {
+        const jp_tape_t* entry = tape + 4 + i * 2;
+        succ = entry->obj_ty == OT_STR &&
+               entry->flags == (OF_RAW | OF_BORROWED) &&
+               string(entry->str_val, entry->str_len) == raw[i];
+    }
+    succ = succ && tape[2].obj_ty == OT_INT64 && tape[8].obj_ty == OT_STR &&
+           !(tape[8].flags & OF_RAW);
+
+    // Nothing nested in a primitive or an empty object
+    succ = succ && jp_parse_shallow(parser, "[]", 2, 0) &&
+           jp_parse_shallow(parser, "\"[]\"", 4, 0)[0].obj_ty == OT_STR;
+    fprintf(stdout, "%s\n", succ ? "succ" : "fail!");
+    if (!succ)
+        fail_num++;
+
+    // The errors after the raw objects are located as jp_parse_tape() does
+    string nested = "[";
+    for (int i = 0; i < 20; i++)
+        nested += "{\"k\":\"v\\\"\",\n \"a\":[1, 2]},";
+    nested += "{}]";
+
+    const string bad[] = {
+        "{\"a\":" + nested + ",\n\"b\" 1}",
+        "{\"a\":" + nested + ",\n\"b\":1,}",
+        "[" + nested + "\n" + nested + "]",
+        "[" + nested,
+    };
+    for (uint32_t i = 0; i < sizeof(bad)/sizeof(bad[0]); i++) {
+        test_num++;
+        fprintf(stdout, "Testing malformed json %u ... ", i);
+
+        jp_parse_tape(parser, bad[i].c_str(), bad[i].size(), 0);
+        string expect = jp_get_err(parser);
+        string err = "(none)";
+        if (!jp_parse_shallow(parser, bad[i].c_str(), bad[i].size(), 0))
+            err = jp_get_err(parser);
+
+        // The one not closed is not looked into
+        if (i == 3 && err.find("not closed") != string::npos)
+            expect = err;
+
+        if (err.compare(expect)) {
+            fprintf(stdout, "fail! expect:%s got:%s\n", expect.c_str(),
+                    err.c_str());
+            fail_num++;
+        } else {
+            fprintf(stdout, "succ\n");
+        }
+    }
+    jp_destroy(parser);
+}
+
+// jp_hashtab_get() and jp_array_get() should find the same values as walking
+// the tape does.
+static void
+test_tape_lookup() {
+    fprintf(stdout, "\n\nTest looking up values on the tape\n"
+                    "========================================\n");
+
+    const char* json = "{\"a\":[1, [2, 3], {\"x\":null}, 4], \"ab\":{}, "
+                       "\"b\":[5, 6, 7], \"a\\u0000\":\"s\"}";
+    struct json_parser* parser = jp_create();
+    const jp_tape_t* tape = jp_parse_tape(parser, json, strlen(json), 0);
+
+    test_num++;
+    fprintf(stdout, "Testing jp_hashtab_get/jp_array_get ... ");
+    const jp_tape_t* a = jp_hashtab_get(tape, "a", 1);
+    const jp_tape_t* b = jp_hashtab_get(tape, "b", 1);
+    bool succ = a == tape + 2 && b && b->obj_ty == OT_ARRAY &&
+                jp_hashtab_get(tape, "ab", 2)->obj_ty == OT_HASHTAB &&
+                jp_hashtab_get(tape, "a\0", 2)->obj_ty == OT_STR &&
+                !jp_hashtab_get(tape, "c", 1) && !jp_hashtab_get(a, "a", 1);
+
+    // elements of arrays with and without nested objects
+    const jp_tape_t* a3 = jp_array_get(a, 3);
+    const jp_tape_t* a2 = jp_array_get(a, 2);
+    succ = succ && jp_array_get(a, 0)->int_val == 1 &&
+           jp_array_get(jp_array_get(a, 1), 1)->int_val == 3 &&
+           a3 && a3->int_val == 4 && a2 && a2->obj_ty == OT_HASHTAB &&
+           jp_hashtab_get(a2, "x", 1)->obj_ty == OT_NULL &&
+           !jp_array_get(a, 4) && jp_array_get(b, 2)->int_val == 7 &&
+           !jp_array_get(b, 3) && !jp_array_get(tape, 0);
+
+    fprintf(stdout, "%s\n", succ ? "succ" : "fail!");
+    if (!succ)
+        fail_num++;
+
+    // The indexed lookup should agree with walking the keys, including the
+    // duplicated keys, and the hashtabs not indexed.
+    for (uint32_t key_num = 1; key_num <= 300; key_num = key_num * 3 + 1) {
+        string input = "{";
+        for (uint32_t i = 0; i < key_num; i++) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%s\"key%u%s\":%s", i ? "," : "",
+                     i % (key_num / 2 + 1), string(i % 13, '_').c_str(),
+                     i % 5 ? "{\"a\":1, \"b\":[2]}" : "3");
+            input += buf;
+        }
+        input += "}";
+
+        test_num++;
+        fprintf(stdout, "Testing JP_KEY_INDEX with %u keys ... ", key_num);
+        vector<ptrdiff_t> expect;
+        vector<string> keys;
+        const jp_tape_t* plain = jp_parse_tape(parser, input.c_str(),
+                                               input.size(), 0);
+        for (uint32_t i = 0; i <= key_num; i++) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "key%u%s", i % (key_num / 2 + 1),
+                     string(i % 13, '_').c_str());
+            keys.push_back(buf);
+            const jp_tape_t* val = jp_hashtab_get(plain, buf, strlen(buf));
+            expect.push_back(val ? val - plain : -1);
+        }
+
+        const jp_tape_t* indexed = jp_parse_tape(parser, input.c_str(),
+                                                 input.size(), JP_KEY_INDEX);
+        succ = indexed && (indexed->key_index != 0) == (key_num >= 16);
+        for (uint32_t i = 0; i <= key_num && succ; i++) {
+            const jp_tape_t* val = jp_hashtab_get(indexed, keys[i].c_str(),
+                                                  keys[i].size());
+            succ = (val ? val - indexed : -1) == expect[i];
+        }
+
+        fprintf(stdout, "%s\n", succ ? "succ" : "fail!");
+        if (!succ)
+            fail_num++;
+    }
+
+    jp_destroy(parser);
+}
+
+// The nodes of jp_parse_flat() should be the entries of the tape.
+static void
+test_flat() {
+    fprintf(stdout, "\n\nTest the structure of arrays\n"
+                    "========================================\n");
+
+    const char* json = "{\"a\":[1, 2.5, true, null, \"s\"], \"b\":{}}";
+    struct json_parser* parser = jp_create();
+    test_num++;
+    fprintf(stdout, "Testing jp_parse_flat ... ");
+
+    const jp_flat_t* flat = jp_parse_flat(parser, json, strlen(json),
+                                          JP_INTERN_KEYS);
+    const uint8_t tags[] = { OT_HASHTAB, OT_STR, OT_ARRAY, OT_INT64, OT_FP,
+                             OT_BOOL, OT_NULL, OT_STR, OT_STR, OT_HASHTAB };
+    bool succ = flat && flat->num == 10;
+    for (uint32_t i = 0; i < 10 && succ; i++)
+        succ = flat->tags[i] == tags[i];
+
+    succ = succ && flat->lens[0] == 4 && flat->lens[2] == 5 &&
+           flat->lens[9] == 0 && flat->slots[1] == 1 && flat->slots[8] == 2 &&
+           flat->slots[7] == 0 && flat->ints[3] == 1 && flat->dbls[4] == 2.5 &&
+           flat->ints[5] == 1 && flat->lens[7] == 1 &&
+           !memcmp(flat->strs[7], "s", 1);
+
+    // a primitive takes a single node, and errors are reported as usual
+    flat = jp_parse_flat(parser, "\"x\" ", 4, 0);
+    succ = succ && flat && flat->num == 1 && flat->tags[0] == OT_STR &&
+           !jp_parse_flat(parser, "[1,]", 4, 0);
+
+    fprintf(stdout, "%s\n", succ ? "succ" : "fail!");
+    if (!succ)
+        fail_num++;
+
+    jp_destroy(parser);
+}
+
+// With JP_INTERN_KEYS, the same key should get the same slot across calls,
+// be it parsed to the linked lists or to the tape.
+static void
+test_intern_keys() {
+    fprintf(stdout, "\n\nTest interning keys\n"
+                    "========================================\n");
+
+    const char* json = "[{\"id\":1, \"name\":\"a\", \"tags\":{\"id\":\"x\"}},"
+                       " {\"name\":\"b\", \"a_key_longer_than_24_bytes\":2}]";
+    struct json_parser* parser = jp_create();
+    test_num++;
+    fprintf(stdout, "Testing JP_INTERN_KEYS ... ");
+
+    // keys on the tape: id, name, tags, id, name, a_key...
+    const uint32_t key_idx[] = { 2, 4, 6, 8, 11, 13 };
+    const uint32_t expect[] = { 1, 2, 3, 1, 2, 0 };
+    const jp_tape_t* tape = jp_parse_tape(parser, json, strlen(json),
+                                          JP_INTERN_KEYS | JP_ZERO_COPY);
+    bool succ = tape != 0;
+    for (uint32_t i = 0; i < 6 && succ; i++) {
+        const jp_tape_t* key = tape + key_idx[i];
+        succ = key->obj_ty == OT_STR && JP_KEY_SLOT(key->flags) == expect[i] &&
+               (key->flags & OF_BORROWED);
+    }
+
+    // The values are not interned, nor the keys without the flag
+    succ = succ && tape[5].flags == OF_BORROWED;
+    tape = jp_parse_tape(parser, json, strlen(json), 0);
+    succ = succ && tape && tape[2].flags == 0;
+
+    // The linked lists: the 1st hashtab is {"id":1, "name":"a", "tags":...},
+    // whose keys are in reverse order.
+    const char* json2 = "{\"new\":1, \"name\":2, \"id\":3}";
+    obj_t* obj = jp_parse_ex(parser, json2, strlen(json2), JP_INTERN_KEYS);
+    if (succ && obj && obj->obj_ty == OT_HASHTAB) {
+        const uint32_t expect2[] = { 1, 2, 4 };
+        obj_t* elmt = ((obj_composite_t*)obj)->subobjs;
+        for (uint32_t i = 0; i < 3 && succ; i++) {
+            elmt = elmt->next;
+            succ = JP_KEY_SLOT(elmt->flags) == expect2[i];
+            elmt = elmt->next;
+        }
+    } else {
+        succ = false;
+    }
+
+    // Once the slots are used up, the new keys are not interned
+    string many = "{";
+    for (int i = 0; i < 5000; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%s\"k%d\":0", i ? "," : "", i);
+        many += buf;
+    }
+    many += "}";
+    tape = jp_parse_tape(parser, many.c_str(), many.size(), JP_INTERN_KEYS);
+    succ = succ && tape && JP_KEY_SLOT(tape[1].flags) == 5 &&
+           JP_KEY_SLOT(tape[2 * 4090 + 1].flags) == 4095 &&
+           JP_KEY_SLOT(tape[2 * 4091 + 1].flags) == 0;
+
+    fprintf(stdout, "%s\n", succ ? "succ" : "fail!");
+    if (!succ)
+        fail_num++;
+
+    jp_destroy(parser);
+}
+
+// With JP_ZERO_COPY, the strings free of escapes should point into the input,
+// and the others should be copied as usual.
+static void
+test_zero_copy() {
+    fprintf(stdout, "\n\nTest zero-copy strings\n"
+                    "========================================\n");
+
+    string long_str(100, 'x');
+    string json = "{\"key\":\"" + long_str + "\", \"k\\u00e9y\":\"a\\nb\", "
+                  "\"\":[\"\", \"" + long_str + "\\t\", 1]}";
+    const char* json_b = json.c_str();
+    const char* json_e = json_b + json.size();
+
+    struct json_parser* parser = jp_create();
+    for (int flags = 0; flags <= JP_ZERO_COPY; flags += JP_ZERO_COPY) {
+        for (int tape = 0; tape < 2; tape++) {
+            test_num++;
+            fprintf(stdout, "Testing %s (flags:%d) ... ",
+                    tape ? "tape" : "list", flags);
+
+            // Collect the strings as (str_val, str_len, flags)
+            vector<jp_tape_t> strs;
+            if (tape) {
+                const jp_tape_t* entries = jp_parse_tape(parser, json_b,
+                                                         json.size(), flags);
+                for (uint32_t i = 0; entries && i < entries[0].skip; i++) {
+                    if (entries[i].obj_ty == OT_STR)
+                        strs.push_back(entries[i]);
+                }
+            } else {
+                obj_t* obj = jp_parse_ex(parser, json_b, json.size(), flags);
+                for (obj_composite_t* cobj = (obj_composite_t*)obj; cobj;
+                     cobj = cobj->reverse_nesting_order) {
+                    for (obj_t* e = cobj->subobjs; e; e = e->next) {
+                        if (e->obj_ty != OT_STR)
+                            continue;
+                        jp_tape_t entry;
+                        entry.obj_ty = e->obj_ty;
+                        entry.flags = e->flags;
+                        entry.str_len = e->str_len;
+                        entry.str_val = ((obj_primitive_t*)e)->str_val;
+                        strs.push_back(entry);
+                    }
+                }
+            }
+
+            // "key", long_str and the two "" are free of escapes
+            uint32_t borrowed = 0;
+            bool succ = (strs.size() == 7);
+            for (uint32_t i = 0; succ && i < strs.size(); i++) {
+                const char* str = strs[i].str_val;
+                bool inside = (str >= json_b && str < json_e);
+                if (strs[i].flags & OF_BORROWED) {
+                    borrowed++;
+                    succ = inside && str + strs[i].str_len < json_e &&
+                           str[strs[i].str_len] == '"';
+                } else {
+                    succ = !inside && str[strs[i].str_len] == '\0';
+                }
+            }
+
+            if (!succ || borrowed != (flags ? 4 : 0)) {
+                fprintf(stdout, "fail! %u strings, %u borrowed\n",
+                        (uint32_t)strs.size(), borrowed);
+                fail_num++;
+            } else {
+                fprintf(stdout, "succ\n");
+            }
+        }
+    }
+    jp_destroy(parser);
+}
+
+// The strings are copied to the mempool a vector at a time, leaving room for
+// the escapes. Place the escapes at every offset around the end of a chunk,
+// by sweeping the string ahead of them across the first chunk of mempool.
+static void
+test_str_chunk_end() {
+    fprintf(stdout, "\n\nTest escapes at the end of mempool chunk\n"
+                    "========================================\n");
+
+    static const struct {
+        const char* esc;
+        const char* utf8;
+    } cases[] = {
+        { "\\n", "\n" },
+        { "\\u00e9", "\xc3\xa9" },
+        { "\\u4e2d", "\xe4\xb8\xad" },
+        { "\\ud83d\\ude00", "\xf0\x9f\x98\x80" },
+    };
+
+    struct json_parser* parser = jp_create();
+    for (uint32_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++) {
+        test_num++;
+        fprintf(stdout, "Testing %s ... ", cases[i].esc);
+
+        // The mempool allocates 8-byte aligned, and so does the string start.
+        // Each escape lands on every offset of a vector, by "lead" and "mid"
+        // plain bytes ahead of it.
+        bool succ = true;
+        for (uint32_t pad = 0; pad < 4500 && succ; pad += 8) {
+            for (uint32_t k = 0; k < 8 * 40 && succ; k++) {
+                uint32_t lead = k % 8, mid = k / 8;
+                // plain bytes, the escape, plain bytes, a surrogate pair
+                string json = "[\"" + string(pad, 'p') + "\", \"" +
+                              string(lead, 'a') + cases[i].esc +
+                              string(mid, 'b') + "\\ud83d\\ude00c\"]";
+                string expect = string(lead, 'a') + cases[i].utf8 +
+                                string(mid, 'b') + "\xf0\x9f\x98\x80" +
+                                "c";
+
+                const jp_tape_t* tape = jp_parse_tape(parser, json.c_str(),
+                                                      json.size(), 0);
+                succ = tape && tape[2].obj_ty == OT_STR &&
+                       expect.compare(0, string::npos, tape[2].str_val,
+                                      tape[2].str_len) == 0;
+                if (!succ) {
+                    fprintf(stdout, "fail! pad:%u lead:%u mid:%u\n", pad,
+                            lead, mid);
+                    fail_num++;
+                }
+            }
+        }
+
+        if (succ)
+            fprintf(stdout, "succ\n");
+    }
+    jp_destroy(parser);
+}
+
+// Feed a json of long strings, numbers, escapes and whitespaces in pieces of
+// various sizes, the result should be the same as jp_parse_tape()'s.
+static void
+test_stream() {
+    fprintf(stdout, "\n\nTest streaming\n"
+                    "========================================\n");
+
+    string json = "[";
+    for (int i = 0; i < 300; i++) {
+        if (i)
+            json += ",\n    ";
+        json += "{\"key\\u00e9\\ud83d\\ude00\" : \"";
+        json += string(i * 7 % 1000, 'a' + i % 26);
+        json += "\", \"n\":[-1.5e-3, 12345678901234567890, true, false, null";
+        json += ", 9007199254740993.0000001], \"s\": \"\\\"\\\\\\n\"}";
+    }
+    json += "]   ";
+
+    struct json_parser* parser = jp_create();
+    JsonDumper expect_dumper;
+    expect_dumper.dump_tape(jp_parse_tape(parser, json.c_str(), json.size(),
+                                          0));
+    string expect = expect_dumper.get_buf();
+
+    static const uint32_t piece_sizes[] = { 1, 2, 7, 100, 1000, 4096, 65536 };
+    for (uint32_t i = 0; i < sizeof(piece_sizes)/sizeof(piece_sizes[0]);
+         i++) {
+        test_num++;
+        uint32_t piece = piece_sizes[i];
+        fprintf(stdout, "Testing pieces of %u bytes ... ", piece);
+
+        bool fed = true;
+        for (uint32_t ofst = 0; ofst < json.size() && fed; ofst += piece) {
+            uint32_t len = json.size() - ofst;
+            // Feed a copy, which is overwritten right after, to make sure
+            // the parser does not refer to the input afterwards.
+            string copy = json.substr(ofst, len < piece ? len : piece);
+            fed = jp_feed(parser, copy.c_str(), copy.size());
+            copy.assign(copy.size(), '#');
+        }
+
+        const jp_tape_t* tape = jp_finish(parser);
+        if (!fed || !tape) {
+            fprintf(stdout, "fail! %s\n", jp_get_err(parser));
+            fail_num++;
+            continue;
+        }
+
+        JsonDumper dumper;
+        dumper.dump_tape(tape);
+        if (expect.compare(dumper.get_buf())) {
+            fprintf(stdout, "fail! result differs\n");
+            fail_num++;
+        } else {
+            fprintf(stdout, "succ\n");
+        }
+    }
+
+    // jp_feed() should tell the error as early as possible, and the next
+    // jp_feed() after jp_finish() starts over.
+    test_num++;
+    fprintf(stdout, "Testing early error ... ");
+    bool succ = jp_feed(parser, "[1, 2", 5) && !jp_feed(parser, "}", 1) &&
+                !jp_feed(parser, "]", 1) && !jp_finish(parser) &&
+                jp_feed(parser, "[1, 2", 5) && jp_feed(parser, "]", 1) &&
+                jp_finish(parser);
+    if (!succ) {
+        fprintf(stdout, "fail!\n");
+        fail_num++;
+    } else {
+        fprintf(stdout, "succ\n");
+    }
+
+    jp_destroy(parser);
+}
+
+// Each json of the sequence should be parsed as if it were parsed alone by
+// jp_parse_tape().
+static void
+test_many() {
+    fprintf(stdout, "\n\nTest json sequence\n"
+                    "========================================\n");
+
+    static const char* jsons[] = {
+        "{\"ts\":1700000000, \"msg\":\"a\\nb\", \"tags\":[\"x\", null]}",
+        "[]",
+        "\"str\"",
+        "[1, [2, [3.5, {}]], true]",
+        "{}",
+        "false",
+        "-12",
+    };
+
+    struct json_parser* parser = jp_create();
+    string input, expect;
+    for (uint32_t i = 0; i < sizeof(jsons)/sizeof(jsons[0]); i++) {
+        JsonDumper dumper;
+        string json = string(jsons[i]) + "\n";
+        dumper.dump_tape(jp_parse_tape(parser, json.c_str(), json.size(), 0));
+        expect += dumper.get_buf();
+        expect += "\n";
+        input += json;
+    }
+    // no newline is needed between composite objects
+    input += " {\"k\":[]}[0]\r\n\n";
+    expect += "{\"k\":[]}\n[0]\n";
+
+    static const uint32_t flags[] = { 0, JP_STRUCT_INDEX | JP_PREALLOC };
+    for (uint32_t i = 0; i < sizeof(flags)/sizeof(flags[0]); i++) {
+        test_num++;
+        fprintf(stdout, "Testing sequence (flags:%u) ... ", flags[i]);
+
+        uint32_t json_num = 0;
+        const jp_tape_t* tape = jp_parse_many(parser, input.c_str(),
+                                              input.size(), flags[i],
+                                              &json_num);
+        if (!tape) {
+            fprintf(stdout, "fail! %s\n", jp_get_err(parser));
+            fail_num++;
+            continue;
+        }
+
+        JsonDumper dumper;
+        dumper.dump_tape_many(tape, json_num);
+        if (json_num != sizeof(jsons)/sizeof(jsons[0]) + 2 ||
+            expect.compare(dumper.get_buf())) {
+            fprintf(stdout, "fail! %u jsons:\n%s", json_num,
+                    dumper.get_buf());
+            fail_num++;
+        } else {
+            fprintf(stdout, "succ\n");
+        }
+    }
+
+    // An empty sequence is not an error
+    test_num++;
+    fprintf(stdout, "Testing empty sequence ... ");
+    uint32_t json_num = 1;
+    if (!jp_parse_many(parser, " \n\n", 3, 0, &json_num) || json_num != 0) {
+        fprintf(stdout, "fail!\n");
+        fail_num++;
+    } else {
+        fprintf(stdout, "succ\n");
+    }
+
+    // The last json needs no newline, even if it's a scalar, while a
+    // truncated scalar is still malformed.
+    static const struct {
+        const char* input;
+        const char* expect;     // the jsons, or NULL if malformed
+    } last_jsons[] = {
+        { "{\"a\":1}\n5", "{\"a\":1}\n5\n" },
+        { "[1]\nnull", "[1]\nnull\n" },
+        { "1 2", "1\n2\n" },
+        { "true\nfalse", "true\nfalse\n" },
+        { "[]-1.5e3", "[]\n-1500.00000000\n" },
+        // longer than the buffer of the copy of a literal at the end
+        { "[]0.12345678901234567890123456789012345678901234567890123456789012345",
+          "[]\n0.12345679\n" },
+        { "[1]\n1e", 0 },
+        { "[1]\nnul", 0 },
+        { "[1]\ntru", 0 },
+    };
+    for (uint32_t i = 0; i < sizeof(last_jsons)/sizeof(last_jsons[0]); i++) {
+        for (uint32_t f = 0; f < sizeof(flags)/sizeof(flags[0]); f++) {
+            test_num++;
+            fprintf(stdout, "Testing scalar at the end:%u (flags:%u) ... ", i,
+                    flags[f]);
+
+            const char* input = last_jsons[i].input;
+            const jp_tape_t* tape = jp_parse_many(parser, input, strlen(input),
+                                                  flags[f], &json_num);
+            JsonDumper dumper;
+            if (tape)
+                dumper.dump_tape_many(tape, json_num);
+
+            const char* expect = last_jsons[i].expect;
+            if (!tape != !expect || (tape && strcmp(dumper.get_buf(), expect))) {
+                fprintf(stdout, "fail! %s\n",
+                        tape ? dumper.get_buf() : jp_get_err(parser));
+                fail_num++;
+            } else {
+                fprintf(stdout, "succ\n");
+            }
+        }
+    }
+
+    // The error location tells which json is malformed
+    test_num++;
+    fprintf(stdout, "Testing malformed json ... ");
+    const char* bad = "{\"a\":1}\n[1, 2}\n{}\n";
+    const char* expect_err = "(line:2,col:7) Array syntax error, expect ',' or ']'";
+    if (jp_parse_many(parser, bad, strlen(bad), 0, &json_num) ||
+        strcmp(jp_get_err(parser), expect_err)) {
+        fprintf(stdout, "fail! %s\n", jp_get_err(parser));
+        fail_num++;
+    } else {
+        fprintf(stdout, "succ\n");
+    }
+
+    jp_destroy(parser);
+}
+
+// Parsing NDJSON in parallel should give the same jsons, in the same order,
+// as jp_parse_many() does, and so should the error location.
+static void
+test_pool() {
+    fprintf(stdout, "\n\nTest thread pool\n"
+                    "========================================\n");
+
+    string json;
+    char buf[128];
+    for (int i = 0; i < 20000; i++) {
+        snprintf(buf, sizeof(buf),
+                 "{\"id\":%d, \"name\":\"item%d\", \"v\":[%d.5, null]}\n",
+                 i, i, i % 97);
+        json += buf;
+    }
+
+    struct json_parser* parser = jp_create();
+    uint32_t json_num = 0;
+    const jp_tape_t* tape = jp_parse_many(parser, json.c_str(), json.size(),
+                                          0, &json_num);
+    JsonDumper expect_dumper;
+    expect_dumper.dump_tape_many(tape, json_num);
+    string expect = expect_dumper.get_buf();
+
+    static const uint32_t thread_nums[] = { 1, 4, 7 };
+    for (uint32_t i = 0; i < sizeof(thread_nums)/sizeof(thread_nums[0]); i++) {
+        uint32_t thread_num = thread_nums[i];
+        struct jp_pool* pool = jp_pool_create(thread_num);
+
+        test_num++;
+        fprintf(stdout, "Testing %u threads ... ", thread_num);
+        uint32_t slice_num = 0;
+        const jp_slice_t* slices = jp_pool_parse_many(pool, json.c_str(),
+                                                      json.size(), 0,
+                                                      &slice_num);
+        JsonDumper dumper;
+        for (uint32_t s = 0; slices && s < slice_num; s++)
+            dumper.dump_tape_many(slices[s].tape, slices[s].json_num);
+
+        if (!slices || slice_num != thread_num ||
+            expect.compare(dumper.get_buf() ? dumper.get_buf() : "")) {
+            fprintf(stdout, "fail! %u slices\n", slice_num);
+            fail_num++;
+        } else {
+            fprintf(stdout, "succ\n");
+        }
+
+        // A small input is not worth splitting
+        test_num++;
+        fprintf(stdout, "Testing small input (%u threads) ... ", thread_num);
+        slices = jp_pool_parse_many(pool, "[1]\n[2]\n", 8, 0, &slice_num);
+        if (!slices || slice_num != 1 || slices[0].json_num != 2) {
+            fprintf(stdout, "fail!\n");
+            fail_num++;
+        } else {
+            fprintf(stdout, "succ\n");
+        }
+
+        for (uint32_t flags = 0; flags <= JP_STRUCT_INDEX; flags++) {
+            test_num++;
+            fprintf(stdout, "Testing error location (%u threads, flags:%u) ... ",
+                    thread_num, flags);
+            string bad = json;
+            bad[bad.find(":[", bad.size() * 3 / 4) + 1] = '}';
+            jp_parse_many(parser, bad.c_str(), bad.size(), flags, &json_num);
+            string expect_err = jp_get_err(parser);
+
+            if (jp_pool_parse_many(pool, bad.c_str(), bad.size(), flags,
+                                   &slice_num) ||
+                expect_err.compare(jp_pool_get_err(pool))) {
+                fprintf(stdout, "fail! %s\n", jp_pool_get_err(pool));
+                fail_num++;
+            } else {
+                fprintf(stdout, "succ\n");
+            }
+        }
+
+        jp_pool_destroy(pool);
+    }
+
+    jp_destroy(parser);
+}
+
+// The ids of the composite objects should be 1 .. n in the reverse-nesting
+// order, n being the id of the 1st one.
+static bool
+verify_cobj_ids(const obj_t* obj) {
+    if (obj->obj_ty <= OT_LAST_PRIMITIVE)
+        return true;
+
+    const obj_composite_t* cobj = (const obj_composite_t*)(const void*)obj;
+    uint32_t id = cobj->id;
+    for (; cobj; cobj = cobj->reverse_nesting_order) {
+        if (cobj->id != id--)
+            return false;
+    }
+    return id == 0;
+}
+
+// Parsing a large array in parallel should give the same result as parsing
+// it as a whole, and so should the error message.
+static void
+test_pool_array() {
+    fprintf(stdout, "\n\nTest parallel array parsing\n"
+                    "========================================\n");
+
+    string json = "[";
+    char buf[128];
+    for (int i = 0; i < 30000; i++) {
+        if (i)
+            json += (i % 10) ? "," : ",\n  ";
+        switch (i % 4) {
+        case 0:
+            snprintf(buf, sizeof(buf), "{\"id\":%d, \"v\":[%d, [], {}]}", i, i);
+            break;
+        case 1:
+            snprintf(buf, sizeof(buf), "[[\"a,]\", %d.25], {\"k\":[null]}]", i);
+            break;
+        case 2:
+            snprintf(buf, sizeof(buf), "%d", i);
+            break;
+        default:
+            snprintf(buf, sizeof(buf), "\"str%d\"", i);
+            break;
+        }
+        json += buf;
+    }
+    json += "]\n";
+
+    struct json_parser* parser = jp_create();
+    JsonDumper expect_dumper;
+    expect_dumper.dump(jp_parse(parser, json.c_str(), json.size()));
+    string expect = expect_dumper.get_buf();
+
+    // The input is malformed at the given place, the latter of which is
+    // where a slice likely ends.
+    struct {
+        const char* desc;
+        string json;
+    } bad_inputs[] = {
+        { "bad element", json },
+        { "trailing comma", json.substr(0, json.size() - 2) + ",]" },
+        { "trailing junk", json + "]" },
+        { "not closed", json.substr(0, json.size() - 2) },
+        { "truncated right after a top-level comma",
+          json.substr(0, json.size() - 2) + "," },
+        // The last slice would be empty
+        { "empty slice", "[\"" + string(600000, 'a') + "\", 1,]" },
+    };
+    bad_inputs[0].json[json.find("\"id\":20000") + 4] = ']';
+
+    static const uint32_t thread_nums[] = { 1, 4, 7 };
+    for (uint32_t i = 0; i < sizeof(thread_nums)/sizeof(thread_nums[0]); i++) {
+        uint32_t thread_num = thread_nums[i];
+        struct jp_pool* pool = jp_pool_create(thread_num);
+
+        for (uint32_t flags = 0; flags <= JP_STRUCT_INDEX; flags++) {
+            test_num++;
+            fprintf(stdout, "Testing %u threads (flags:%u) ... ", thread_num,
+                    flags);
+            obj_t* obj = jp_pool_parse(pool, json.c_str(), json.size(), flags);
+            JsonDumper dumper;
+            if (obj)
+                dumper.dump(obj);
+
+            if (!obj || !verify_cobj_ids(obj) ||
+                expect.compare(dumper.get_buf())) {
+                fprintf(stdout, "fail!\n");
+                fail_num++;
+            } else {
+                fprintf(stdout, "succ\n");
+            }
+        }
+
+        for (uint32_t b = 0; b < sizeof(bad_inputs)/sizeof(bad_inputs[0]);
+             b++) {
+            test_num++;
+            fprintf(stdout, "Testing %s (%u threads) ... ", bad_inputs[b].desc,
+                    thread_num);
+            const string& bad = bad_inputs[b].json;
+            jp_parse(parser, bad.c_str(), bad.size());
+            string expect_err = jp_get_err(parser);
+
+            if (jp_pool_parse(pool, bad.c_str(), bad.size(), 0) ||
+                expect_err.compare(jp_pool_get_err(pool))) {
+                fprintf(stdout, "fail! %s\n", jp_pool_get_err(pool));
+                fail_num++;
+            } else {
+                fprintf(stdout, "succ\n");
+            }
+        }
+
+        jp_pool_destroy(pool);
+    }
+
+    jp_destroy(parser);
+}
+
 int
 main(int argc, char** argv) {
     test_driver("test_spec/test_token.txt", "Scaner testing cases");
@@ -105,6 +1495,96 @@ main(int argc, char** argv) {
     test_driver("test_spec/test_misc.txt", "Misc testing cases");
     test_driver("test_spec/test_diagnostic.txt", "Test diagnoistic information", true);
 
+    // Parsing with structural index should not make any difference.
+    test_driver("test_spec/test_token.txt", "Scaner testing cases (index)",
+                false, JP_STRUCT_INDEX);
+    test_driver("test_spec/test_composite.txt", "Test array/hashtab (index)",
+                false, JP_STRUCT_INDEX);
+    test_driver("test_spec/test_misc.txt", "Misc testing cases (index)",
+                false, JP_STRUCT_INDEX);
+    test_driver("test_spec/test_diagnostic.txt",
+                "Test diagnoistic information (index)", true, JP_STRUCT_INDEX);
+
+    // Nor should preallocating the memory.
+    test_driver("test_spec/test_composite.txt", "Test array/hashtab (prealloc)",
+                false, JP_PREALLOC);
+    test_driver("test_spec/test_token.txt", "Scaner testing cases (prealloc)",
+                false, JP_PREALLOC | JP_STRUCT_INDEX);
+
+    // The tape should tell the same story as the linked lists do.
+    test_driver("test_spec/test_token.txt", "Scaner testing cases (tape)",
+                false, 0, PARSE_TAPE);
+    test_driver("test_spec/test_composite.txt", "Test array/hashtab (tape)",
+                false, 0, PARSE_TAPE);
+    test_driver("test_spec/test_misc.txt", "Misc testing cases (tape)",
+                false, 0, PARSE_TAPE);
+    test_driver("test_spec/test_diagnostic.txt",
+                "Test diagnoistic information (tape)", true, 0, PARSE_TAPE);
+    test_driver("test_spec/test_composite.txt",
+                "Test array/hashtab (tape, index, prealloc)", false,
+                JP_STRUCT_INDEX | JP_PREALLOC, PARSE_TAPE);
+
+    // So should the input be split anywhere.
+    test_driver("test_spec/test_token.txt", "Scaner testing cases (stream)",
+                false, 0, PARSE_STREAM);
+    test_driver("test_spec/test_composite.txt", "Test array/hashtab (stream)",
+                false, 0, PARSE_STREAM);
+    test_driver("test_spec/test_misc.txt", "Misc testing cases (stream)",
+                false, 0, PARSE_STREAM);
+    test_driver("test_spec/test_diagnostic.txt",
+                "Test diagnoistic information (stream)", true, 0,
+                PARSE_STREAM);
+
+    // So should the input be validated only.
+    test_driver("test_spec/test_token.txt", "Scaner testing cases (validate)",
+                false, 0, PARSE_VALIDATE);
+    test_driver("test_spec/test_composite.txt",
+                "Test array/hashtab (validate)", false, 0, PARSE_VALIDATE);
+    test_driver("test_spec/test_misc.txt", "Misc testing cases (validate)",
+                false, 0, PARSE_VALIDATE);
+    test_driver("test_spec/test_diagnostic.txt",
+                "Test diagnoistic information (validate)", true, 0,
+                PARSE_VALIDATE);
+    test_driver("test_spec/test_diagnostic.txt",
+                "Test diagnoistic information (validate, index)", true,
+                JP_STRUCT_INDEX, PARSE_VALIDATE);
+
+    // Nor should the strings point into the input.
+    test_driver("test_spec/test_token.txt", "Scaner testing cases (zero-copy)",
+                false, JP_ZERO_COPY);
+    test_driver("test_spec/test_composite.txt",
+                "Test array/hashtab (zero-copy)", false, JP_ZERO_COPY);
+    test_driver("test_spec/test_misc.txt", "Misc testing cases (zero-copy)",
+                false, JP_ZERO_COPY | JP_STRUCT_INDEX);
+    test_driver("test_spec/test_diagnostic.txt",
+                "Test diagnoistic information (zero-copy)", true,
+                JP_ZERO_COPY);
+    test_driver("test_spec/test_token.txt",
+                "Scaner testing cases (tape, zero-copy)", false, JP_ZERO_COPY,
+                PARSE_TAPE);
+
+    test_err_location(0);
+    test_err_location(JP_STRUCT_INDEX);
+    test_err_location(0, PARSE_STREAM);
+    test_err_location(0, PARSE_VALIDATE);
+    test_err_location(JP_STRUCT_INDEX, PARSE_VALIDATE);
+
+    test_fp_conversion();
+    test_bounded_input();
+    test_mem_retention();
+    test_stream();
+    test_validate();
+    test_zero_copy();
+    test_str_chunk_end();
+    test_paths();
+    test_skip();
+    test_tape_lookup();
+    test_intern_keys();
+    test_flat();
+    test_many();
+    test_pool();
+    test_pool_array();
+
     fprintf(stdout,
             "\nSummary\n=====================================\n Test: %d, fail :%d\n",
             test_num, fail_num);
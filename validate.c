@@ -0,0 +1,133 @@
+/* ****************************************************************************
+ *
+ *   This file implements jp_validate(), which drives the scaner in the
+ * validation mode (see scaner_t::validate) through the same state machine
+ * as jp_parse_tape() does, but emits nothing at all. The only state is the
+ * types of the open composite objects, one byte each.
+ *
+ * ****************************************************************************
+ */
+#include <stdlib.h>
+#include "util.h"
+#include "parser.h"
+
+/* Double the capacity of the nesting stack, return 0 on OOM */
+static int __attribute__((noinline))
+grow_nesting(parser_t* parser) {
+    uint64_t cap = parser->nesting_cap ? parser->nesting_cap * 2 : 64;
+    if (unlikely(cap > UINT32_MAX))
+        return 0;
+
+    uint8_t* nesting = (uint8_t*)realloc(parser->nesting, cap);
+    if (unlikely(!nesting))
+        return 0;
+
+    parser->nesting = nesting;
+    parser->nesting_cap = cap;
+    return 1;
+}
+
+int
+validate(parser_t* parser) {
+    scaner_t* scaner = &parser->scaner;
+    const char* json_end = scaner->json_end;
+    uint32_t depth = 0;
+    obj_ty_t nesting = OT_ROOT; /* type of the innermost composite object */
+    tape_state_t state = TS_VALUE;
+
+    while (1) {
+        token_t* tk = sc_get_token(scaner, json_end);
+
+        switch (state) {
+        case TS_FIRST_ELMT:
+            if (tk->type == TT_CHAR && tk->char_val == ']')
+                goto close;
+            /* fall through */
+
+        case TS_VALUE:
+            if (tk_is_primitive(tk)) {
+                state = depth ? TS_NEXT : TS_END;
+                continue;
+            }
+
+            if (tk->type == TT_CHAR &&
+                (tk->char_val == '[' || tk->char_val == '{')) {
+                if (unlikely(depth == parser->nesting_cap) &&
+                    !grow_nesting(parser)) {
+                    parser->err_msg = "OOM";
+                    return 0;
+                }
+
+                int is_array = (tk->char_val == '[');
+                nesting = is_array ? OT_ARRAY : OT_HASHTAB;
+                parser->nesting[depth++] = nesting;
+                state = is_array ? TS_FIRST_ELMT : TS_FIRST_KEY;
+                continue;
+            }
+
+            report_value_err(parser, nesting, tk);
+            return 0;
+
+        case TS_FIRST_KEY:
+            if (tk->type == TT_CHAR && tk->char_val == '}')
+                goto close;
+            /* fall through */
+
+        case TS_KEY:
+            if (likely(tk->type == TT_STR)) {
+                state = TS_COLON;
+                continue;
+            }
+
+            report_key_err(parser, tk);
+            return 0;
+
+        case TS_COLON:
+            if (likely(tk->type == TT_CHAR && tk->char_val == ':')) {
+                state = TS_VALUE;
+                continue;
+            }
+
+            set_parser_err(parser, "expect ':'");
+            return 0;
+
+        case TS_NEXT:
+            {
+                int is_array = (nesting == OT_ARRAY);
+                if (likely(tk->type == TT_CHAR)) {
+                    char c = tk->char_val;
+                    if (c == ',') {
+                        state = is_array ? TS_VALUE : TS_KEY;
+                        continue;
+                    }
+
+                    if (c == (is_array ? ']' : '}'))
+                        goto close;
+                }
+
+                set_parser_err(parser, is_array ?
+                               "Array syntax error, expect ',' or ']'" :
+                               "hashtab syntax error");
+                return 0;
+            }
+
+        default:
+            ASSERT(state == TS_END);
+            if (tk->type == TT_END)
+                return 1;
+
+            set_parser_err(parser, "Extraneous stuff");
+            return 0;
+        }
+
+    close:
+        /* close the innermost composite object */
+        if (--depth) {
+            nesting = (obj_ty_t)parser->nesting[depth - 1];
+            state = TS_NEXT;
+        } else {
+            nesting = OT_ROOT;
+            state = TS_END;
+        }
+    }
+}